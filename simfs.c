@@ -13,6 +13,7 @@
 
 SIMFS_CONTEXT_TYPE *simfsContext; // all in-memory information about the system
 SIMFS_VOLUME *simfsVolume;
+static SIMFS_SHARED_SEGMENT_TYPE *simfsShared; // the segment holding both if the volume is mounted in shared memory
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -21,11 +22,11 @@ SIMFS_VOLUME *simfsVolume;
 //////////////////////////////////////////////////////////////////////////
 
 /*
- * Retuns a hash value within the limits of the directory.
+ * Retuns a hash value within the limits of the directory for a leaf name in the given parent folder.
  */
-inline unsigned long hash(unsigned char *str)
+inline unsigned long hash(SIMFS_INDEX_TYPE parent, unsigned char *str)
 {
-    register unsigned long hash = 5381;
+    register unsigned long hash = 5381 * 33 + parent;
     register unsigned char c;
 
     while ((c = *str++) != '\0')
@@ -41,9 +42,12 @@ inline unsigned short simfsFindFreeBlock(unsigned char *bitvector)
 {
     unsigned short i = 0;
     //while the bitector isn't full
-    while (bitvector[i] == 0xFF) //0xFF is a full bitvector
+    while (i < SIMFS_NUMBER_OF_BLOCKS / 8 && bitvector[i] == 0xFF) //0xFF is a full bitvector
         i += 1;
 
+    if (i == SIMFS_NUMBER_OF_BLOCKS / 8)
+        return SIMFS_INVALID_INDEX; // no free block left
+
     register unsigned char mask = 0x80; //is 10000000
     unsigned short j = 0;
     while (bitvector[i] & mask){
@@ -86,763 +90,6245 @@ inline void simfsClearBit(unsigned char *bitvector, unsigned short bitIndex)
 }
 
 /*
- * Allocates space for the file system and saves it to disk.
+ * Returns the number of free blocks in the in-memory bitvector.
  */
-SIMFS_ERROR simfsCreateFileSystem(char *simfsFileName)
+static unsigned int simfsCountFreeBlocks()
 {
+    unsigned int count = 0;
 
-    FILE *file = fopen(simfsFileName, "wb");
-    if (file == NULL)
-        return SIMFS_ALLOC_ERROR;
-
-    simfsContext = malloc(sizeof(SIMFS_CONTEXT_TYPE));
-    if (simfsContext == NULL)
-        return SIMFS_ALLOC_ERROR;
-
-    simfsVolume = malloc(sizeof(SIMFS_VOLUME));
-    if (simfsVolume == NULL)
-        return SIMFS_ALLOC_ERROR;
-
-    // initialize the superblock
+    for (unsigned int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if ((simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) == 0)
+            count++;
 
-    simfsVolume->superblock.rootNodeIndex = 0;
-    simfsVolume->superblock.blockSize = SIMFS_BLOCK_SIZE;
-    simfsVolume->superblock.numberOfBlocks = SIMFS_NUMBER_OF_BLOCKS;
+    return count;
+}
 
-    // initialize the blocks holding the root folder
+/*
+ * Finds a run of free blocks in the in-memory bitvector for length blocks. The first run that is long enough is
+ * returned; if there is none, the longest run is. The length of the returned run (at most length) is passed back
+ * through runLength.
+ *
+ * Returns SIMFS_INVALID_INDEX if the volume is full.
+ */
+static SIMFS_INDEX_TYPE simfsFindFreeRun(unsigned int length, unsigned int *runLength)
+{
+    SIMFS_INDEX_TYPE longestStart = SIMFS_INVALID_INDEX;
+    unsigned int longest = 0;
+    unsigned int start = 0;
+
+    for (unsigned int i = 0; i <= SIMFS_NUMBER_OF_BLOCKS; i++) {
+        if (i < SIMFS_NUMBER_OF_BLOCKS && (simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) == 0) {
+            if (i - start + 1 == length) {
+                *runLength = length;
+                return start;
+            }
+            continue;
+        }
+
+        if (i - start > longest) {
+            longest = i - start;
+            longestStart = start;
+        }
+        start = i + 1;
+    }
 
-    // initialize the root folder
+    *runLength = longest;
+    return longestStart;
+}
 
-    simfsVolume->block[0].type = FOLDER_CONTENT_TYPE;
-    simfsVolume->block[0].content.fileDescriptor.type = FOLDER_CONTENT_TYPE;
-    strcpy(simfsVolume->block[0].content.fileDescriptor.name, "/");
-    simfsVolume->block[0].content.fileDescriptor.accessRights = 0777; //arbitrary umask to allow for complete
-    simfsVolume->block[0].content.fileDescriptor.owner = 0; // arbitrarily simulated
-    simfsVolume->block[0].content.fileDescriptor.size = 0;
+/*
+ * Returns the number of allocated (live) blocks in a segment of the in-memory bitvector.
+ */
+static unsigned int simfsSegmentLiveBlocks(unsigned int segment)
+{
+    unsigned int count = 0;
 
-    struct timespec time;
-    clock_gettime(CLOCK_MONOTONIC, &time);
-    simfsVolume->block[0].content.fileDescriptor.creationTime = time.tv_sec;
-    simfsVolume->block[0].content.fileDescriptor.lastAccessTime = time.tv_sec;
-    simfsVolume->block[0].content.fileDescriptor.lastModificationTime = time.tv_sec;
+    for (unsigned int i = segment * SIMFS_SEGMENT_BLOCKS; i < (segment + 1) * SIMFS_SEGMENT_BLOCKS; i++)
+        if (simfsContext->bitvector[i / 8] & (0x80 >> (i % 8)))
+            count++;
 
-    // initialize the index block of the root folder
+    return count;
+}
 
-    // first, point from the root file descriptor to the index block
-    simfsVolume->block[0].content.fileDescriptor.block_ref = 1;
+/*
+ * Finds the next block of the log of a log-structured volume and advances the head of the log past it.
+ *
+ * The log fills a clean segment from its start to its end and then continues in the next clean segment (in the
+ * order of the segments, wrapping around at the end of the volume). Blocks taken in the segment meanwhile by
+ * something else (e.g., a run reserved for a file) are skipped. If no clean segment is left, the log is threaded
+ * through the free blocks of the other segments until the cleaner makes a segment clean again.
+ *
+ * Returns SIMFS_INVALID_INDEX if the volume is full.
+ */
+static SIMFS_INDEX_TYPE simfsFindLogBlock()
+{
+    SIMFS_INDEX_TYPE head = simfsContext->logHead;
+
+    for (int n = 0; n < SIMFS_NUMBER_OF_SEGMENTS; n++) {
+        if (head % SIMFS_SEGMENT_BLOCKS == 0) {
+            int segment = head / SIMFS_SEGMENT_BLOCKS;
+            int k = 0;
+
+            while (k < SIMFS_NUMBER_OF_SEGMENTS && simfsSegmentLiveBlocks((segment + k) % SIMFS_NUMBER_OF_SEGMENTS) > 0)
+                k++;
+            if (k == SIMFS_NUMBER_OF_SEGMENTS)
+                break;
+
+            head = (segment + k) % SIMFS_NUMBER_OF_SEGMENTS * SIMFS_SEGMENT_BLOCKS;
+        }
+
+        do {
+            if ((simfsContext->bitvector[head / 8] & (0x80 >> (head % 8))) == 0) {
+                simfsContext->logHead = (head + 1) % SIMFS_NUMBER_OF_BLOCKS;
+                return head;
+            }
+            head++;
+        } while (head % SIMFS_SEGMENT_BLOCKS != 0);
+
+        head %= SIMFS_NUMBER_OF_BLOCKS;
+        simfsContext->logHead = head;
+    }
 
-    simfsVolume->block[1].type = INDEX_CONTENT_TYPE;
+    return simfsFindFreeBlock((unsigned char *) simfsContext->bitvector);
+}
 
-    // indicate that the blocks #0 and #1 are allocated
+/*
+ * Returns the number of segments without allocated blocks.
+ */
+static unsigned int simfsCountCleanSegments()
+{
+    unsigned int count = 0;
 
-    simfsFlipBit(simfsVolume->bitvector, simfsFindFreeBlock(simfsVolume->bitvector)); // should be 0
-    simfsFlipBit(simfsVolume->bitvector, simfsFindFreeBlock(simfsVolume->bitvector)); // should be 1
+    for (unsigned int segment = 0; segment < SIMFS_NUMBER_OF_SEGMENTS; segment++)
+        if (simfsSegmentLiveBlocks(segment) == 0)
+            count++;
 
-    // sample alternative #1 - illustration of bit-wise operations
-//    simfsVolume->bitvector[0] = 0;
-//    simfsVolume->bitvector[0] |= 0x01 << 7; // set the first bit of the bit vector
-//    simfsVolume->bitvector[0] += 0x80 >> 1; // flip the first bit of the bit vector
+    return count;
+}
 
-    // sample alternative #2 - less educational, but fastest
-//     simfsVolume->bitvector[0] = 0xC0;
-    // 0xC0 is 11000000 in binary (showing the root block and root's index block taken)
-    strcpy(simfsContext->bitvector, simfsVolume->bitvector);
+/*
+ * Returns the current time for the timestamps of files, folders and snapshots.
+ *
+ * With the coarseClock mount option the time is read from CLOCK_REALTIME_COARSE, which the kernel advances once
+ * per tick and which is read from the vDSO without entering the kernel. Timestamps have a resolution of a second,
+ * so the coarse clock loses nothing.
+ */
+static time_t simfsNow()
+{
+    struct timespec time;
 
-    fwrite(simfsVolume, 1, sizeof(SIMFS_VOLUME), file);
+#ifdef CLOCK_REALTIME_COARSE
+    if (simfsContext != NULL && simfsContext->options.coarseClock) {
+        clock_gettime(CLOCK_REALTIME_COARSE, &time);
+        return time.tv_sec;
+    }
+#endif
 
-    fclose(file);
+    clock_gettime(CLOCK_REALTIME, &time);
+    return time.tv_sec;
+}
 
-    return SIMFS_NO_ERROR;
+/*
+ * Returns non-zero if the file or folder belongs to a snapshot, that is, if its chain of parents ends at a root
+ * named with the prefix '@' (see simfsCreateSnapshot).
+ */
+static int simfsIsInSnapshot(SIMFS_FILE_DESCRIPTOR_TYPE *fd)
+{
+    while (fd->parent != SIMFS_INVALID_INDEX)
+        fd = &simfsVolume->block[fd->parent].content.fileDescriptor;
+    return fd->name[0] == '@';
 }
 
 /*
- * Takes a folder block and goes through each fileDescriptor pointed to by the index array (the index array pointed to from the folder block_ref)
- * 
- * If another folder is found, pass that folder into the same function to go through that folder.
- *  Otherwise:
- *  	Hash the fileName and store the block_ref at that location in the directory 
+ * Records an access to a file or a folder according to the access time policy of the mount. Returns non-zero if
+ * the time of the last access was changed.
  *
+ * Files and folders without write permission and those of snapshots are read-only, so their access times are
+ * never changed.
  */
+#define SIMFS_RELATIME_INTERVAL (24 * 60 * 60) // relatime updates access times at least once a day
 
-SIMFS_ERROR AddFolderToContext(SIMFS_BLOCK_TYPE folder, SIMFS_CONTEXT_TYPE *context){
+static int simfsTouchAccessTime(SIMFS_FILE_DESCRIPTOR_TYPE *fd)
+{
+    if (simfsContext->options.atime == SIMFS_NOATIME)
+        return 0;
 
-	if(folder.content.fileDescriptor.size <= 0){
-		return SIMFS_NO_ERROR;
-	}
+    if (!(fd->accessRights & 0200) || simfsIsInSnapshot(fd))
+        return 0;
 
-	for(int i = 0; i < folder.content.fileDescriptor.size; i++){
+    time_t now = simfsNow();
 
-		SIMFS_BLOCK_TYPE indexBlock = simfsVolume->block[folder.content.fileDescriptor.block_ref];
-		SIMFS_BLOCK_TYPE blockAtIndex = simfsVolume->block[indexBlock.content.index[i]];
+    if (simfsContext->options.atime == SIMFS_RELATIME && fd->lastAccessTime > fd->lastModificationTime &&
+        now - fd->lastAccessTime < SIMFS_RELATIME_INTERVAL)
+        return 0;
 
-		if(blockAtIndex.content.fileDescriptor.type == FOLDER_CONTENT_TYPE){
-			AddFolderToContext(blockAtIndex, context);
-		}
+    if (fd->lastAccessTime == now)
+        return 0;
 
-		context->directory[hash(blockAtIndex.content.fileDescriptor.name)].nodeReference = blockAtIndex.content.fileDescriptor.block_ref;
-	}
-	return SIMFS_NO_ERROR;
+    fd->lastAccessTime = now;
+    return 1;
 }
 
 /*
- * Loads the file system from a disk and constructs in-memory directory of all files is the system.
- *
- * Starting with the file system root (pointed to from the superblock) traverses the hierarachy of directories
- * and adds en entry for each folder or file to the directory by hashing the name and adding a directory
- * entry node to the conflict resolution list for that entry. If the entry is NULL, the new node will be
- * the only element of that list.
- *
- * The function sets the current working directory to refer to the block holding the root of the volume. This will
- * be changed as the user navigates the file system hierarchy.
+ * Conversion between the offsets that the in-memory structures use to refer to each other and pointers in the
+ * address space of the calling process (see SIMFS_OFFSET_TYPE). Offsets are taken from simfsContext.
+ */
+static void *simfsPointer(SIMFS_OFFSET_TYPE offset)
+{
+    return offset == 0 ? NULL : (void *) ((uintptr_t) simfsContext + offset);
+}
+
+static SIMFS_OFFSET_TYPE simfsOffset(void *object)
+{
+    return object == NULL ? 0 : (uintptr_t) object - (uintptr_t) simfsContext;
+}
+
+/*
+ * Arena and slab pools for the in-memory structures of the mounted volume.
  *
+ * Allocations are aligned for any type. simfsArenaRelease returns all chunks to the heap, which also invalidates
+ * every object of the pools carved from the arena. A fixed arena (in a shared segment) returns NULL when it is full.
  */
-SIMFS_ERROR simfsMountFileSystem(char *simfsFileName)
+#define SIMFS_ARENA_ALIGNMENT 16
+
+static void *simfsArenaAllocate(SIMFS_ARENA_TYPE *arena, size_t size)
 {
-    simfsContext = malloc(sizeof(SIMFS_CONTEXT_TYPE));
-    if (simfsContext == NULL)
-        return SIMFS_ALLOC_ERROR;
+    size = (size + SIMFS_ARENA_ALIGNMENT - 1) / SIMFS_ARENA_ALIGNMENT * SIMFS_ARENA_ALIGNMENT;
 
-    simfsVolume = malloc(sizeof(SIMFS_VOLUME));
-    if (simfsVolume == NULL)
-        return SIMFS_ALLOC_ERROR;
+    SIMFS_ARENA_CHUNK_TYPE *chunk = simfsPointer(arena->chunks);
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        if (arena->fixed)
+            return NULL;
 
-    FILE *file = fopen(simfsFileName, "rb");
-    if (file == NULL)
-        return SIMFS_ALLOC_ERROR;
+        size_t chunkSize = size > SIMFS_ARENA_CHUNK_SIZE ? size : SIMFS_ARENA_CHUNK_SIZE;
 
-    fread(simfsVolume, 1, sizeof(SIMFS_VOLUME), file);
+        chunk = malloc(sizeof(SIMFS_ARENA_CHUNK_TYPE) + chunkSize + SIMFS_ARENA_ALIGNMENT);
+        if (chunk == NULL)
+            return NULL;
 
-    AddFolderToContext(simfsVolume->block[simfsVolume->superblock.rootNodeIndex], simfsContext);
+        // the first object starts at an aligned address
+        chunk->size = chunkSize;
+        chunk->used = (SIMFS_ARENA_ALIGNMENT - (size_t) chunk->memory % SIMFS_ARENA_ALIGNMENT) % SIMFS_ARENA_ALIGNMENT;
+        chunk->next = arena->chunks;
+        arena->chunks = simfsOffset(chunk);
+        arena->bytesReserved += sizeof(SIMFS_ARENA_CHUNK_TYPE) + chunkSize + SIMFS_ARENA_ALIGNMENT;
+    }
 
-    strcpy(simfsContext->bitvector, simfsVolume->bitvector);
+    void *object = chunk->memory + chunk->used;
+    chunk->used += size;
 
-    fclose(file);
-    return SIMFS_NO_ERROR;
+    return object;
+}
 
-    // TODO: complete
+static void simfsArenaRelease(SIMFS_ARENA_TYPE *arena)
+{
+    if (arena->fixed)
+        return; // the chunk goes with the segment
 
+    while (arena->chunks != 0) {
+        SIMFS_ARENA_CHUNK_TYPE *chunk = simfsPointer(arena->chunks);
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+    arena->bytesReserved = 0;
 }
 
-/*
- * Saves the file system to a disk and de-allocates the memory.
- *
- * Assumes that all synchronization has been done.
- *
- */
-SIMFS_ERROR simfsUmountFileSystem(char *simfsFileName)
+static void simfsPoolInit(SIMFS_POOL_TYPE *pool, size_t objectSize)
 {
-    FILE *file = fopen(simfsFileName, "wb");
-    if (file == NULL)
-        return SIMFS_ALLOC_ERROR;
+    pool->objectSize = objectSize < sizeof(SIMFS_OFFSET_TYPE) ? sizeof(SIMFS_OFFSET_TYPE) : objectSize;
+    pool->freeList = 0;
+    pool->objectsInUse = 0;
+}
 
-    fwrite(simfsVolume, 1, sizeof(SIMFS_VOLUME), file);
-    //save the actual files on ur computer...
-    fclose(file);
+static void *simfsPoolAllocate(SIMFS_POOL_TYPE *pool)
+{
+    void *object = simfsPointer(pool->freeList);
 
-    free(simfsVolume);
-    free(simfsContext);
+    if (object != NULL)
+        pool->freeList = *(SIMFS_OFFSET_TYPE *) object;
+    else if ((object = simfsArenaAllocate(&simfsContext->arena, pool->objectSize)) == NULL)
+        return NULL;
 
-    return SIMFS_NO_ERROR;
+    pool->objectsInUse++;
+    return object;
 }
 
-//////////////////////////////////////////////////////////////////////////
+static void simfsPoolRelease(SIMFS_POOL_TYPE *pool, void *object)
+{
+    *(SIMFS_OFFSET_TYPE *) object = pool->freeList;
+    pool->freeList = simfsOffset(object);
+    pool->objectsInUse--;
+}
 
 /*
- * Depending on the type parameter the function creates a file or a folder in the current directory
- * of the process. If the process does not have an entry in the processControlBlock, then the root directory
- * is assumed to be its current working directory.
- *
- * Hashes the file name and check if the file with such name already exists in the in-memory directory.
- * If it is then it return SIMFS_DUPLICATE_ERROR.
- * Otherwise:
- *    - finds an available block in the storage using the in-memory bitvector and flips the bit to indicate
- *      that the block is taken
- *    - initializes a local buffer for the file descriptor block with the block type depending on the parameter type
- *      (i.e., folder or file)
- *    - creates an entry in the conflict resolution list for the corresponding in-memory directory entry
- *    - copies the local buffer to the disk block that was found to be free
- *    - copies the in-memory bitvector to the bitevector blocks on the simulated disk
- *
- *  The access rights and the the owner are taken from the context (umask and uid correspondingly).
- *
+ * Sets up the arena and the pools of a new context. In a shared segment, the arena is the given memory, which
+ * must follow the context in the segment; otherwise memory is NULL and the arena takes chunks from the heap.
  */
-SIMFS_ERROR simfsCreateFile(SIMFS_NAME_TYPE fileName, SIMFS_CONTENT_TYPE type)
+static void simfsContextInit(SIMFS_CONTEXT_TYPE *context, char *memory, size_t size)
 {
-    // TODO: implement
+    context->arena.chunks = 0;
+    context->arena.bytesReserved = 0;
+    context->arena.fixed = memory != NULL;
+
+    if (memory != NULL) {
+        SIMFS_ARENA_CHUNK_TYPE *chunk = (SIMFS_ARENA_CHUNK_TYPE *) memory;
+        chunk->next = 0;
+        chunk->size = size - sizeof(SIMFS_ARENA_CHUNK_TYPE);
+        chunk->used = 0;
+        context->arena.chunks = (uintptr_t) chunk - (uintptr_t) context;
+        context->arena.bytesReserved = size;
+    }
 
-	unsigned short free = simfsFindFreeBlock(simfsContext->bitvector);
-	simfsFlipBit(simfsContext->bitvector, free);
+    simfsPoolInit(&context->directoryEntryPool, sizeof(SIMFS_DIR_ENT));
+    simfsPoolInit(&context->processControlBlockPool, sizeof(SIMFS_PROCESS_CONTROL_BLOCK_TYPE));
+    for (int i = 0; i < SIMFS_READ_BUFFER_CLASSES; i++)
+        simfsPoolInit(&context->readBufferPool[i], (size_t) 64 << i);
+}
 
-	SIMFS_BLOCK_TYPE curr_block;
+/*
+ * Read buffers are taken from the pool of the smallest class that fits; a header in front of the buffer records
+ * the class, or -1 for a buffer that comes from the heap (it is too large for any class, or the pool is out of memory).
+ */
+#define SIMFS_READ_BUFFER_HEADER SIMFS_ARENA_ALIGNMENT
 
-    if(simfsContext->processControlBlocks != NULL){
-    	curr_block = simfsVolume->block[simfsContext->processControlBlocks->currentWorkingDirectory];
-    }
-    else{
-    	curr_block = simfsVolume->block[simfsVolume->superblock.rootNodeIndex];
+static char *simfsAllocateReadBuffer(size_t size)
+{
+    int class = 0;
+    while (class < SIMFS_READ_BUFFER_CLASSES && ((size_t) 64 << class) < size + SIMFS_READ_BUFFER_HEADER)
+        class++;
+
+    char *buffer = class < SIMFS_READ_BUFFER_CLASSES ? simfsPoolAllocate(&simfsContext->readBufferPool[class]) : NULL;
+    if (buffer == NULL) {
+        // too large for the pools, or the fixed arena of a shared mount is full
+        class = -1;
+        buffer = malloc(size + SIMFS_READ_BUFFER_HEADER);
+        if (buffer == NULL)
+            return NULL;
     }
 
-    if(curr_block.type != FOLDER_CONTENT_TYPE){
-    	printf("Current Directory is not a Folder\n");
-    	return SIMFS_NOT_FOUND_ERROR;
-    }
-    
-    SIMFS_BLOCK_TYPE index_block = simfsVolume->block[curr_block.content.fileDescriptor.block_ref];
-    if(index_block.type != INDEX_CONTENT_TYPE){
-    	printf("CurrentDirectory does not point to Index Block\n");
-    	return SIMFS_NOT_FOUND_ERROR;
-    }
+    *(int *) buffer = class;
+    return buffer + SIMFS_READ_BUFFER_HEADER;
+}
 
-    SIMFS_NAME_TYPE fileName_actual;
+/*
+ * CRC32C (Castagnoli) checksums of blocks.
+ *
+ * On processors with SSE4.2 the checksum is computed with the crc32 instruction, eight bytes at a time; elsewhere
+ * a table-driven implementation of the same polynomial (reflected 0x82F63B78) is used. simfsCrc32cInit selects
+ * the implementation and must be called before the first checksum is computed.
+ */
+static unsigned int simfsCrc32cTable[256];
+static unsigned int (*simfsCrc32c)(const unsigned char *data, size_t length);
 
-    sprintf(fileName_actual, "%s%s/", curr_block.content.fileDescriptor.name, fileName);
+static unsigned int simfsCrc32cSoftware(const unsigned char *data, size_t length)
+{
+    unsigned int crc = 0xFFFFFFFF;
 
-    //printf("OG: %s ACTUAL: %s\n", fileName, fileName_actual);
+    while (length-- > 0)
+        crc = simfsCrc32cTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
 
-    //printf("Path: %s\n", fileName_actual);
+    return ~crc;
+}
 
-    SIMFS_DIR_ENT *hash_dir = &(simfsContext->directory[hash(fileName_actual)]);
-    //printf("HashedNode%d\n", hash_dir->nodeReference);
+#if defined(__x86_64__)
+#include <nmmintrin.h>
 
-    while(hash_dir->nodeReference != 0){
-		if(strcmp(simfsVolume->block[hash_dir->nodeReference].content.fileDescriptor.name, fileName_actual) == 0){
-			//duplicate found
-			return SIMFS_DUPLICATE_ERROR;
-		}
-		else{
-			if(hash_dir->next == NULL){
-				hash_dir->next = malloc(sizeof(SIMFS_DIR_ENT));
-				hash_dir = hash_dir->next;
-				break;
-			}
-			else{
-				hash_dir = hash_dir->next;
-			}
-		}
-	}
+__attribute__((target("sse4.2")))
+static unsigned int simfsCrc32cHardware(const unsigned char *data, size_t length)
+{
+    unsigned long long crc = 0xFFFFFFFF;
 
-	hash_dir->nodeReference = free;
-	hash_dir->next = NULL;
+    for (; length >= 8; data += 8, length -= 8) {
+        unsigned long long word;
+        memcpy(&word, data, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+    while (length-- > 0)
+        crc = _mm_crc32_u8((unsigned int) crc, *data++);
 
-	//got here with no errors, so now set up actual file
+    return ~(unsigned int) crc;
+}
+#endif
 
-    SIMFS_FILE_DESCRIPTOR_TYPE fd = simfsVolume->block[free].content.fileDescriptor;
+static void simfsCrc32cInit()
+{
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        simfsCrc32cTable[i] = crc;
+    }
 
-	fd.type = type;
-	strcpy(fd.name, fileName_actual);
+    simfsCrc32c = simfsCrc32cSoftware;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+        simfsCrc32c = simfsCrc32cHardware;
+#endif
+}
 
-	fd.block_ref = simfsFindFreeBlock(simfsContext->bitvector);
-	simfsFlipBit(simfsContext->bitvector, fd.block_ref);
+static void simfsUpdateChecksum(SIMFS_INDEX_TYPE blockIndex)
+{
+    simfsVolume->checksum[blockIndex] = simfsCrc32c((unsigned char *) &simfsVolume->block[blockIndex], sizeof(SIMFS_BLOCK_TYPE));
+}
 
-	SIMFS_CONTENT_TYPE block_ref_type;
+static int simfsChecksumValid(SIMFS_INDEX_TYPE blockIndex)
+{
+    return simfsVolume->checksum[blockIndex] ==
+           simfsCrc32c((unsigned char *) &simfsVolume->block[blockIndex], sizeof(SIMFS_BLOCK_TYPE));
+}
 
-	switch(type){
-		case FOLDER_CONTENT_TYPE:
-			block_ref_type = INDEX_CONTENT_TYPE;
-				break;
-		case FILE_CONTENT_TYPE:
-			block_ref_type = DATA_CONTENT_TYPE;
-				break;
-		default:
-			return SIMFS_ACCESS_ERROR;
-	}
+/*
+ * Checksums the allocated folder, file and index blocks before the volume is saved. The checksums of data blocks
+ * are kept up to date on every write, so a data block that got corrupted in memory is not sealed with a new one.
+ *
+ * The volume is sealed with the given generation, which is stamped on the blocks that changed since the last seal:
+ * on their content if they are marked in the changed blocks of the context or are folder, file and index blocks
+ * whose checksums differ from the sealed ones, and on their reference count if they are marked in the changed
+ * references. When a volume is sealed for the first time, every allocated block is stamped.
+ */
+static void simfsSealChecksums(unsigned int generation)
+{
+    int first = simfsVolume->superblock.generation == 0;
+
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++) {
+        int allocated = simfsVolume->bitvector[i / 8] & (0x80 >> (i % 8));
+        int changed = simfsContext->changedBlocks[i / 8] & (0x80 >> (i % 8));
+        int shared = simfsContext->changedReferences[i / 8] & (0x80 >> (i % 8));
+
+        if (allocated && simfsVolume->block[i].type != DATA_CONTENT_TYPE) {
+            unsigned int sealed = simfsVolume->checksum[i];
+            simfsUpdateChecksum(i);
+            changed |= simfsVolume->checksum[i] != sealed;
+        }
+
+        if (changed || (allocated && first))
+            simfsVolume->generation[i] = generation;
+        if (shared || (allocated && first))
+            simfsVolume->referenceGeneration[i] = generation;
+    }
 
-	simfsVolume->block[fd.block_ref].type = block_ref_type;
+    memset(simfsContext->changedBlocks, 0, sizeof(simfsContext->changedBlocks));
+    memset(simfsContext->changedReferences, 0, sizeof(simfsContext->changedReferences));
+    simfsVolume->superblock.generation = generation;
+}
 
-	//DEAL WITH FOLDER SIZE PROBLEMS...
-	if(curr_block.content.fileDescriptor.size == SIMFS_INDEX_SIZE - 1){
-		//size has reached max, set the final block to point to an index...
-		index_block.content.index[curr_block.content.fileDescriptor.size] = simfsFindFreeBlock(simfsContext->bitvector);
-		simfsFlipBit(simfsContext->bitvector, index_block.content.index[curr_block.content.fileDescriptor.size]);
-		simfsVolume->block[index_block.content.index[SIMFS_INDEX_SIZE]].type = INDEX_CONTENT_TYPE;
-	}
-	else{
-		for(int i = 0; i < curr_block.content.fileDescriptor.size; i++){
-			if(index_block.content.index[i] == 0){
-				index_block.content.index[i] = free;
-				break;
-			}
-		}
-	}
+/*
+ * Fingerprint index for deduplication.
+ *
+ * The index chains the data blocks by the FNV-1a hash of their content. A fingerprint only selects candidates;
+ * whether two blocks are equal is always decided by comparing their content.
+ */
+static unsigned int simfsFingerprint(char *data)
+{
+    unsigned int fingerprint = 2166136261u;
 
-	fd.accessRights = curr_block.content.fileDescriptor.accessRights;
-    fd.owner = curr_block.content.fileDescriptor.owner; // arbitrarily simulated
-    curr_block.content.fileDescriptor.size++;
+    for (int i = 0; i < SIMFS_DATA_SIZE; i++)
+        fingerprint = (fingerprint ^ (unsigned char) data[i]) * 16777619u;
 
-    struct timespec time;
-    clock_gettime(CLOCK_MONOTONIC, &time);
-    fd.creationTime = time.tv_sec;
-    fd.lastAccessTime = time.tv_sec;
-    fd.lastModificationTime = time.tv_sec;
-    simfsVolume->block[free].content.fileDescriptor = fd;
+    return fingerprint;
+}
 
-    strcpy(simfsVolume->bitvector, simfsContext->bitvector);
+static void simfsRememberFingerprint(SIMFS_INDEX_TYPE blockIndex)
+{
+    unsigned int fingerprint = simfsFingerprint(simfsVolume->block[blockIndex].content.data);
+    SIMFS_INDEX_TYPE *head = &simfsContext->fingerprintTable[fingerprint % SIMFS_FINGERPRINT_TABLE_SIZE];
 
-    return SIMFS_NO_ERROR;
+    simfsContext->fingerprint[blockIndex] = fingerprint;
+    simfsContext->fingerprintNext[blockIndex] = *head;
+    *head = blockIndex;
 }
 
-//////////////////////////////////////////////////////////////////////////
+static void simfsForgetFingerprint(SIMFS_INDEX_TYPE blockIndex)
+{
+    SIMFS_INDEX_TYPE *link = &simfsContext->fingerprintTable[simfsContext->fingerprint[blockIndex] % SIMFS_FINGERPRINT_TABLE_SIZE];
+
+    while (*link != 0) {
+        if (*link == blockIndex) {
+            *link = simfsContext->fingerprintNext[blockIndex];
+            simfsContext->fingerprintNext[blockIndex] = 0;
+            return;
+        }
+        link = &simfsContext->fingerprintNext[*link];
+    }
+}
 
 /*
- * Deletes a file from the file system.
- *
- * Hashes the file name and check if the file is in the directory. If not, then it returns SIMFS_NOT_FOUND_ERROR.
- * Otherwise:
- *    - finds the reference to the file descriptor block
- *    - if the referenced block is a folder that is not empty, then returns SIMFS_NOT_EMPTY_ERROR.
- *    - Otherwise:
- *       - checks if the process owner can delete this file or folder; if not, it returns SIMFS_ACCESS_ERROR.
- *       - Otherwise:
- *          - frees all blocks belonging to the file by flipping the corresponding bits in the in-memory bitvector
- *          - frees the reference block by flipping the corresponding bit in the in-memory bitvector
- *          - clears the entry in the folder by removing the corresponding node in the list associated with
- *            the slot for this file
- *          - copies the in-memory bitvector to the bitvector blocks on the simulated disk
+ * Returns an indexed data block with the given content that can take one more reference, or SIMFS_INVALID_INDEX.
  */
-SIMFS_ERROR simfsDeleteFile(SIMFS_NAME_TYPE fileName)
+static SIMFS_INDEX_TYPE simfsFindDuplicateBlock(char *data)
 {
-    // TODO: implement
-    //printf("Deleting: %s\n", fileName);
-    SIMFS_DIR_ENT *dir = &(simfsContext->directory[hash(fileName)]);
-    if(dir->nodeReference == 0){
-    	//nothing hashed there, nothing to delete
-    	return SIMFS_NOT_FOUND_ERROR;
-    }
+    unsigned int fingerprint = simfsFingerprint(data);
 
+    for (SIMFS_INDEX_TYPE candidate = simfsContext->fingerprintTable[fingerprint % SIMFS_FINGERPRINT_TABLE_SIZE];
+         candidate != 0; candidate = simfsContext->fingerprintNext[candidate])
+        if (simfsContext->fingerprint[candidate] == fingerprint &&
+            simfsVolume->referenceCount[candidate] < 0xFFFF &&
+            memcmp(simfsVolume->block[candidate].content.data, data, SIMFS_DATA_SIZE) == 0)
+            return candidate;
 
-    //getting here means the file exists
-    SIMFS_BLOCK_TYPE curr_block = simfsVolume->block[dir->nodeReference];
+    return SIMFS_INVALID_INDEX;
+}
 
-    if(curr_block.content.fileDescriptor.type == FOLDER_CONTENT_TYPE){
-    	if(curr_block.content.fileDescriptor.size > 0){
-    		return SIMFS_NOT_EMPTY_ERROR;
-    	}
-    }
+static unsigned int simfsReservedSlots(size_t reserved, char compression);
 
-    //USE BIT MANIPULATION TO CHECK FOR OWNER
-    //U:rwxG:rwxO:rwx
-    //022 -> 000 000 001 
-    if(curr_block.content.fileDescriptor.accessRights&0001){
-    	//if the accessRight's owner execute bit is 1, then the owner can delete files
-    	SIMFS_BLOCK_TYPE index_block = simfsVolume->block[curr_block.content.fileDescriptor.block_ref];
-    	//free all the blocks in the file
-    	for(int i = 0; i < curr_block.content.fileDescriptor.size; i++){
-    		simfsClearBit(simfsContext->bitvector, index_block.content.index[i]);
-    	}
-    	simfsClearBit(simfsContext->bitvector, curr_block.content.fileDescriptor.block_ref);
-    	dir->nodeReference = 0;
-    	strcpy(simfsVolume->bitvector, simfsContext->bitvector);
-    }
-    else{
-    	return SIMFS_ACCESS_ERROR;
+/*
+ * Rebuilds the fingerprint index from all allocated data blocks, except those in slots reserved for a file (see
+ * simfsStoreData), which are kept out of the index so no other file comes to share them.
+ */
+static void simfsBuildFingerprintIndex()
+{
+    char reserved[SIMFS_NUMBER_OF_BLOCKS];
+
+    memset(simfsContext->fingerprintTable, 0, sizeof(simfsContext->fingerprintTable));
+    memset(simfsContext->fingerprintNext, 0, sizeof(simfsContext->fingerprintNext));
+
+    if (!simfsVolume->superblock.deduplication)
+        return;
+
+    memset(reserved, 0, sizeof(reserved));
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++) {
+        SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[i].content.fileDescriptor;
+        if (simfsVolume->referenceCount[i] == 0 || simfsVolume->block[i].type != FILE_CONTENT_TYPE || fd->reserved == 0)
+            continue;
+
+        unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression), slot = 0;
+        for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref;
+             indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX && slot < reservedSlots;
+             indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+            for (unsigned int k = 0; k < SIMFS_INDEX_ENTRIES_PER_BLOCK && slot < reservedSlots; k++, slot++)
+                reserved[simfsVolume->block[indexBlock].content.index[k]] = 1;
     }
 
-    return SIMFS_NO_ERROR;
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->referenceCount[i] > 0 && simfsVolume->block[i].type == DATA_CONTENT_TYPE && !reserved[i])
+            simfsRememberFingerprint(i);
 }
 
-//////////////////////////////////////////////////////////////////////////
-
 /*
- * Finds the file in the in-memory directory and obtains the information about the file from the file descriptor
- * block referenced from the directory.
+ * Block allocation with reference counts.
  *
- * If the file is not found, then it returns SIMFS_NOT_FOUND_ERROR
+ * A newly allocated block is cleared and has a reference count of 1. Sharing a block (e.g., between the live tree
+ * and a snapshot) increments the count and releasing it decrements the count; the bit in the in-memory bitvector is
+ * cleared only when the last reference is gone. As before, the callers copy the in-memory bitvector to the volume.
+ * On a log-structured volume, new blocks are taken from the log (see simfsFindLogBlock). The blocks are marked
+ * as changed for the next seal: a new block in its content and its count, a shared or released one in its count.
+ *
+ * simfsAllocateBlock returns SIMFS_INVALID_INDEX if the volume is full.
  */
-SIMFS_ERROR simfsGetFileInfo(SIMFS_NAME_TYPE fileName, SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffer)
+static void simfsClaimBlock(SIMFS_INDEX_TYPE blockIndex, SIMFS_CONTENT_TYPE type)
 {
-    // TODO: implement
-    SIMFS_DIR_ENT *dir = &(simfsContext->directory[hash(fileName)]);
+    simfsSetBit((unsigned char *) simfsContext->bitvector, blockIndex);
+    simfsSetBit((unsigned char *) simfsContext->changedBlocks, blockIndex);
+    simfsSetBit((unsigned char *) simfsContext->changedReferences, blockIndex);
+    simfsVolume->referenceCount[blockIndex] = 1;
+
+    memset(&simfsVolume->block[blockIndex], 0, sizeof(SIMFS_BLOCK_TYPE));
+    simfsVolume->block[blockIndex].type = type;
+    simfsUpdateChecksum(blockIndex);
+}
 
-    if(dir->nodeReference == 0)
-    	return SIMFS_NOT_FOUND_ERROR;
+SIMFS_INDEX_TYPE simfsAllocateBlock(SIMFS_CONTENT_TYPE type)
+{
+    SIMFS_INDEX_TYPE blockIndex = simfsVolume->superblock.engine == SIMFS_LOG_STRUCTURED_ENGINE ?
+        simfsFindLogBlock() : simfsFindFreeBlock((unsigned char *) simfsContext->bitvector);
+    if (blockIndex == SIMFS_INVALID_INDEX)
+        return SIMFS_INVALID_INDEX;
 
-    SIMFS_FILE_DESCRIPTOR_TYPE fd = simfsVolume->block[dir->nodeReference].content.fileDescriptor;
+    simfsClaimBlock(blockIndex, type);
 
-    infoBuffer->type = fd.type;
-    strcpy(infoBuffer->name, fd.name);
-    infoBuffer->creationTime = fd.creationTime;
+    return blockIndex;
+}
 
-    struct timespec time;
-    clock_gettime(CLOCK_MONOTONIC, &time);
-    fd.lastAccessTime = time.tv_sec;
+void simfsShareBlock(SIMFS_INDEX_TYPE blockIndex)
+{
+    simfsVolume->referenceCount[blockIndex]++;
+    simfsSetBit((unsigned char *) simfsContext->changedReferences, blockIndex);
+}
 
-    infoBuffer->lastAccessTime = fd.lastAccessTime; //UPADTE THIS RIGHT NOW
-    infoBuffer->lastModificationTime = fd.lastModificationTime;
-    infoBuffer->owner = fd.owner;
-    infoBuffer->size = fd.size;
-    infoBuffer->block_ref = fd.block_ref;
+void simfsReleaseBlock(SIMFS_INDEX_TYPE blockIndex)
+{
+    simfsSetBit((unsigned char *) simfsContext->changedReferences, blockIndex);
 
-    return SIMFS_NO_ERROR;
-}
+    if (simfsVolume->referenceCount[blockIndex] > 0)
+        simfsVolume->referenceCount[blockIndex]--;
 
-//////////////////////////////////////////////////////////////////////////
+    if (simfsVolume->referenceCount[blockIndex] == 0) {
+        simfsClearBit((unsigned char *) simfsContext->bitvector, blockIndex);
+        if (simfsVolume->block[blockIndex].type == DATA_CONTENT_TYPE)
+            simfsForgetFingerprint(blockIndex);
+    }
+}
 
 /*
- * Hashes the name and searches for it in the in-memory directory. If the file does not exist,
- * the SIMFS_NOT_FOUND_ERROR is returned.
- *
- * Otherwise:
- *    - checks the per-process open file table for the process, and if the file has already been opened
- *      it returns the index of the openFileTable with the entry of the file through the parameter fileHandle, and
- *      returns SIMFS_DUPLICATE_ERROR as the return value
- *
- *    - otherwise, checks if there is a global entry for the file, and if so, then:
- *       - it increases the reference count for this file
- *
- *       - otherwise, it creates an entry in the global open file table for the file copying the information
- *         from the file descriptor block referenced from the entry for this file in the directory
- *
-*       - if the process does not have its process control block in the processControlBlocks list, then
-*         a file control block for the process is created and added to the list; the current working directory
-*         is initialized to the root of the volume and the number of the open files is initialized to 0
-*
-*       - if an entry for this file does not exits in the per-process open file table, the function finds an
-*         empty slot in the table and fills it with the information including the reference to the entry for
-*         this file in the global open file table.
-*
-*       - returns the index to the new element of the per-process open file table through the parameter fileHandle
-*         and SIMFS_NO_ERROR as the return value
+ * Returns the address of the index entry for a slot of a file or a folder.
  *
- * If there is no free slot for the file in either the global file table or in the per-process
- * file table, or if there is any other allocation problem, then the function returns SIMFS_ALLOC_ERROR.
+ * Slots are numbered across the chain of index blocks starting at *chainHead. In every index block all entries but
+ * the last hold slots; the last one links to the next index block (0 if there is none). A slot holding 0 is unused.
  *
+ * If allocate is non-zero, missing index blocks are allocated and linked on the way. Otherwise, NULL is returned
+ * for slots beyond the end of the chain. NULL is also returned if the volume is full.
  */
-SIMFS_ERROR simfsOpenFile(SIMFS_NAME_TYPE fileName, SIMFS_FILE_HANDLE_TYPE *fileHandle)
+static SIMFS_INDEX_TYPE *simfsIndexSlot(SIMFS_INDEX_TYPE *chainHead, unsigned int slot, int allocate)
 {
-    // TODO: implement
-    //printf("%s\n", fileName);
-    SIMFS_DIR_ENT *dir = &(simfsContext->directory[hash(fileName)]);
+    SIMFS_INDEX_TYPE *link = chainHead;
 
-    if(dir->nodeReference == 0)
-    	return SIMFS_NOT_FOUND_ERROR;
+    while (1) {
+        if (*link == 0 || *link == SIMFS_INVALID_INDEX) {
+            if (!allocate)
+                return NULL;
 
-    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsContext->processControlBlocks;
-
-    //true/false indicator to keep track of first open block
-    unsigned short openBlockFound = 0;
-    //variable to hold first open block in per_process table
-    int per_pros_open_ind = 0;
-    int glob_open_ind = 0;
-
-    while(process != NULL){
-    	if(process->numberOfOpenFiles != 0){
-    		//has an open file, go through openFile table. keep track of first free open block in per_process
-    		for(int i = 0; i < process->numberOfOpenFiles; i++){
-    			SIMFS_FILE_DESCRIPTOR_TYPE process_fd = simfsVolume->block[process->openFileTable[i].globalEntry->fileDescriptor].content.fileDescriptor;
-    			//check if this fileDescriptor is the same as the fileName passed in...
-    			SIMFS_FILE_DESCRIPTOR_TYPE passed_fd = simfsVolume->block[dir->nodeReference].content.fileDescriptor;
-    			if(strcmp(process_fd.name, passed_fd.name)==0){
-    				//a process' name matches the file passed in, so it is already open
-    				*fileHandle = i;
-    				return SIMFS_DUPLICATE_ERROR;
-    			}
-    			else{
-    				if(openBlockFound == 0){
-    					openBlockFound = 1;
-    					per_pros_open_ind = i;
-    				}
-    			}
-    		}//end for loop
-
-    		//check globalTable now. reset the openBlockFound to false
-    		openBlockFound = 0;
-
-    		for(int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES; i++){
-    			if(simfsContext->globalOpenFileTable[i].fileDescriptor > 0){
-    				//this file at this index points to an actual file...
-    				SIMFS_FILE_DESCRIPTOR_TYPE global_fd =  simfsVolume->block[simfsContext->globalOpenFileTable[i].fileDescriptor].content.fileDescriptor;
-    				SIMFS_FILE_DESCRIPTOR_TYPE passed_fd = simfsVolume->block[dir->nodeReference].content.fileDescriptor;
-
-    				//check if this fileDes macthes the one passed in
-    				if(strcmp(global_fd.name, passed_fd.name)==0){
-    					//found it in the thing...
-    					//increase ref count
-    					simfsContext->globalOpenFileTable[i].referenceCount++;
-    					*fileHandle = i;
-    					return SIMFS_NO_ERROR;
-    				}
-    			}
-    			else{
-    				//its a free spot, store the free spot and stop looking for free spots.
-    				if(openBlockFound == 0){
-    					//no open block found...
-    					openBlockFound = 1;
-    					glob_open_ind = i;
-    				}
-    			}
-    		}//end globalTable for loop
-    	} //end if. 
-    	else{
-    		process = process->next;
-    	}
-    }//end while loop
+            SIMFS_INDEX_TYPE newIndexBlock = simfsAllocateBlock(INDEX_CONTENT_TYPE);
+            if (newIndexBlock == SIMFS_INVALID_INDEX)
+                return NULL;
+            *link = newIndexBlock;
+        }
 
-    //initialize a processControlBlocks
-	process = (SIMFS_PROCESS_CONTROL_BLOCK_TYPE *)malloc(sizeof(SIMFS_PROCESS_CONTROL_BLOCK_TYPE));
-	process->currentWorkingDirectory = simfsVolume->superblock.rootNodeIndex;
-	process->numberOfOpenFiles = 0;
-	process->next = NULL;
+        SIMFS_INDEX_TYPE *entries = simfsVolume->block[*link].content.index;
+        if (slot < SIMFS_INDEX_ENTRIES_PER_BLOCK)
+            return &entries[slot];
 
-	//check if there is room to add a process
-    if(per_pros_open_ind > SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS || glob_open_ind > SIMFS_MAX_NUMBER_OF_OPEN_FILES)
-    	return SIMFS_ALLOC_ERROR;
+        slot -= SIMFS_INDEX_ENTRIES_PER_BLOCK;
+        link = &entries[SIMFS_INDEX_SIZE - 1];
+    }
+}
+
+/*
+ * Releases all slots of a chain starting with firstSlot, and the index blocks that no longer hold any kept slot.
+ *
+ * Truncating at slot 0 releases the whole chain and resets *chainHead to SIMFS_INVALID_INDEX.
+ */
+static void simfsTruncateChain(SIMFS_INDEX_TYPE *chainHead, unsigned int firstSlot)
+{
+    SIMFS_INDEX_TYPE *link = chainHead;
+    unsigned int base = 0; // number of the first slot in the current index block
+
+    while (*link != 0 && *link != SIMFS_INVALID_INDEX) {
+        SIMFS_INDEX_TYPE indexBlock = *link;
+        SIMFS_INDEX_TYPE *entries = simfsVolume->block[indexBlock].content.index;
+
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++)
+            if (base + i >= firstSlot && entries[i] != 0) {
+                simfsReleaseBlock(entries[i]);
+                entries[i] = 0;
+            }
+
+        if (base >= firstSlot) {
+            // nothing is kept in this index block, so the link skips it
+            *link = entries[SIMFS_INDEX_SIZE - 1];
+            simfsReleaseBlock(indexBlock);
+        }
+        else
+            link = &entries[SIMFS_INDEX_SIZE - 1];
+
+        base += SIMFS_INDEX_ENTRIES_PER_BLOCK;
+    }
 
-    SIMFS_BLOCK_TYPE *openBlock = &simfsVolume->block[dir->nodeReference];
+    if (firstSlot == 0)
+        *chainHead = SIMFS_INVALID_INDEX;
+}
 
-    //per process table accessrights set
-    process->openFileTable[per_pros_open_ind].accessRights = openBlock->content.fileDescriptor.accessRights;
+/*
+ * Counts the blocks of a chain (index blocks and the blocks in their slots) that are not shared with anything else,
+ * i.e., the blocks that would become free if the chain was released.
+ */
+static unsigned int simfsCountPrivateBlocks(SIMFS_INDEX_TYPE chainHead)
+{
+    unsigned int count = 0;
+
+    for (SIMFS_INDEX_TYPE indexBlock = chainHead; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]) {
+        count++;
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE entry = simfsVolume->block[indexBlock].content.index[i];
+            if (entry != 0 && simfsVolume->referenceCount[entry] == 1)
+                count++;
+        }
+    }
+
+    return count;
+}
 
-    //the context global in-memory, no allocation needed
-    simfsContext->globalOpenFileTable[glob_open_ind].type = openBlock->content.fileDescriptor.type;
-	simfsContext->globalOpenFileTable[glob_open_ind].fileDescriptor = dir->nodeReference;
-	simfsContext->globalOpenFileTable[glob_open_ind].creationTime = openBlock->content.fileDescriptor.creationTime;
+/*
+ * Returns the number of slots covered by the space reserved for a file (see simfsReserve). Truncating the content
+ * of a file never releases these slots, so the blocks in them are reused by later writes.
+ */
+static unsigned int simfsReservedSlots(size_t reserved, char compression)
+{
+    if (compression == SIMFS_NO_COMPRESSION)
+        return (reserved + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
 
-	struct timespec time;
-	clock_gettime(CLOCK_MONOTONIC, &time);
+    return (reserved + SIMFS_COMPRESSION_CHUNK_SIZE - 1) / SIMFS_COMPRESSION_CHUNK_SIZE * SIMFS_COMPRESSION_CHUNK_BLOCKS;
+}
 
-	//update lastAccessTime
-	openBlock->content.fileDescriptor.lastAccessTime = time.tv_sec;
-	//continue setting values
-	simfsContext->globalOpenFileTable[glob_open_ind].lastAccessTime = openBlock->content.fileDescriptor.lastAccessTime;
+/*
+ * Stores up to SIMFS_DATA_SIZE bytes as the content of a slot of a file; the rest of the block is cleared.
+ *
+ * A block held only by the file is overwritten in place. A block shared with a snapshot or with other files is
+ * copied on write: the slot gets a new block, and the others keep the old one. In the deduplication mode, the slot
+ * shares an existing block with the same content instead, so nothing has to be copied at all. On a log-structured
+ * volume, no block is overwritten: the old block is released first and the content goes to the head of the log, so
+ * the write does not need more free blocks than one in place.
+ *
+ * A slot reserved for the file (see simfsReserve) keeps its block: a block held only by the file is overwritten in
+ * place in the deduplication mode and on a log-structured volume as well, so the reservation stays contiguous. Its
+ * content is not added to the fingerprint index, so other files do not share it.
+ *
+ * Returns SIMFS_ALLOC_ERROR if a new block is needed and the volume is full.
+ */
+static SIMFS_ERROR simfsStoreData(SIMFS_INDEX_TYPE *slot, char *data, size_t length, int reserved)
+{
+    SIMFS_DATA_TYPE content;
+    memcpy(content, data, length);
+    memset(content + length, 0, SIMFS_DATA_SIZE - length);
+
+    if (simfsVolume->superblock.deduplication && !reserved) {
+        if (*slot != 0 && memcmp(simfsVolume->block[*slot].content.data, content, SIMFS_DATA_SIZE) == 0) {
+            simfsContext->bytesDeduplicated += length; // unchanged
+            return SIMFS_NO_ERROR;
+        }
+
+        SIMFS_INDEX_TYPE duplicate = simfsFindDuplicateBlock(content);
+        if (duplicate != SIMFS_INVALID_INDEX) {
+            simfsShareBlock(duplicate);
+            if (*slot != 0)
+                simfsReleaseBlock(*slot);
+            *slot = duplicate;
+            simfsContext->bytesDeduplicated += length;
+            return SIMFS_NO_ERROR;
+        }
+    }
 
-	simfsContext->globalOpenFileTable[glob_open_ind].lastModificationTime = openBlock->content.fileDescriptor.lastModificationTime;
-	simfsContext->globalOpenFileTable[glob_open_ind].owner = openBlock->content.fileDescriptor.owner;
-	simfsContext->globalOpenFileTable[glob_open_ind].size = openBlock->content.fileDescriptor.size;
+    if (*slot != 0 && (simfsVolume->referenceCount[*slot] > 1 ||
+                       (simfsVolume->superblock.engine == SIMFS_LOG_STRUCTURED_ENGINE && !reserved))) {
+        simfsReleaseBlock(*slot);
+        *slot = 0;
+    }
 
+    if (*slot == 0) {
+        SIMFS_INDEX_TYPE blockIndex = simfsAllocateBlock(DATA_CONTENT_TYPE);
+        if (blockIndex == SIMFS_INVALID_INDEX)
+            return SIMFS_ALLOC_ERROR;
+        *slot = blockIndex;
+    }
+    else if (simfsVolume->superblock.deduplication)
+        simfsForgetFingerprint(*slot); // the content changes in place
 
-	//process global entry is NOT null, so why issues??
-    process->openFileTable[per_pros_open_ind].globalEntry = &simfsContext->globalOpenFileTable[glob_open_ind];
-    simfsContext->processControlBlocks = process;
+    memcpy(simfsVolume->block[*slot].content.data, content, SIMFS_DATA_SIZE);
+    simfsUpdateChecksum(*slot);
+    simfsSetBit((unsigned char *) simfsContext->changedBlocks, *slot);
+    simfsContext->bytesWritten += length;
 
-    *fileHandle = per_pros_open_ind;
+    // a reserved block that another file came to share would be copied on the next write, out of the reservation
+    if (simfsVolume->superblock.deduplication && !reserved)
+        simfsRememberFingerprint(*slot);
 
     return SIMFS_NO_ERROR;
 }
 
-//////////////////////////////////////////////////////////////////////////
-
 /*
- * The function replaces content of a file with new one pointed to by the parameter writeBuffer.
- *
- * Checks if the file handle points to a valid file descriptor of an open file. If the entry is invalid
- * (e.g., if the reference to the global table is NULL, or if the entry in the global table is INVALID_CONTENT_TYPE),
- * then it returns SIMFS_NOT_FOUND_ERROR.
- *
- * Otherwise, it checks the access rights for writing. If the process owner is not allowed to write to the file,
- * then the function returns SIMFS_ACCESS_ERROR.
- *
- * Then, the functions calculates the space needed for the new content and checks if the write buffer can fit into
- * the remaining free space in the file system. If not, then the SIMFS_ALLOC_ERROR is returned.
- *
- * Otherwise, the function removes all blocks currently held by this file, and then acquires new blocks as needed
- * modifying bits in the in-memory bitvector as needed.
- *
- * It then copies the characters pointed to by the parameter writeBuffer (until '\0' but excluding it) to the
- * new blocks that belong to the file. The function copies any modified block of the in-memory bitvector to
- * the corresponding bitvector block on the disk.
- *
- * Finally, the file descriptor is modified to reflect the new size of the file, and the times of last modification
- * and access.
- *
- * The function returns SIMFS_WRITE_ERROR in response to exception not specified earlier.
+ * Sequential lookup of slots in a chain of index blocks.
  *
+ * Looking up increasing slot numbers with the same cursor walks the chain only once. A slot past the end of the
+ * chain reads as 0, just like an unused slot.
  */
-SIMFS_ERROR simfsWriteFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *writeBuffer)
+typedef struct simfs_slot_cursor_type {
+    SIMFS_INDEX_TYPE indexBlock; // the index block holding the slots from base on
+    unsigned int base;
+} SIMFS_SLOT_CURSOR_TYPE;
+
+static SIMFS_INDEX_TYPE simfsSlotAt(SIMFS_SLOT_CURSOR_TYPE *cursor, unsigned int slot)
 {
-    // TODO: implement
-    if(simfsContext->processControlBlocks == NULL)
-    	return SIMFS_NOT_FOUND_ERROR;
+    while (cursor->indexBlock != 0 && cursor->indexBlock != SIMFS_INVALID_INDEX &&
+           slot >= cursor->base + SIMFS_INDEX_ENTRIES_PER_BLOCK) {
+        cursor->indexBlock = simfsVolume->block[cursor->indexBlock].content.index[SIMFS_INDEX_SIZE - 1];
+        cursor->base += SIMFS_INDEX_ENTRIES_PER_BLOCK;
+    }
 
-    if(simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry == NULL)
-    	return SIMFS_NOT_FOUND_ERROR;
+    if (cursor->indexBlock == 0 || cursor->indexBlock == SIMFS_INVALID_INDEX || slot < cursor->base)
+        return 0;
 
-    if(simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry->type == INVALID_CONTENT_TYPE)
-		return SIMFS_NOT_FOUND_ERROR;
+    return simfsVolume->block[cursor->indexBlock].content.index[slot - cursor->base];
+}
 
-	SIMFS_BLOCK_TYPE *write_block = &(simfsVolume->block[simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry->fileDescriptor]);
+/*
+ * LZ compression of a chunk.
+ *
+ * The output is a sequence of tokens. A token below 0x80 is followed by (token + 1) literal bytes. A token with
+ * the high bit set is a match of ((token & 0x7F) + SIMFS_LZ_MIN_MATCH) bytes, copied from the distance stored in
+ * the following two bytes (least significant byte first). Matches never reach outside of the chunk, so every chunk
+ * decodes on its own.
+ *
+ * The compressor returns the size of the output, or 0 if the output would not be shorter than the input.
+ */
+#define SIMFS_LZ_MIN_MATCH 3
+#define SIMFS_LZ_MAX_MATCH (0x7F + SIMFS_LZ_MIN_MATCH)
+#define SIMFS_LZ_MAX_LITERALS 0x80
+#define SIMFS_LZ_HASH_SIZE 1024
 
-    if(write_block->content.fileDescriptor.accessRights&0200){
-		//user CAN write
-		SIMFS_BLOCK_TYPE *data_block = &(simfsVolume->block[write_block->content.fileDescriptor.block_ref]);
-		if(data_block->type != DATA_CONTENT_TYPE)
-			return SIMFS_NOT_FOUND_ERROR;
+static size_t simfsLzFlushLiterals(const char *literals, size_t count, char *output, size_t out, size_t capacity)
+{
+    while (count > 0) {
+        size_t run = count < SIMFS_LZ_MAX_LITERALS ? count : SIMFS_LZ_MAX_LITERALS;
+        if (out + 1 + run > capacity)
+            return capacity + 1; // does not fit
+        output[out++] = (char) (run - 1);
+        memcpy(output + out, literals, run);
+        out += run;
+        literals += run;
+        count -= run;
+    }
 
-		//check if theres room for writeBuffer... max size multiplied by 2 since each file can have up to 2 data blocks
-		if((write_block->content.fileDescriptor.size + sizeof(writeBuffer)) > (SIMFS_DATA_SIZE * 2))
-			return SIMFS_ALLOC_ERROR;
+    return out;
+}
 
-		//a reference to another data block exists, clear the second data block
-		if(data_block->content.data[SIMFS_DATA_SIZE-1] != 0)
-			simfsClearBit(simfsContext->bitvector, data_block->content.data[SIMFS_DATA_SIZE]);
+static size_t simfsLzCompress(const char *input, size_t length, char *output, size_t capacity)
+{
+    unsigned short table[SIMFS_LZ_HASH_SIZE]; // last position + 1 of every hashed sequence; 0 if none
+    memset(table, 0, sizeof(table));
+
+    size_t in = 0, out = 0, literalStart = 0;
+
+    while (in + SIMFS_LZ_MIN_MATCH <= length) {
+        const unsigned char *sequence = (const unsigned char *) input + in;
+        unsigned int slot = ((sequence[0] << 16 | sequence[1] << 8 | sequence[2]) * 2654435761u) >> 22;
+        size_t candidate = table[slot];
+        table[slot] = (unsigned short) (in + 1);
+
+        if (candidate == 0 || in - (candidate - 1) > 0xFFFF ||
+            memcmp(input + candidate - 1, input + in, SIMFS_LZ_MIN_MATCH) != 0) {
+            in++;
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t matchLength = SIMFS_LZ_MIN_MATCH;
+        while (in + matchLength < length && matchLength < SIMFS_LZ_MAX_MATCH &&
+               input[match + matchLength] == input[in + matchLength])
+            matchLength++;
+
+        out = simfsLzFlushLiterals(input + literalStart, in - literalStart, output, out, capacity);
+        if (out + 3 > capacity)
+            return 0;
+
+        size_t distance = in - match;
+        output[out++] = (char) (0x80 | (matchLength - SIMFS_LZ_MIN_MATCH));
+        output[out++] = (char) (distance & 0xFF);
+        output[out++] = (char) (distance >> 8);
+
+        in += matchLength;
+        literalStart = in;
+    }
 
-		//clear the bit from the original block (thus removing it)
- 		simfsClearBit(simfsContext->bitvector, write_block->content.fileDescriptor.block_ref);
- 		//and find a new open block
- 		write_block->content.fileDescriptor.block_ref = simfsFindFreeBlock(simfsContext->bitvector);
+    out = simfsLzFlushLiterals(input + literalStart, length - literalStart, output, out, capacity);
+    if (out > capacity)
+        return 0;
 
-		strcpy(data_block->content.data, writeBuffer);
+    return out < length ? out : 0;
+}
 
-		//copy in-memory bitvector to volume
-		strcpy(simfsVolume->bitvector, simfsContext->bitvector);
+/*
+ * Decodes a chunk produced by simfsLzCompress; returns SIMFS_READ_ERROR unless exactly expected bytes result.
+ */
+static SIMFS_ERROR simfsLzDecompress(const char *input, size_t length, char *output, size_t expected)
+{
+    size_t in = 0, out = 0;
+
+    while (in < length) {
+        unsigned char token = (unsigned char) input[in++];
+
+        if (token < 0x80) {
+            size_t run = token + 1;
+            if (in + run > length || out + run > expected)
+                return SIMFS_READ_ERROR;
+            memcpy(output + out, input + in, run);
+            in += run;
+            out += run;
+        }
+        else {
+            size_t matchLength = (token & 0x7F) + SIMFS_LZ_MIN_MATCH;
+            if (in + 2 > length)
+                return SIMFS_READ_ERROR;
+            size_t distance = (unsigned char) input[in] | (size_t) (unsigned char) input[in + 1] << 8;
+            in += 2;
+            if (distance == 0 || distance > out || out + matchLength > expected)
+                return SIMFS_READ_ERROR;
+            for (size_t i = 0; i < matchLength; i++, out++) // the source may overlap the output
+                output[out] = output[out - distance];
+        }
+    }
 
-		struct timespec time;
-		clock_gettime(CLOCK_MONOTONIC, &time);
+    return out == expected ? SIMFS_NO_ERROR : SIMFS_READ_ERROR;
+}
 
-		//update lastModificationTime
-		write_block->content.fileDescriptor.lastModificationTime = time.tv_sec;
+/*
+ * Encodes one chunk of a compressed file into a stream of a two-byte header and the encoded bytes. The header
+ * holds the length of the encoded bytes and has the high bit set if the chunk is compressed; chunks that do not
+ * compress are stored as they are. The stream needs SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE bytes at most.
+ *
+ * Returns the length of the stream.
+ */
+static unsigned short simfsEncodeChunk(char *raw, size_t rawLength, char *stream)
+{
+    size_t packed = simfsLzCompress(raw, rawLength, stream + 2, SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE - 2);
+    unsigned short header = (unsigned short) (packed | 0x8000);
 
-		// The function returns SIMFS_WRITE_ERROR in response to exception not specified earlier.
-		return SIMFS_WRITE_ERROR;
-	}
-	else
-		return SIMFS_ACCESS_ERROR;
+    if (packed == 0) {
+        memcpy(stream + 2, raw, rawLength);
+        packed = rawLength;
+        header = (unsigned short) rawLength;
+    }
+    stream[0] = (char) (header & 0xFF);
+    stream[1] = (char) (header >> 8);
 
-    return SIMFS_NO_ERROR;
+    return (unsigned short) (packed + 2);
 }
 
-//////////////////////////////////////////////////////////////////////////
+/*
+ * Stores an encoded chunk k in the slots from (k * SIMFS_COMPRESSION_CHUNK_BLOCKS) on, and releases the slots of
+ * the chunk that the stream does not need (unless they are reserved).
+ */
+static SIMFS_ERROR simfsStoreChunk(SIMFS_FILE_DESCRIPTOR_TYPE *fd, unsigned int k, char *stream, unsigned short streamLength)
+{
+    unsigned int streamBlocks = (streamLength + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+    unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression);
+
+    for (unsigned int j = 0; j < SIMFS_COMPRESSION_CHUNK_BLOCKS; j++) {
+        SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, k * SIMFS_COMPRESSION_CHUNK_BLOCKS + j, j < streamBlocks);
+
+        if (j < streamBlocks) {
+            size_t part = streamLength - j * SIMFS_DATA_SIZE < SIMFS_DATA_SIZE ? streamLength - j * SIMFS_DATA_SIZE : SIMFS_DATA_SIZE;
+            if (slot == NULL || simfsStoreData(slot, stream + j * SIMFS_DATA_SIZE, part,
+                                               k * SIMFS_COMPRESSION_CHUNK_BLOCKS + j < reservedSlots) != SIMFS_NO_ERROR)
+                return SIMFS_WRITE_ERROR;
+        }
+        else if (slot != NULL && *slot != 0 && k * SIMFS_COMPRESSION_CHUNK_BLOCKS + j >= reservedSlots) {
+            simfsReleaseBlock(*slot);
+            *slot = 0;
+        }
+    }
+
+    return SIMFS_NO_ERROR;
+}
 
 /*
- * The function returns the complete content of the file to the caller through the parameter readBuffer.
- *
- * Checks if the file handle points to a valid file descriptor of an open file. If the entry is invalid
- * (e.g., if the reference to the global table is NULL, or if the entry in the global table is INVALID_CONTENT_TYPE),
- * then it returns SIMFS_NOT_FOUND_ERROR.
- *
- * Otherwise, it checks the user's access right to read the file. If the process owner is not allowed to read the file,
- * then the function returns SIMFS_ACCESS_ERROR.
- *
- * Otherwise, the function allocates memory sufficient to hold the read content with an appended end of string
- * character; the pointer to newly allocated memory is passed back through the readBuffer parameter. All the content
- * of the blocks is concatenated using the allocated space, and an end of string character is appended at the end of
- * the concatenated content.
- *
- * The function returns SIMFS_READ_ERROR in response to exception not specified earlier.
+ * Encodes chunks firstChunk, firstChunk + 1, ... of a compressed file from the length bytes in content into
+ * freshly allocated streams, so that the number of blocks needed is known before anything is stored.
  *
+ * Returns NULL if memory runs out; the caller frees the streams and the lengths.
  */
-SIMFS_ERROR simfsReadFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char **readBuffer)
+static char *simfsEncodeChunks(char *content, size_t length, unsigned short **streamLength, unsigned int *chunks,
+                               unsigned int *blocksNeeded, unsigned int firstChunk, unsigned int *lastSlot)
 {
-    // TODO: implement
-    if(simfsContext->processControlBlocks == NULL)
-    	return SIMFS_NOT_FOUND_ERROR;
+    size_t streamCapacity = SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE;
+
+    *chunks = (length + SIMFS_COMPRESSION_CHUNK_SIZE - 1) / SIMFS_COMPRESSION_CHUNK_SIZE;
+    *blocksNeeded = 0;
+    *lastSlot = firstChunk * SIMFS_COMPRESSION_CHUNK_BLOCKS;
+
+    char *streams = malloc(*chunks * streamCapacity + 1);
+    *streamLength = malloc(*chunks * sizeof(unsigned short) + 1);
+    if (streams == NULL || *streamLength == NULL) {
+        free(streams);
+        free(*streamLength);
+        return NULL;
+    }
 
-    if(simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry == NULL)
-    	return SIMFS_NOT_FOUND_ERROR;
+    for (unsigned int k = 0; k < *chunks; k++) {
+        size_t rawLength = length - k * SIMFS_COMPRESSION_CHUNK_SIZE < SIMFS_COMPRESSION_CHUNK_SIZE ?
+            length - k * SIMFS_COMPRESSION_CHUNK_SIZE : SIMFS_COMPRESSION_CHUNK_SIZE;
 
-    if(simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry->type == INVALID_CONTENT_TYPE)
-		return SIMFS_NOT_FOUND_ERROR;
+        (*streamLength)[k] = simfsEncodeChunk(content + k * SIMFS_COMPRESSION_CHUNK_SIZE, rawLength, streams + k * streamCapacity);
 
-	SIMFS_BLOCK_TYPE read_block = simfsVolume->block[simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry->fileDescriptor];
-    if(read_block.content.fileDescriptor.accessRights&0400){
+        unsigned int streamBlocks = ((*streamLength)[k] + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+        *blocksNeeded += streamBlocks;
+        *lastSlot = (firstChunk + k) * SIMFS_COMPRESSION_CHUNK_BLOCKS + streamBlocks;
+    }
 
-		//user CAN read
-		SIMFS_BLOCK_TYPE data_block = simfsVolume->block[read_block.content.fileDescriptor.block_ref];
-		if(data_block.type != DATA_CONTENT_TYPE)
-			return SIMFS_NOT_FOUND_ERROR;
+    return streams;
+}
 
-		//malloc the size of the data + one additional character
-		char *read = malloc(read_block.content.fileDescriptor.size + sizeof(char));
+/*
+ * Replaces the content of a file with length bytes from content, using the compression setting of the volume.
+ *
+ * Without compression, byte i of the file is in slot (i / SIMFS_DATA_SIZE). With compression, chunk k of the file
+ * is encoded (see simfsEncodeChunk) into the slots from (k * SIMFS_COMPRESSION_CHUNK_BLOCKS) on; the remaining
+ * slots of the chunk stay unused. Blocks reserved for the file stay with it and are overwritten in place; a file
+ * with reserved space keeps the layout the space was reserved in, so its reserved slots are counted the same way.
+ *
+ * Returns SIMFS_ALLOC_ERROR, with the file unchanged, if the volume does not have enough free blocks.
+ */
+static SIMFS_ERROR simfsReplaceContent(SIMFS_FILE_DESCRIPTOR_TYPE *fd, char *content, size_t length)
+{
+    char compression = fd->reserved > 0 ? fd->compression : simfsVolume->superblock.compression;
+    unsigned int reservedSlots = simfsReservedSlots(fd->reserved, compression);
+    SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+    unsigned int idle = 0; // reserved blocks that the new content does not use
+
+    if (compression == SIMFS_NO_COMPRESSION) {
+        unsigned int blocksNeeded = (length + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+        unsigned int keptSlots = blocksNeeded > reservedSlots ? blocksNeeded : reservedSlots;
+        unsigned int indexBlocksNeeded = (keptSlots + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+
+        for (unsigned int i = blocksNeeded; i < reservedSlots; i++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, i);
+            if (blockIndex != 0 && simfsVolume->referenceCount[blockIndex] == 1)
+                idle++;
+        }
+
+        // the blocks that only this file holds are reused
+        if (blocksNeeded + indexBlocksNeeded + idle > simfsCountFreeBlocks() + simfsCountPrivateBlocks(fd->block_ref))
+            return SIMFS_ALLOC_ERROR;
+
+        fd->compression = compression;
+        simfsTruncateChain(&fd->block_ref, keptSlots);
+
+        for (unsigned int i = 0; i < blocksNeeded; i++) {
+            SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, i, 1);
+            size_t chunk = length - i * SIMFS_DATA_SIZE < SIMFS_DATA_SIZE ? length - i * SIMFS_DATA_SIZE : SIMFS_DATA_SIZE;
+            if (slot == NULL || simfsStoreData(slot, content + i * SIMFS_DATA_SIZE, chunk, i < reservedSlots) != SIMFS_NO_ERROR)
+                return SIMFS_WRITE_ERROR;
+        }
+    }
+    else {
+        unsigned short *streamLength;
+        unsigned int chunks, blocksNeeded, lastSlot;
+
+        char *streams = simfsEncodeChunks(content, length, &streamLength, &chunks, &blocksNeeded, 0, &lastSlot);
+        if (streams == NULL)
+            return SIMFS_ALLOC_ERROR;
+
+        unsigned int keptSlots = lastSlot > reservedSlots ? lastSlot : reservedSlots;
+        unsigned int indexBlocksNeeded = (keptSlots + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+
+        for (unsigned int i = 0; i < reservedSlots; i++) {
+            unsigned int k = i / SIMFS_COMPRESSION_CHUNK_BLOCKS;
+            unsigned int streamBlocks = k < chunks ? (streamLength[k] + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE : 0;
+            if (i % SIMFS_COMPRESSION_CHUNK_BLOCKS < streamBlocks)
+                continue;
+
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, i);
+            if (blockIndex != 0 && simfsVolume->referenceCount[blockIndex] == 1)
+                idle++;
+        }
+
+        if (blocksNeeded + indexBlocksNeeded + idle > simfsCountFreeBlocks() + simfsCountPrivateBlocks(fd->block_ref)) {
+            free(streams);
+            free(streamLength);
+            return SIMFS_ALLOC_ERROR;
+        }
+
+        fd->compression = compression;
+        simfsTruncateChain(&fd->block_ref, keptSlots);
+
+        SIMFS_ERROR error = SIMFS_NO_ERROR;
+        for (unsigned int k = 0; k < chunks && error == SIMFS_NO_ERROR; k++)
+            error = simfsStoreChunk(fd, k, streams + k * SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE, streamLength[k]);
+
+        free(streams);
+        free(streamLength);
+        if (error != SIMFS_NO_ERROR)
+            return error;
+    }
 
-		if(read_block.content.fileDescriptor.size == SIMFS_DATA_SIZE)
-			return SIMFS_ALLOC_ERROR;
+    fd->compression = compression;
+    fd->size = length;
 
-		strcpy(read, data_block.content.data);
+    return SIMFS_NO_ERROR;
+}
 
-		//readBuffer needs to point to a char*
-		*readBuffer = read;
+/*
+ * Decodes chunk k of a compressed file into plain; the chunk holds rawLength bytes. A chunk without blocks is a
+ * hole and decodes to zeros.
+ */
+static SIMFS_ERROR simfsReadChunk(SIMFS_SLOT_CURSOR_TYPE *cursor, unsigned int k, char *plain, size_t rawLength)
+{
+    char stream[SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE];
 
-		//printf("Message Read IN FUNCTION: %s\n", *readBuffer); //the first element in readBuffer, aka the char *
+    SIMFS_INDEX_TYPE first = simfsSlotAt(cursor, k * SIMFS_COMPRESSION_CHUNK_BLOCKS);
+    if (first == 0) {
+        memset(plain, 0, rawLength); // a hole
+        return SIMFS_NO_ERROR;
+    }
+    if (!simfsChecksumValid(first))
+        return SIMFS_READ_ERROR;
+    memcpy(stream, simfsVolume->block[first].content.data, SIMFS_DATA_SIZE);
+
+    unsigned short header = (unsigned char) stream[0] | (unsigned short) ((unsigned char) stream[1] << 8);
+    if (header == 0) {
+        memset(plain, 0, rawLength); // reserved but never written; every stored chunk has a non-zero header
+        return SIMFS_NO_ERROR;
+    }
+    size_t packed = header & 0x7FFF;
+    if (packed + 2 > sizeof(stream))
+        return SIMFS_READ_ERROR;
+
+    for (unsigned int j = 1; j * SIMFS_DATA_SIZE < packed + 2; j++) {
+        SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(cursor, k * SIMFS_COMPRESSION_CHUNK_BLOCKS + j);
+        if (blockIndex == 0 || !simfsChecksumValid(blockIndex))
+            return SIMFS_READ_ERROR;
+        memcpy(stream + j * SIMFS_DATA_SIZE, simfsVolume->block[blockIndex].content.data, SIMFS_DATA_SIZE);
+    }
 
-		// The function returns SIMFS_READ_ERROR in response to exception not specified earlier.
-		return SIMFS_READ_ERROR;
-	}
-	else
-		return SIMFS_ACCESS_ERROR;
+    if (header & 0x8000)
+        return simfsLzDecompress(stream + 2, packed, plain, rawLength);
+
+    if (packed != rawLength)
+        return SIMFS_READ_ERROR;
+    memcpy(plain, stream + 2, rawLength);
 
     return SIMFS_NO_ERROR;
 }
 
-//////////////////////////////////////////////////////////////////////////
-
 /*
- * Removes the entry for the file with the file handle provided as the parameter from the open file table
- * for this process. It decreases the number of open files for in the process control block of this process, and
- * if it becomes zero, then the process control block for this process is removed from the processControlBlocks list.
- *
- * Decreases the reference count in the global open file table, and if that number is 0, it also removes the entry
- * for this file from the global open file table.
+ * Copies length bytes of the content of a file starting at offset into buffer; the range must be within the file.
  *
+ * Only the blocks (or for compressed files, the chunks) overlapping the range are read; holes are filled with zeros
+ * without reading anything. Returns SIMFS_READ_ERROR if any of the blocks does not match its checksum.
  */
-
-SIMFS_ERROR simfsCloseFile(SIMFS_FILE_HANDLE_TYPE fileHandle)
+static SIMFS_ERROR simfsReadRange(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t offset, size_t length, char *buffer)
 {
-    // TODO: implement
-    simfsContext->processControlBlocks->numberOfOpenFiles--;
-    
-    if(simfsContext->processControlBlocks->numberOfOpenFiles <= 0){
-    	simfsContext->processControlBlocks->numberOfOpenFiles = 0;
-    	simfsContext->processControlBlocks = simfsContext->processControlBlocks->next;
+    SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+
+    if (fd->compression == SIMFS_NO_COMPRESSION) {
+        while (length > 0) {
+            size_t within = offset % SIMFS_DATA_SIZE;
+            size_t part = SIMFS_DATA_SIZE - within < length ? SIMFS_DATA_SIZE - within : length;
+
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, offset / SIMFS_DATA_SIZE);
+            if (blockIndex == 0)
+                memset(buffer, 0, part); // a hole
+            else if (!simfsChecksumValid(blockIndex))
+                return SIMFS_READ_ERROR; // the block is corrupted
+            else
+                memcpy(buffer, simfsVolume->block[blockIndex].content.data + within, part);
+
+            buffer += part;
+            offset += part;
+            length -= part;
+        }
     }
-    else{
-    	simfsContext->processControlBlocks->openFileTable[fileHandle].accessRights = umask(0000);
-
-    	//setting fileDescriptor to 0 allows for it to be overwritten, essentially erasing it.
-    	simfsContext->processControlBlocks->openFileTable[fileHandle].globalEntry->fileDescriptor = 0;
+    else {
+        char plain[SIMFS_COMPRESSION_CHUNK_SIZE];
+
+        while (length > 0) {
+            unsigned int k = offset / SIMFS_COMPRESSION_CHUNK_SIZE;
+            size_t within = offset % SIMFS_COMPRESSION_CHUNK_SIZE;
+            size_t rawLength = fd->size - k * SIMFS_COMPRESSION_CHUNK_SIZE < SIMFS_COMPRESSION_CHUNK_SIZE ?
+                fd->size - k * SIMFS_COMPRESSION_CHUNK_SIZE : SIMFS_COMPRESSION_CHUNK_SIZE;
+            size_t part = rawLength - within < length ? rawLength - within : length;
+
+            if (simfsReadChunk(&cursor, k, plain, rawLength) != SIMFS_NO_ERROR)
+                return SIMFS_READ_ERROR;
+            memcpy(buffer, plain + within, part);
+
+            buffer += part;
+            offset += part;
+            length -= part;
+        }
     }
 
-    simfsContext->globalOpenFileTable[fileHandle].referenceCount--;
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Counts the index blocks in a chain.
+ */
+static unsigned int simfsCountIndexBlocks(SIMFS_INDEX_TYPE chainHead)
+{
+    unsigned int count = 0;
+
+    for (SIMFS_INDEX_TYPE indexBlock = chainHead; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        count++;
+
+    return count;
+}
 
-    if(simfsContext->globalOpenFileTable[fileHandle].referenceCount <= 0){
-    	simfsContext->globalOpenFileTable[fileHandle].referenceCount = 0;
-    	simfsContext->globalOpenFileTable[fileHandle].fileDescriptor = 0;
+/*
+ * Appends length bytes from data to the end of a file, keeping the layout of its content (an empty file takes the
+ * compression setting of the volume).
+ *
+ * Without compression, the partial last block of the file is filled up first, and whole blocks follow. With
+ * compression, the partial last chunk is decoded and encoded again together with the new bytes; the chunks before
+ * it are not touched.
+ *
+ * Returns SIMFS_ALLOC_ERROR, with the file unchanged, if the volume does not have enough free blocks.
+ */
+static SIMFS_ERROR simfsAppendContent(SIMFS_FILE_DESCRIPTOR_TYPE *fd, char *data, size_t length)
+{
+    if (fd->size == 0 && fd->reserved == 0)
+        fd->compression = simfsVolume->superblock.compression;
+
+    if (fd->compression == SIMFS_NO_COMPRESSION) {
+        unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression);
+        unsigned int oldBlocks = (fd->size + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+        unsigned int newBlocks = (fd->size + length + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+        unsigned int indexBlocks = simfsCountIndexBlocks(fd->block_ref);
+        unsigned int indexBlocksNeeded = (newBlocks + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+        indexBlocksNeeded = indexBlocksNeeded > indexBlocks ? indexBlocksNeeded - indexBlocks : 0;
+
+        // reserved slots already have their blocks
+        unsigned int blocksNeeded = 0;
+        SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+        for (unsigned int i = oldBlocks; i < newBlocks; i++)
+            if (simfsSlotAt(&cursor, i) == 0)
+                blocksNeeded++;
+
+        // a shared partial last block is copied on write, so it may need one more block
+        if (blocksNeeded + indexBlocksNeeded + (fd->size % SIMFS_DATA_SIZE != 0) > simfsCountFreeBlocks())
+            return SIMFS_ALLOC_ERROR;
+
+        size_t offset = 0;
+
+        if (fd->size % SIMFS_DATA_SIZE != 0) {
+            SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, fd->size / SIMFS_DATA_SIZE, 1);
+            if (slot == NULL)
+                return SIMFS_WRITE_ERROR;
+            if (*slot != 0 && !simfsChecksumValid(*slot))
+                return SIMFS_READ_ERROR;
+
+            SIMFS_DATA_TYPE tail;
+            size_t used = fd->size % SIMFS_DATA_SIZE;
+            size_t part = SIMFS_DATA_SIZE - used < length ? SIMFS_DATA_SIZE - used : length;
+            if (*slot == 0)
+                memset(tail, 0, used); // the file ends in a hole
+            else
+                memcpy(tail, simfsVolume->block[*slot].content.data, used);
+            memcpy(tail + used, data, part);
+
+            if (simfsStoreData(slot, tail, used + part, fd->size / SIMFS_DATA_SIZE < reservedSlots) != SIMFS_NO_ERROR)
+                return SIMFS_WRITE_ERROR;
+            offset = part;
+        }
+
+        while (offset < length) {
+            unsigned int i = (fd->size + offset) / SIMFS_DATA_SIZE;
+            SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, i, 1);
+            size_t part = length - offset < SIMFS_DATA_SIZE ? length - offset : SIMFS_DATA_SIZE;
+
+            if (slot == NULL || simfsStoreData(slot, data + offset, part, i < reservedSlots) != SIMFS_NO_ERROR)
+                return SIMFS_WRITE_ERROR;
+            offset += part;
+        }
     }
+    else {
+        unsigned int firstChunk = fd->size / SIMFS_COMPRESSION_CHUNK_SIZE;
+        size_t kept = fd->size % SIMFS_COMPRESSION_CHUNK_SIZE; // bytes already in the partial last chunk
+
+        char *plain = malloc(kept + length + 1);
+        if (plain == NULL)
+            return SIMFS_ALLOC_ERROR;
+
+        SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+        if (kept > 0 && simfsReadChunk(&cursor, firstChunk, plain, kept) != SIMFS_NO_ERROR) {
+            free(plain);
+            return SIMFS_READ_ERROR;
+        }
+        memcpy(plain + kept, data, length);
+
+        unsigned short *streamLength;
+        unsigned int chunks, blocksNeeded, lastSlot;
+        char *streams = simfsEncodeChunks(plain, kept + length, &streamLength, &chunks, &blocksNeeded, firstChunk, &lastSlot);
+        free(plain);
+        if (streams == NULL)
+            return SIMFS_ALLOC_ERROR;
+
+        // the blocks of the partial last chunk and of the reserved chunks that only this file holds are reused
+        unsigned int reusable = 0;
+        for (unsigned int j = 0; j < chunks * SIMFS_COMPRESSION_CHUNK_BLOCKS; j++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, firstChunk * SIMFS_COMPRESSION_CHUNK_BLOCKS + j);
+            if (blockIndex != 0 && simfsVolume->referenceCount[blockIndex] == 1)
+                reusable++;
+        }
+
+        unsigned int indexBlocks = simfsCountIndexBlocks(fd->block_ref);
+        unsigned int indexBlocksNeeded = (lastSlot + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+        indexBlocksNeeded = indexBlocksNeeded > indexBlocks ? indexBlocksNeeded - indexBlocks : 0;
+
+        SIMFS_ERROR error = SIMFS_NO_ERROR;
+        if (blocksNeeded + indexBlocksNeeded > simfsCountFreeBlocks() + reusable)
+            error = SIMFS_ALLOC_ERROR;
+
+        for (unsigned int k = 0; k < chunks && error == SIMFS_NO_ERROR; k++)
+            error = simfsStoreChunk(fd, firstChunk + k, streams + k * SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE, streamLength[k]);
+
+        free(streams);
+        free(streamLength);
+        if (error != SIMFS_NO_ERROR)
+            return error;
+    }
+
+    fd->size += length;
 
     return SIMFS_NO_ERROR;
 }
 
-//////////////////////////////////////////////////////////////////////////
-//
-// The following functions are provided only for testing without FUSE.
-//
-// When linked to the FUSE library, both user ID and process ID can be obtained by calling fuse_get_context().
-// See: http://libfuse.github.io/doxygen/structfuse__context.html
-//
-//////////////////////////////////////////////////////////////////////////
+/*
+ * Returns the number of bytes of chunk k of a compressed file of the given size.
+ */
+static size_t simfsChunkLength(size_t size, unsigned int k)
+{
+    size_t chunkStart = (size_t) k * SIMFS_COMPRESSION_CHUNK_SIZE;
+
+    if (chunkStart >= size)
+        return 0;
+
+    return size - chunkStart < SIMFS_COMPRESSION_CHUNK_SIZE ? size - chunkStart : SIMFS_COMPRESSION_CHUNK_SIZE;
+}
 
 /*
- * Simulates FUSE context to get values for user ID, process ID, and umask through fuse_context
+ * Rewrites chunks firstChunk to lastChunk of a compressed file for the file to have newSize bytes: every chunk is
+ * decoded with the length it has now (a hole decodes to zeros), the bytes of data (length bytes from offset on; data
+ * may be NULL) that overlap it are copied over it, and it is encoded again with the length it has in newSize. If the
+ * file grows past a partial last chunk before firstChunk, that chunk is encoded again, too.
+ *
+ * All chunks are encoded before anything is stored, so SIMFS_ALLOC_ERROR is returned with the file unchanged if
+ * the volume does not have enough free blocks. The caller sets the size of the file.
  */
+static SIMFS_ERROR simfsRewriteChunks(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t newSize, unsigned int firstChunk,
+                                      unsigned int lastChunk, size_t offset, char *data, size_t length)
+{
+    size_t streamCapacity = SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE;
+    unsigned int tailChunk = fd->size / SIMFS_COMPRESSION_CHUNK_SIZE;
+    int tail = fd->size % SIMFS_COMPRESSION_CHUNK_SIZE != 0 && newSize > fd->size && tailChunk < firstChunk;
+    unsigned int chunks = lastChunk - firstChunk + 1 + tail;
+
+    char *streams = malloc(chunks * streamCapacity);
+    unsigned short *streamLength = malloc(chunks * sizeof(unsigned short));
+    if (streams == NULL || streamLength == NULL) {
+        free(streams);
+        free(streamLength);
+        return SIMFS_ALLOC_ERROR;
+    }
 
-struct fuse_context *simfs_debug_get_context() {
+    SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+    SIMFS_SLOT_CURSOR_TYPE reuseCursor = { fd->block_ref, 0 };
+    unsigned int blocksNeeded = 0, reusable = 0; // the blocks of the rewritten chunks that only this file holds
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    for (unsigned int n = 0; n < chunks && error == SIMFS_NO_ERROR; n++) {
+        unsigned int k = tail ? (n == 0 ? tailChunk : firstChunk + n - 1) : firstChunk + n;
+        size_t chunkStart = (size_t) k * SIMFS_COMPRESSION_CHUNK_SIZE;
+        size_t oldLength = simfsChunkLength(fd->size, k);
+        size_t newLength = simfsChunkLength(newSize, k);
+        char plain[SIMFS_COMPRESSION_CHUNK_SIZE];
+
+        for (unsigned int j = 0; j < SIMFS_COMPRESSION_CHUNK_BLOCKS; j++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&reuseCursor, k * SIMFS_COMPRESSION_CHUNK_BLOCKS + j);
+            if (blockIndex != 0 && simfsVolume->referenceCount[blockIndex] == 1)
+                reusable++;
+        }
+
+        memset(plain, 0, sizeof(plain));
+        if (oldLength > 0 && simfsReadChunk(&cursor, k, plain, oldLength) != SIMFS_NO_ERROR) {
+            error = SIMFS_READ_ERROR;
+            break;
+        }
+
+        if (data != NULL && offset < chunkStart + newLength && offset + length > chunkStart) {
+            size_t from = offset > chunkStart ? offset : chunkStart;
+            size_t to = offset + length < chunkStart + newLength ? offset + length : chunkStart + newLength;
+            memcpy(plain + (from - chunkStart), data + (from - offset), to - from);
+        }
+
+        streamLength[n] = simfsEncodeChunk(plain, newLength, streams + n * streamCapacity);
+        blocksNeeded += (streamLength[n] + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+    }
 
-    // TODO: replace its use with FUSE's fuse_get_context()
+    unsigned int indexBlocks = simfsCountIndexBlocks(fd->block_ref);
+    unsigned int indexBlocksNeeded = ((lastChunk + 1) * SIMFS_COMPRESSION_CHUNK_BLOCKS + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) /
+        SIMFS_INDEX_ENTRIES_PER_BLOCK;
+    indexBlocksNeeded = indexBlocksNeeded > indexBlocks ? indexBlocksNeeded - indexBlocks : 0;
 
-    struct fuse_context *context = malloc(sizeof(struct fuse_context));
+    if (error == SIMFS_NO_ERROR && blocksNeeded + indexBlocksNeeded > simfsCountFreeBlocks() + reusable)
+        error = SIMFS_ALLOC_ERROR;
 
-    context->fuse = NULL;
-    context->uid = (uid_t) rand()%10+1;
-    context->pid = (pid_t) rand()%10+1;
-    context->gid = (gid_t) rand()%10+1;
-    context->private_data = NULL;
-    context->umask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH; // can be changed as needed
+    for (unsigned int n = 0; n < chunks && error == SIMFS_NO_ERROR; n++) {
+        unsigned int k = tail ? (n == 0 ? tailChunk : firstChunk + n - 1) : firstChunk + n;
+        error = simfsStoreChunk(fd, k, streams + n * streamCapacity, streamLength[n]);
+    }
 
-    return context;
+    free(streams);
+    free(streamLength);
+
+    return error;
 }
 
-char *simfsGenerateContent(int size)
+/*
+ * Makes the part of a file between its end and newSize read as zeros before the file grows. Only reserved slots
+ * hold blocks there (see simfsReserve), and their content may be left from earlier writes: a private block is
+ * cleared in place (for compressed files, the first block of a chunk, so that the chunk reads as unwritten), and
+ * a shared one is released, so the slot becomes a hole. No blocks are allocated; reserved blocks are cleared in
+ * place on a log-structured volume as well (see simfsStoreData).
+ */
+static void simfsClearReservedTail(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t newSize)
 {
-    size = (size <= 0 ? rand()%1000 : size); // arbitrarily chosen as an example
+    unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression);
+    unsigned int step = fd->compression == SIMFS_NO_COMPRESSION ? 1 : SIMFS_COMPRESSION_CHUNK_BLOCKS;
+    size_t unit = fd->compression == SIMFS_NO_COMPRESSION ? SIMFS_DATA_SIZE : SIMFS_COMPRESSION_CHUNK_SIZE;
+    SIMFS_DATA_TYPE zeros;
+
+    memset(zeros, 0, SIMFS_DATA_SIZE);
+
+    // the partial last unit is not cleared; the bytes past the end of a file in its last block are always zeros
+    for (unsigned int i = (fd->size + unit - 1) / unit * step; i < reservedSlots && i / step * unit < newSize; i += step) {
+        SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, i, 0);
+        if (slot == NULL)
+            break;
+        if (*slot == 0)
+            continue;
+
+        if (simfsVolume->referenceCount[*slot] > 1) {
+            simfsReleaseBlock(*slot);
+            *slot = 0;
+        }
+        else
+            simfsStoreData(slot, zeros, 0, 1); // in place, so it cannot fail
+    }
+}
 
-    char *content = malloc(size);
+/*
+ * Writes length bytes from data to a file at offset, keeping the layout of its content (an empty file takes the
+ * compression setting of the volume). The offset may be past the end of the file; the bytes in between become a
+ * hole. Only the blocks (for compressed files, the chunks) overlapping the range are written, so a hole gets
+ * a block only when something is written into it. Index blocks are still needed for all slots up to the range.
+ *
+ * Returns SIMFS_ALLOC_ERROR, with the content of the file unchanged, if the volume does not have enough free blocks.
+ */
+static SIMFS_ERROR simfsWriteRange(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t offset, char *data, size_t length)
+{
+    if (length == 0)
+        return SIMFS_NO_ERROR;
+
+    if (fd->size == 0 && fd->reserved == 0)
+        fd->compression = simfsVolume->superblock.compression;
+
+    size_t end = offset + length;
+    size_t newSize = end > fd->size ? end : fd->size;
+
+    simfsClearReservedTail(fd, newSize);
+
+    if (fd->compression == SIMFS_NO_COMPRESSION) {
+        unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression);
+        unsigned int firstSlot = offset / SIMFS_DATA_SIZE;
+        unsigned int lastSlot = (end - 1) / SIMFS_DATA_SIZE;
+        unsigned int indexBlocks = simfsCountIndexBlocks(fd->block_ref);
+        unsigned int indexBlocksNeeded = (lastSlot + SIMFS_INDEX_ENTRIES_PER_BLOCK) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+        indexBlocksNeeded = indexBlocksNeeded > indexBlocks ? indexBlocksNeeded - indexBlocks : 0;
+
+        // holes get new blocks, and shared blocks are copied on write
+        unsigned int blocksNeeded = 0;
+        SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+        for (unsigned int i = firstSlot; i <= lastSlot; i++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, i);
+            if (blockIndex == 0 || simfsVolume->referenceCount[blockIndex] > 1)
+                blocksNeeded++;
+        }
+
+        if (blocksNeeded + indexBlocksNeeded > simfsCountFreeBlocks())
+            return SIMFS_ALLOC_ERROR;
+
+        for (unsigned int i = firstSlot; i <= lastSlot; i++) {
+            SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, i, 1);
+            if (slot == NULL)
+                return SIMFS_WRITE_ERROR;
+
+            size_t blockStart = (size_t) i * SIMFS_DATA_SIZE;
+            size_t from = offset > blockStart ? offset : blockStart;
+            size_t to = end < blockStart + SIMFS_DATA_SIZE ? end : blockStart + SIMFS_DATA_SIZE;
+            size_t used = newSize - blockStart < SIMFS_DATA_SIZE ? newSize - blockStart : SIMFS_DATA_SIZE;
+
+            // a block that is only partly overwritten keeps the rest of its content
+            SIMFS_DATA_TYPE content;
+            memset(content, 0, SIMFS_DATA_SIZE);
+            if (to - from < used && *slot != 0) {
+                if (!simfsChecksumValid(*slot))
+                    return SIMFS_READ_ERROR;
+                memcpy(content, simfsVolume->block[*slot].content.data, SIMFS_DATA_SIZE);
+            }
+            memcpy(content + (from - blockStart), data + (from - offset), to - from);
+
+            if (simfsStoreData(slot, content, used, i < reservedSlots) != SIMFS_NO_ERROR)
+                return SIMFS_WRITE_ERROR;
+        }
+    }
+    else {
+        SIMFS_ERROR error = simfsRewriteChunks(fd, newSize, offset / SIMFS_COMPRESSION_CHUNK_SIZE,
+                                               (end - 1) / SIMFS_COMPRESSION_CHUNK_SIZE, offset, data, length);
+        if (error != SIMFS_NO_ERROR)
+            return error;
+    }
 
-    int firstPrintable = ' ';
-    int len = '~' - firstPrintable;
+    fd->size = newSize;
 
-    for (int i=0; i<size-1; i++)
-        *(content+i) = firstPrintable + rand()%len;
+    return SIMFS_NO_ERROR;
+}
 
-    content[size - 1] = '\0';
-    return content;
+/*
+ * Sets the size of a file, like ftruncate(2).
+ *
+ * Growing a file adds a hole at its end, which needs no data blocks; only the partial last chunk of a compressed
+ * file is encoded again. Shrinking a file releases the blocks past the new end, except the reserved ones, and
+ * clears the rest of the new last block (or chunk), so the bytes past the end of a file always read as zeros.
+ *
+ * Returns SIMFS_ALLOC_ERROR, with the file unchanged, if a block has to be copied on write and the volume is full.
+ */
+static SIMFS_ERROR simfsResizeContent(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t size)
+{
+    if (fd->size == 0 && fd->reserved == 0)
+        fd->compression = simfsVolume->superblock.compression;
+
+    if (size == fd->size)
+        return SIMFS_NO_ERROR;
+
+    size_t shorter = size < fd->size ? size : fd->size;
+
+    if (fd->compression == SIMFS_NO_COMPRESSION) {
+        if (size < fd->size && size % SIMFS_DATA_SIZE != 0) {
+            SIMFS_INDEX_TYPE *slot = simfsIndexSlot(&fd->block_ref, size / SIMFS_DATA_SIZE, 0);
+            if (slot != NULL && *slot != 0) {
+                if (!simfsChecksumValid(*slot))
+                    return SIMFS_READ_ERROR;
+                if (simfsVolume->referenceCount[*slot] > 1 && simfsCountFreeBlocks() == 0)
+                    return SIMFS_ALLOC_ERROR;
+
+                SIMFS_DATA_TYPE content;
+                memcpy(content, simfsVolume->block[*slot].content.data, SIMFS_DATA_SIZE);
+                int reserved = size / SIMFS_DATA_SIZE < simfsReservedSlots(fd->reserved, fd->compression);
+                if (simfsStoreData(slot, content, size % SIMFS_DATA_SIZE, reserved) != SIMFS_NO_ERROR)
+                    return SIMFS_WRITE_ERROR;
+            }
+        }
+    }
+    else if (shorter % SIMFS_COMPRESSION_CHUNK_SIZE != 0) {
+        unsigned int k = shorter / SIMFS_COMPRESSION_CHUNK_SIZE;
+        SIMFS_ERROR error = simfsRewriteChunks(fd, size, k, k, 0, NULL, 0);
+        if (error != SIMFS_NO_ERROR)
+            return error;
+    }
+
+    if (size < fd->size) {
+        unsigned int keptSlots = fd->compression == SIMFS_NO_COMPRESSION ? (size + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE :
+            (size + SIMFS_COMPRESSION_CHUNK_SIZE - 1) / SIMFS_COMPRESSION_CHUNK_SIZE * SIMFS_COMPRESSION_CHUNK_BLOCKS;
+        unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression);
+        simfsTruncateChain(&fd->block_ref, keptSlots > reservedSlots ? keptSlots : reservedSlots);
+    }
+    else
+        simfsClearReservedTail(fd, size);
+
+    fd->size = size;
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Returns the offset of the first byte at or after offset (which is within the file) that is in a block if data is
+ * non-zero, or in a hole otherwise; returns the size of the file if there is none. The end of the file counts as
+ * a hole, and reserved blocks count as data. Only the index blocks are read.
+ */
+static size_t simfsSeekContent(SIMFS_FILE_DESCRIPTOR_TYPE *fd, size_t offset, int data)
+{
+    unsigned int step = fd->compression == SIMFS_NO_COMPRESSION ? 1 : SIMFS_COMPRESSION_CHUNK_BLOCKS;
+    size_t unit = fd->compression == SIMFS_NO_COMPRESSION ? SIMFS_DATA_SIZE : SIMFS_COMPRESSION_CHUNK_SIZE;
+    SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+
+    for (size_t u = offset / unit; u * unit < fd->size; u++) {
+        SIMFS_INDEX_TYPE blockIndex = simfsSlotAt(&cursor, u * step);
+        if ((blockIndex != 0) == (data != 0))
+            return u * unit > offset ? u * unit : offset;
+
+        // the rest of a file past the end of its chain is one hole
+        if (cursor.indexBlock == 0 || cursor.indexBlock == SIMFS_INVALID_INDEX)
+            break;
+    }
+
+    return fd->size;
+}
+
+/*
+ * Subtree usage.
+ *
+ * simfsOwnUsage counts what a node holds itself: a file its size, its descriptor, and the index and data blocks of
+ * its content; a folder its descriptor and index blocks. Operations that change what a node holds take its own
+ * usage before, and simfsTrackUsage adds the difference to the node and to all folders above it afterwards. Only
+ * the content of the node and its parent chain are read, never the subtree.
+ */
+static void simfsOwnUsage(SIMFS_INDEX_TYPE node, SIMFS_USAGE_TYPE *usage)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+
+    memset(usage, 0, sizeof(SIMFS_USAGE_TYPE));
+    usage->blocks = 1;
+    if (fd->type == FOLDER_CONTENT_TYPE)
+        usage->folders = 1;
+    else {
+        usage->files = 1;
+        usage->bytes = fd->size;
+    }
+
+    for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]) {
+        usage->blocks++;
+        if (fd->type == FILE_CONTENT_TYPE)
+            for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++)
+                if (simfsVolume->block[indexBlock].content.index[i] != 0)
+                    usage->blocks++;
+    }
+}
+
+/*
+ * Adds (or, if sign is negative, subtracts) a usage to a node and to all folders above it.
+ */
+static void simfsAddUsage(SIMFS_INDEX_TYPE node, SIMFS_USAGE_TYPE *usage, int sign)
+{
+    for (; node != SIMFS_INVALID_INDEX; node = simfsVolume->block[node].content.fileDescriptor.parent) {
+        SIMFS_USAGE_TYPE *total = &simfsVolume->block[node].content.fileDescriptor.usage;
+
+        if (sign < 0) {
+            total->bytes -= usage->bytes;
+            total->files -= usage->files;
+            total->folders -= usage->folders;
+            total->blocks -= usage->blocks;
+        }
+        else {
+            total->bytes += usage->bytes;
+            total->files += usage->files;
+            total->folders += usage->folders;
+            total->blocks += usage->blocks;
+        }
+    }
+}
+
+static void simfsTrackUsage(SIMFS_INDEX_TYPE node, SIMFS_USAGE_TYPE *before)
+{
+    SIMFS_USAGE_TYPE after;
+
+    simfsOwnUsage(node, &after);
+    simfsAddUsage(node, before, -1);
+    simfsAddUsage(node, &after, 1);
+}
+
+/*
+ * Counts the usage of a whole subtree from scratch, for trees that are built without the operations above (see
+ * simfsImportTree).
+ */
+static void simfsRecountUsage(SIMFS_INDEX_TYPE node)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+
+    simfsOwnUsage(node, &fd->usage);
+    if (fd->type != FOLDER_CONTENT_TYPE)
+        return;
+
+    for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE child = simfsVolume->block[indexBlock].content.index[i];
+            if (child == 0)
+                continue;
+
+            simfsRecountUsage(child);
+            SIMFS_USAGE_TYPE *usage = &simfsVolume->block[child].content.fileDescriptor.usage;
+            fd->usage.bytes += usage->bytes;
+            fd->usage.files += usage->files;
+            fd->usage.folders += usage->folders;
+            fd->usage.blocks += usage->blocks;
+        }
+}
+
+/*
+ * Operations on the in-memory directory.
+ *
+ * Every slot of the hash table is the head of a conflict resolution list. A nodeReference of 0 marks an unused
+ * entry (block 0 is the root folder, which is never looked up by name). Entries are keyed by the parent and the
+ * leaf name in the file descriptor they reference; the roots of mounted snapshots have no parent and are keyed
+ * by SIMFS_INVALID_INDEX.
+ */
+static SIMFS_INDEX_TYPE simfsDirectoryFind(SIMFS_CONTEXT_TYPE *context, SIMFS_INDEX_TYPE parent, char *leaf)
+{
+    for (SIMFS_DIR_ENT *entry = &context->directory[hash(parent, (unsigned char *) leaf)]; entry != NULL; entry = simfsPointer(entry->next))
+        if (entry->nodeReference != 0 &&
+            simfsVolume->block[entry->nodeReference].content.fileDescriptor.parent == parent &&
+            strcmp(simfsVolume->block[entry->nodeReference].content.fileDescriptor.name, leaf) == 0)
+            return entry->nodeReference;
+
+    return SIMFS_INVALID_INDEX;
+}
+
+static SIMFS_DIR_ENT *simfsDirectorySlot(SIMFS_CONTEXT_TYPE *context, SIMFS_INDEX_TYPE nodeReference)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[nodeReference].content.fileDescriptor;
+    return &context->directory[hash(fd->parent, (unsigned char *) fd->name)];
+}
+
+static SIMFS_ERROR simfsDirectoryInsert(SIMFS_CONTEXT_TYPE *context, SIMFS_INDEX_TYPE nodeReference)
+{
+    SIMFS_DIR_ENT *entry = simfsDirectorySlot(context, nodeReference);
+
+    if (entry->nodeReference != 0) {
+        SIMFS_DIR_ENT *collision = simfsPoolAllocate(&context->directoryEntryPool);
+        if (collision == NULL)
+            return SIMFS_ALLOC_ERROR;
+
+        collision->nodeReference = nodeReference;
+        collision->next = entry->next;
+        entry->next = simfsOffset(collision);
+    }
+    else
+        entry->nodeReference = nodeReference;
+
+    return SIMFS_NO_ERROR;
+}
+
+static void simfsDirectoryRemove(SIMFS_CONTEXT_TYPE *context, SIMFS_INDEX_TYPE nodeReference)
+{
+    SIMFS_DIR_ENT *entry = simfsDirectorySlot(context, nodeReference);
+
+    if (entry->nodeReference == nodeReference) {
+        // the head lives in the hash table, so the next node (if any) is moved into it
+        SIMFS_DIR_ENT *next = simfsPointer(entry->next);
+        if (next != NULL) {
+            *entry = *next;
+            simfsPoolRelease(&context->directoryEntryPool, next);
+        }
+        else
+            entry->nodeReference = 0;
+        return;
+    }
+
+    for (SIMFS_DIR_ENT *previous = entry; previous->next != 0; previous = simfsPointer(previous->next))
+        if (((SIMFS_DIR_ENT *) simfsPointer(previous->next))->nodeReference == nodeReference) {
+            SIMFS_DIR_ENT *node = simfsPointer(previous->next);
+            previous->next = node->next;
+            simfsPoolRelease(&context->directoryEntryPool, node);
+            return;
+        }
+}
+
+/*
+ * Returns the process identifier of the caller. When linked to FUSE, it is the pid in fuse_get_context();
+ * without FUSE, the simulated processes are the processes of the host.
+ */
+static pid_t simfsCallerPid()
+{
+    return getpid();
+}
+
+/*
+ * Returns the process control block of the process with the given identifier, or NULL if it has none.
+ */
+static SIMFS_PROCESS_CONTROL_BLOCK_TYPE *simfsFindProcess(pid_t pid)
+{
+    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsPointer(simfsContext->processControlBlocks);
+
+    while (process != NULL && process->pid != pid)
+        process = simfsPointer(process->next);
+
+    return process;
+}
+
+/*
+ * Resolves a path to the node it names with one lookup in the in-memory directory per component.
+ *
+ * Paths starting with '/' are resolved from the root of the volume, paths starting with '@' from the roots of the
+ * mounted snapshots (which have no parent), and all other paths from the current working directory of the caller.
+ *
+ * If leaf is not NULL, the last component is not looked up but copied to leaf, and the folder that would hold it
+ * is returned instead. Returns SIMFS_INVALID_INDEX if a component does not exist, is not a folder where a folder
+ * is needed, or is too long for a name.
+ */
+static SIMFS_INDEX_TYPE simfsResolvePath(char *path, char *leaf)
+{
+    SIMFS_INDEX_TYPE node = simfsVolume->superblock.rootNodeIndex;
+
+    if (*path == '@')
+        node = SIMFS_INVALID_INDEX;
+    else if (*path != '/') {
+        SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsFindProcess(simfsCallerPid());
+        if (process != NULL)
+            node = process->currentWorkingDirectory;
+    }
+
+    SIMFS_NAME_TYPE component;
+    for (;;) {
+        path += strspn(path, "/");
+        if (*path == '\0')
+            break;
+
+        size_t length = strcspn(path, "/");
+        if (length >= SIMFS_MAX_NAME_LENGTH)
+            return SIMFS_INVALID_INDEX;
+        memcpy(component, path, length);
+        component[length] = '\0';
+        path += length;
+
+        if (leaf != NULL && path[strspn(path, "/")] == '\0') {
+            strcpy(leaf, component);
+            return node;
+        }
+
+        if (node != SIMFS_INVALID_INDEX && simfsVolume->block[node].content.fileDescriptor.type != FOLDER_CONTENT_TYPE)
+            return SIMFS_INVALID_INDEX;
+
+        node = simfsDirectoryFind(simfsContext, node, component);
+        if (node == SIMFS_INVALID_INDEX)
+            return SIMFS_INVALID_INDEX;
+    }
+
+    // without components, a path names the folder it starts from, which has no leaf
+    return leaf == NULL ? node : SIMFS_INVALID_INDEX;
+}
+
+/*
+ * Returns the entry in the global open file table for a file handle of the calling process, or NULL if the handle
+ * does not refer to an open file (e.g., if the reference to the global table is NULL, or if the entry in the global
+ * table is INVALID_CONTENT_TYPE).
+ */
+static SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *simfsGlobalEntry(SIMFS_FILE_HANDLE_TYPE fileHandle)
+{
+    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsFindProcess(simfsCallerPid());
+
+    if (process == NULL || fileHandle < 0 || fileHandle >= SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS)
+        return NULL;
+
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsPointer(process->openFileTable[fileHandle].globalEntry);
+    if (entry == NULL || entry->referenceCount == 0 || entry->type == INVALID_CONTENT_TYPE)
+        return NULL;
+
+    return entry;
+}
+
+/*
+ * Returns the entry in the global open file table for the file with the given descriptor block, or NULL if the
+ * file is not open.
+ */
+static SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *simfsFindGlobalEntry(SIMFS_INDEX_TYPE node)
+{
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES; i++)
+        if (simfsContext->globalOpenFileTable[i].referenceCount > 0 && simfsContext->globalOpenFileTable[i].fileDescriptor == node)
+            return &simfsContext->globalOpenFileTable[i];
+
+    return NULL;
+}
+
+static void simfsCleanSegmentsIfLow();
+
+/*
+ * Stores the bytes buffered in an entry of the global open file table at the end of the file.
+ *
+ * If wholeBlocksOnly is set, only the bytes that fill the file up to the end of its last complete block (for
+ * compressed files, chunk) are stored, and the rest stays in the buffer. Appends thus reach the blocks in whole
+ * blocks, and the allocator and the bitvector are touched once per block instead of once per append.
+ */
+static SIMFS_ERROR simfsFlushBuffer(SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry, int wholeBlocksOnly)
+{
+    if (entry->bufferedBytes == 0)
+        return SIMFS_NO_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+    size_t count = entry->bufferedBytes;
+
+    if (wholeBlocksOnly) {
+        // the layout is chosen as in simfsAppendContent: a file with space reserved keeps the one it was reserved in
+        char compression = fd->size == 0 && fd->reserved == 0 ? simfsVolume->superblock.compression : fd->compression;
+        size_t unit = compression == SIMFS_NO_COMPRESSION ? SIMFS_DATA_SIZE : SIMFS_COMPRESSION_CHUNK_SIZE;
+        size_t end = (fd->size + count) / unit * unit;
+
+        count = end > fd->size ? end - fd->size : 0;
+        if (count == 0)
+            return SIMFS_NO_ERROR;
+    }
+
+    SIMFS_USAGE_TYPE before;
+    simfsOwnUsage(entry->fileDescriptor, &before);
+
+    simfsCleanSegmentsIfLow();
+    SIMFS_ERROR error = simfsAppendContent(fd, entry->writeBuffer, count);
+    simfsTrackUsage(entry->fileDescriptor, &before);
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    entry->bufferedBytes -= count;
+    memmove(entry->writeBuffer, entry->writeBuffer + count, entry->bufferedBytes);
+    entry->size = fd->size;
+
+    fd->lastModificationTime = simfsNow();
+    entry->lastModificationTime = fd->lastModificationTime;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// backing files
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Transfer of one member of a striped volume between the disk and simfsVolume, done by a thread of its own.
+ */
+typedef struct simfs_member_io_type {
+    pthread_t thread;
+    char *fileName;
+    int memberIndex;
+    int numberOfMembers;
+    int write; // non-zero to save the member, zero to load it
+    SIMFS_SUPERBLOCK_TYPE superblock; // the copy of the superblock in the member
+    SIMFS_ERROR error;
+} SIMFS_MEMBER_IO_TYPE;
+
+static int simfsTransfer(void *buffer, size_t size, FILE *file, int write)
+{
+    return (write ? fwrite(buffer, 1, size, file) : fread(buffer, 1, size, file)) == size;
+}
+
+/*
+ * Saves or loads one member: its copy of the superblock, the rest of the metadata if it is the first member, and
+ * then its stripes, each with one call. Loading leaves the superblock of the volume alone; the copy in the member
+ * goes to member->superblock, and the caller checks that the members fit together.
+ */
+static void *simfsTransferMember(void *argument)
+{
+    SIMFS_MEMBER_IO_TYPE *member = argument;
+
+    FILE *file = fopen(member->fileName, member->write ? "wb" : "rb");
+    if (file == NULL) {
+        member->error = SIMFS_ALLOC_ERROR;
+        return NULL;
+    }
+
+    if (member->write) {
+        member->superblock = simfsVolume->superblock;
+        member->superblock.memberIndex = member->memberIndex;
+    }
+    int complete = simfsTransfer(&member->superblock, sizeof(SIMFS_SUPERBLOCK_TYPE), file, member->write);
+
+    int stripeBlocks = member->superblock.stripeBlocks;
+    if (complete && (member->superblock.numberOfMembers != member->numberOfMembers ||
+                     member->superblock.memberIndex != member->memberIndex || stripeBlocks < 1))
+        complete = 0; // not this member of a volume with this many members
+
+    if (complete && member->memberIndex == 0)
+        complete = simfsTransfer((char *) simfsVolume + sizeof(SIMFS_SUPERBLOCK_TYPE),
+                                 offsetof(SIMFS_VOLUME, block) - sizeof(SIMFS_SUPERBLOCK_TYPE), file, member->write);
+
+    for (int first = member->memberIndex * stripeBlocks; complete && first < SIMFS_NUMBER_OF_BLOCKS;
+         first += member->numberOfMembers * stripeBlocks) {
+        int count = first + stripeBlocks <= SIMFS_NUMBER_OF_BLOCKS ? stripeBlocks : SIMFS_NUMBER_OF_BLOCKS - first;
+        complete = simfsTransfer(&simfsVolume->block[first], count * sizeof(SIMFS_BLOCK_TYPE), file, member->write);
+    }
+
+    if (fclose(file) != 0)
+        complete = 0;
+
+    if (!complete)
+        member->error = member->write ? SIMFS_WRITE_ERROR : SIMFS_READ_ERROR;
+
+    return NULL;
+}
+
+/*
+ * Saves simfsVolume to the given members, or loads it from them, with one thread per member (the first member is
+ * done by the calling thread). Saving lays the volume out across as many members as are given.
+ *
+ * Returns SIMFS_ALLOC_ERROR if a member cannot be opened or a thread cannot be started, SIMFS_WRITE_ERROR or
+ * SIMFS_READ_ERROR if a member cannot be written or read completely, and SIMFS_READ_ERROR if the members that
+ * were read do not belong to one volume in the given order or were not saved by the same sync.
+ */
+static SIMFS_ERROR simfsTransferVolume(char **memberFileNames, int numberOfMembers, int write)
+{
+    if (numberOfMembers < 1)
+        return SIMFS_ACCESS_ERROR;
+
+    SIMFS_MEMBER_IO_TYPE *members = calloc(numberOfMembers, sizeof(SIMFS_MEMBER_IO_TYPE));
+    if (members == NULL)
+        return SIMFS_ALLOC_ERROR;
+
+    if (write)
+        simfsVolume->superblock.numberOfMembers = numberOfMembers;
+
+    for (int m = 0; m < numberOfMembers; m++) {
+        members[m].fileName = memberFileNames[m];
+        members[m].memberIndex = m;
+        members[m].numberOfMembers = numberOfMembers;
+        members[m].write = write;
+    }
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    int started = 1;
+    for (; started < numberOfMembers; started++)
+        if (pthread_create(&members[started].thread, NULL, simfsTransferMember, &members[started]) != 0) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+
+    simfsTransferMember(&members[0]);
+
+    for (int m = 0; m < started; m++) {
+        if (m > 0)
+            pthread_join(members[m].thread, NULL);
+        if (error == SIMFS_NO_ERROR)
+            error = members[m].error;
+    }
+
+    if (error == SIMFS_NO_ERROR && !write) {
+        for (int m = 1; m < numberOfMembers; m++)
+            if (members[m].superblock.volumeId != members[0].superblock.volumeId ||
+                members[m].superblock.stripeBlocks != members[0].superblock.stripeBlocks ||
+                members[m].superblock.generation != members[0].superblock.generation)
+                error = SIMFS_READ_ERROR;
+
+        if (error == SIMFS_NO_ERROR) {
+            simfsVolume->superblock = members[0].superblock;
+            simfsVolume->superblock.memberIndex = 0;
+        }
+    }
+
+    free(members);
+
+    return error;
+}
+
+/*
+ * Allocates the volume and a context for it, and formats the volume with an empty root folder.
+ */
+static SIMFS_ERROR simfsFormatVolume(SIMFS_ENGINE_TYPE engine)
+{
+    simfsContext = calloc(1, sizeof(SIMFS_CONTEXT_TYPE));
+    if (simfsContext == NULL)
+        return SIMFS_ALLOC_ERROR;
+
+    simfsVolume = calloc(1, sizeof(SIMFS_VOLUME));
+    if (simfsVolume == NULL) {
+        free(simfsContext);
+        simfsContext = NULL;
+        return SIMFS_ALLOC_ERROR;
+    }
+
+    // initialize the superblock
+
+    simfsVolume->superblock.rootNodeIndex = 0;
+    simfsVolume->superblock.blockSize = SIMFS_BLOCK_SIZE;
+    simfsVolume->superblock.numberOfBlocks = SIMFS_NUMBER_OF_BLOCKS;
+    simfsVolume->superblock.volumeId = (unsigned int) simfsNow() ^ (unsigned int) getpid() << 16;
+    simfsVolume->superblock.stripeBlocks = SIMFS_STRIPE_BLOCKS;
+    simfsVolume->superblock.engine = engine;
+
+    // initialize the blocks holding the root folder
+
+    // initialize the root folder
+
+    simfsVolume->block[0].type = FOLDER_CONTENT_TYPE;
+    simfsVolume->block[0].content.fileDescriptor.type = FOLDER_CONTENT_TYPE;
+    strcpy(simfsVolume->block[0].content.fileDescriptor.name, "/");
+    simfsVolume->block[0].content.fileDescriptor.parent = SIMFS_INVALID_INDEX;
+    simfsVolume->block[0].content.fileDescriptor.accessRights = 0777; //arbitrary umask to allow for complete
+    simfsVolume->block[0].content.fileDescriptor.owner = 0; // arbitrarily simulated
+    simfsVolume->block[0].content.fileDescriptor.size = 0;
+
+    time_t now = simfsNow();
+    simfsVolume->block[0].content.fileDescriptor.creationTime = now;
+    simfsVolume->block[0].content.fileDescriptor.lastAccessTime = now;
+    simfsVolume->block[0].content.fileDescriptor.lastModificationTime = now;
+
+    // initialize the index block of the root folder
+
+    // first, point from the root file descriptor to the index block
+    simfsVolume->block[0].content.fileDescriptor.block_ref = 1;
+
+    simfsVolume->block[1].type = INDEX_CONTENT_TYPE;
+
+    // indicate that the blocks #0 and #1 are allocated
+
+    simfsFlipBit(simfsVolume->bitvector, simfsFindFreeBlock(simfsVolume->bitvector)); // should be 0
+    simfsFlipBit(simfsVolume->bitvector, simfsFindFreeBlock(simfsVolume->bitvector)); // should be 1
+    simfsVolume->referenceCount[0] = 1;
+    simfsVolume->referenceCount[1] = 1;
+    simfsOwnUsage(0, &simfsVolume->block[0].content.fileDescriptor.usage);
+
+    // sample alternative #1 - illustration of bit-wise operations
+//    simfsVolume->bitvector[0] = 0;
+//    simfsVolume->bitvector[0] |= 0x01 << 7; // set the first bit of the bit vector
+//    simfsVolume->bitvector[0] += 0x80 >> 1; // flip the first bit of the bit vector
+
+    // sample alternative #2 - less educational, but fastest
+//     simfsVolume->bitvector[0] = 0xC0;
+    // 0xC0 is 11000000 in binary (showing the root block and root's index block taken)
+    memcpy(simfsContext->bitvector, simfsVolume->bitvector, sizeof(simfsVolume->bitvector));
+
+    simfsCrc32cInit();
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Formats a volume written by the given engine and saves it to its backing files.
+ */
+static SIMFS_ERROR simfsCreateVolume(char **memberFileNames, int numberOfMembers, SIMFS_ENGINE_TYPE engine)
+{
+    if (numberOfMembers < 1)
+        return SIMFS_ACCESS_ERROR;
+
+    // the new volume is formatted in simfsVolume and simfsContext, which belong to the mounted volume
+    if (simfsContext != NULL)
+        return SIMFS_DUPLICATE_ERROR;
+
+    SIMFS_ERROR error = simfsFormatVolume(engine);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    simfsSealChecksums(1);
+
+    error = simfsTransferVolume(memberFileNames, numberOfMembers, 1);
+
+    // the volume is used after it is mounted
+    free(simfsVolume);
+    free(simfsContext);
+    simfsVolume = NULL;
+    simfsContext = NULL;
+
+    return error;
+}
+
+/*
+ * Allocates space for the file system and saves it to disk. The memory is released again; the new volume is used
+ * by mounting it.
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if a volume is mounted.
+ */
+SIMFS_ERROR simfsCreateFileSystem(char *simfsFileName)
+{
+    return simfsCreateStripedFileSystem(&simfsFileName, 1);
+}
+
+/*
+ * Works like simfsCreateFileSystem, but stripes the volume across the given backing files; the files are written
+ * in parallel.
+ */
+SIMFS_ERROR simfsCreateStripedFileSystem(char **memberFileNames, int numberOfMembers)
+{
+    return simfsCreateVolume(memberFileNames, numberOfMembers, SIMFS_IN_PLACE_ENGINE);
+}
+
+/*
+ * Works like simfsCreateStripedFileSystem, but the volume is written by the log-structured engine.
+ */
+SIMFS_ERROR simfsCreateLogStructuredFileSystem(char **memberFileNames, int numberOfMembers)
+{
+    return simfsCreateVolume(memberFileNames, numberOfMembers, SIMFS_LOG_STRUCTURED_ENGINE);
+}
+
+/*
+ * Takes a folder block and goes through each fileDescriptor pointed to by the index array (the index array pointed to from the folder block_ref)
+ * 
+ * If another folder is found, pass that folder into the same function to go through that folder.
+ *  Otherwise:
+ *  	Hash the fileName and store the block_ref at that location in the directory 
+ *
+ */
+
+SIMFS_ERROR AddFolderToContext(SIMFS_BLOCK_TYPE folder, SIMFS_CONTEXT_TYPE *context){
+
+	if(folder.content.fileDescriptor.size <= 0){
+		return SIMFS_NO_ERROR;
+	}
+
+	//walk the chain of index blocks; unused slots hold 0
+	for(SIMFS_INDEX_TYPE indexBlock = folder.content.fileDescriptor.block_ref;
+		indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+		indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]){
+
+		for(int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++){
+
+			SIMFS_INDEX_TYPE nodeReference = simfsVolume->block[indexBlock].content.index[i];
+			if(nodeReference == 0)
+				continue;
+
+			SIMFS_BLOCK_TYPE blockAtIndex = simfsVolume->block[nodeReference];
+
+			if(blockAtIndex.content.fileDescriptor.type == FOLDER_CONTENT_TYPE){
+				AddFolderToContext(blockAtIndex, context);
+			}
+
+			if(simfsDirectoryInsert(context, nodeReference) != SIMFS_NO_ERROR)
+				return SIMFS_ALLOC_ERROR;
+		}
+	}
+	return SIMFS_NO_ERROR;
+}
+
+/*
+ * Allocates the volume and the context for mounting: on the heap, or in a new shared memory segment if the options
+ * name one (see SIMFS_SHARED_SEGMENT_TYPE). Returns SIMFS_DUPLICATE_ERROR if the shared memory object exists.
+ */
+static SIMFS_ERROR simfsAllocateMount(SIMFS_MOUNT_OPTIONS_TYPE *options)
+{
+    if (options == NULL || options->sharedName[0] == '\0') {
+        simfsContext = calloc(1, sizeof(SIMFS_CONTEXT_TYPE));
+        simfsVolume = malloc(sizeof(SIMFS_VOLUME));
+        if (simfsContext == NULL || simfsVolume == NULL) {
+            free(simfsVolume);
+            free(simfsContext);
+            simfsVolume = NULL;
+            simfsContext = NULL;
+            return SIMFS_ALLOC_ERROR;
+        }
+        simfsContextInit(simfsContext, NULL, 0);
+        return SIMFS_NO_ERROR;
+    }
+
+    int descriptor = shm_open(options->sharedName, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (descriptor < 0)
+        return errno == EEXIST ? SIMFS_DUPLICATE_ERROR : SIMFS_ALLOC_ERROR;
+
+    // a new object reads as zeros, so the context starts out cleared
+    SIMFS_SHARED_SEGMENT_TYPE *segment = MAP_FAILED;
+    if (ftruncate(descriptor, sizeof(SIMFS_SHARED_SEGMENT_TYPE)) == 0)
+        segment = mmap(NULL, sizeof(SIMFS_SHARED_SEGMENT_TYPE), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (segment == MAP_FAILED) {
+        shm_unlink(options->sharedName);
+        return SIMFS_ALLOC_ERROR;
+    }
+
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&segment->lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    pthread_condattr_t conditionAttributes;
+    pthread_condattr_init(&conditionAttributes);
+    pthread_condattr_setpshared(&conditionAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&segment->turn, &conditionAttributes);
+    pthread_condattr_destroy(&conditionAttributes);
+    segment->attachedProcesses = 1;
+
+    // the magic is set when the volume is loaded, so processes cannot attach before
+    simfsShared = segment;
+    simfsContext = &segment->context;
+    simfsVolume = &segment->volume;
+    simfsContextInit(simfsContext, segment->arena, sizeof(segment->arena));
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Releases the mounted volume and all memory of its context without saving it. The shared memory object of
+ * a shared mount is removed; processes still attached keep their mapping until they detach.
+ */
+static void simfsReleaseVolume()
+{
+    // the directory entries, the process control blocks and the read buffers go with the arena
+    simfsArenaRelease(&simfsContext->arena);
+
+    if (simfsShared != NULL) {
+        shm_unlink(simfsContext->options.sharedName);
+        munmap(simfsShared, sizeof(SIMFS_SHARED_SEGMENT_TYPE));
+        simfsShared = NULL;
+    }
+    else {
+        free(simfsVolume);
+        free(simfsContext);
+    }
+    simfsVolume = NULL;
+    simfsContext = NULL;
+}
+
+/*
+ * Serializes the file operations of the processes attached to a shared mount; nothing is locked for a private
+ * mount. A process that died holding the lock may have left its operation half done; the lock is taken over all
+ * the same, and a scrub shows what the operation left behind.
+ */
+static void simfsLockMount()
+{
+    if (simfsShared != NULL && pthread_mutex_lock(&simfsShared->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&simfsShared->lock);
+}
+
+static void simfsUnlockMount()
+{
+    if (simfsShared != NULL)
+        pthread_mutex_unlock(&simfsShared->lock);
+}
+
+/*
+ * Loads the file system from a disk and constructs in-memory directory of all files is the system.
+ *
+ * Starting with the file system root (pointed to from the superblock) traverses the hierarachy of directories
+ * and adds en entry for each folder or file to the directory by hashing the name and adding a directory
+ * entry node to the conflict resolution list for that entry. If the entry is NULL, the new node will be
+ * the only element of that list.
+ *
+ * The function sets the current working directory to refer to the block holding the root of the volume. This will
+ * be changed as the user navigates the file system hierarchy.
+ *
+ * Before that, the checksums of the allocated folder, file and index blocks are verified; if any of them does not
+ * match, the volume is not mounted and SIMFS_READ_ERROR is returned.
+ *
+ * The options select the access time policy and the clock for timestamps; NULL selects relatime with the precise
+ * clock.
+ *
+ */
+SIMFS_ERROR simfsMountFileSystem(char *simfsFileName, SIMFS_MOUNT_OPTIONS_TYPE *options)
+{
+    return simfsMountStripedFileSystem(&simfsFileName, 1, options);
+}
+
+/*
+ * Works like simfsMountFileSystem for a volume striped across the given backing files, which are read in parallel.
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if a volume is mounted already, and SIMFS_READ_ERROR if the files are not all the
+ * members of one volume in the order they were created in.
+ */
+SIMFS_ERROR simfsMountStripedFileSystem(char **memberFileNames, int numberOfMembers, SIMFS_MOUNT_OPTIONS_TYPE *options)
+{
+    if (simfsContext != NULL)
+        return SIMFS_DUPLICATE_ERROR;
+
+    SIMFS_ERROR error = simfsAllocateMount(options);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+    if (options != NULL)
+        simfsContext->options = *options;
+
+    error = simfsTransferVolume(memberFileNames, numberOfMembers, 0);
+
+    // the folder, file and index blocks are verified now; data blocks are verified when they are read
+    simfsCrc32cInit();
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS && error == SIMFS_NO_ERROR; i++)
+        if ((simfsVolume->bitvector[i / 8] & (0x80 >> (i % 8))) && simfsVolume->block[i].type != DATA_CONTENT_TYPE &&
+            !simfsChecksumValid(i))
+            error = SIMFS_READ_ERROR;
+
+    if (error != SIMFS_NO_ERROR) {
+        simfsReleaseVolume();
+        return error;
+    }
+
+    // the names are kept for simfsSyncFileSystem
+    SIMFS_OFFSET_TYPE *names = simfsArenaAllocate(&simfsContext->arena, numberOfMembers * sizeof(SIMFS_OFFSET_TYPE));
+    for (int m = 0; m < numberOfMembers && names != NULL; m++) {
+        char *name = simfsArenaAllocate(&simfsContext->arena, strlen(memberFileNames[m]) + 1);
+        if (name == NULL)
+            names = NULL;
+        else {
+            strcpy(name, memberFileNames[m]);
+            names[m] = simfsOffset(name);
+        }
+    }
+    if (names != NULL) {
+        simfsContext->memberFileNames = simfsOffset(names);
+        simfsContext->numberOfMembers = numberOfMembers;
+    }
+
+    AddFolderToContext(simfsVolume->block[simfsVolume->superblock.rootNodeIndex], simfsContext);
+
+    memcpy(simfsContext->bitvector, simfsVolume->bitvector, sizeof(simfsVolume->bitvector));
+
+    simfsBuildFingerprintIndex();
+
+    if (simfsShared != NULL)
+        memcpy(simfsShared->magic, SIMFS_SHARED_MAGIC, sizeof(simfsShared->magic));
+
+    return SIMFS_NO_ERROR;
+
+    // TODO: complete
+
+}
+
+/*
+ * Stores the appends still buffered for all open files.
+ */
+static void simfsFlushOpenFiles()
+{
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES; i++)
+        if (simfsContext->globalOpenFileTable[i].referenceCount > 0)
+            simfsFlushBuffer(&simfsContext->globalOpenFileTable[i], 0);
+}
+
+/*
+ * Stores the appends still buffered for open files, seals the volume with the next generation, and saves it to the
+ * given backing files.
+ */
+static SIMFS_ERROR simfsSaveVolume(char **memberFileNames, int numberOfMembers)
+{
+    simfsFlushOpenFiles();
+
+    simfsSealChecksums(simfsVolume->superblock.generation + 1);
+
+    return simfsTransferVolume(memberFileNames, numberOfMembers, 1);
+}
+
+/*
+ * Saves the mounted volume to the backing files it was mounted from, which are written in parallel, and keeps it
+ * mounted. Appends still buffered for open files are stored first.
+ */
+static SIMFS_ERROR simfsDoSyncFileSystem()
+{
+    if (simfsContext->numberOfMembers == 0)
+        return SIMFS_ALLOC_ERROR; // the names could not be kept on mounting
+
+    char **memberFileNames = malloc(simfsContext->numberOfMembers * sizeof(char *));
+    if (memberFileNames == NULL)
+        return SIMFS_ALLOC_ERROR;
+
+    SIMFS_OFFSET_TYPE *names = simfsPointer(simfsContext->memberFileNames);
+    for (int m = 0; m < simfsContext->numberOfMembers; m++)
+        memberFileNames[m] = simfsPointer(names[m]);
+
+    SIMFS_ERROR error = simfsSaveVolume(memberFileNames, simfsContext->numberOfMembers);
+    free(memberFileNames);
+
+    return error;
+}
+
+/*
+ * Saves the file system to a disk and de-allocates the memory.
+ *
+ * Assumes that all synchronization has been done. Appends still buffered for open files are stored before the
+ * volume is saved. All memory of the context is released, including the read buffers that were not released yet.
+ *
+ */
+SIMFS_ERROR simfsUmountFileSystem(char *simfsFileName)
+{
+    return simfsUmountStripedFileSystem(&simfsFileName, 1);
+}
+
+/*
+ * Works like simfsUmountFileSystem, but stripes the volume across the given backing files, which are written in
+ * parallel. The number of files may differ from the number the volume was mounted from.
+ *
+ * If the volume cannot be saved, it stays mounted and the error is returned.
+ */
+SIMFS_ERROR simfsUmountStripedFileSystem(char **memberFileNames, int numberOfMembers)
+{
+    simfsLockMount();
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    if (simfsShared != NULL && simfsShared->attachedProcesses > 1)
+        error = SIMFS_NOT_EMPTY_ERROR;
+    else
+        error = simfsSaveVolume(memberFileNames, numberOfMembers);
+
+    // no process can attach once the magic is gone
+    if (error == SIMFS_NO_ERROR && simfsShared != NULL)
+        memset(simfsShared->magic, 0, sizeof(simfsShared->magic));
+
+    simfsUnlockMount();
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    simfsReleaseVolume();
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Depending on the type parameter the function creates a file or a folder with the given path (see simfs.h), so a
+ * plain name creates it in the current directory of the process. If the process does not have an entry in the
+ * processControlBlock, then the root directory is assumed to be its current working directory.
+ *
+ * Hashes the leaf name with the folder that holds it and check if the file with such name already exists in the
+ * in-memory directory. If it is then it return SIMFS_DUPLICATE_ERROR. If the folder is not writable (e.g., it is in
+ * a snapshot), it returns SIMFS_ACCESS_ERROR.
+ * Otherwise:
+ *    - finds an available block in the storage using the in-memory bitvector and flips the bit to indicate
+ *      that the block is taken
+ *    - initializes a local buffer for the file descriptor block with the block type depending on the parameter type
+ *      (i.e., folder or file)
+ *    - creates an entry in the conflict resolution list for the corresponding in-memory directory entry
+ *    - copies the local buffer to the disk block that was found to be free
+ *    - links the block into the first unused slot of the index blocks of the folder
+ *    - copies the in-memory bitvector to the bitevector blocks on the simulated disk
+ *
+ *  The access rights and the the owner are taken from the context (umask and uid correspondingly).
+ *
+ */
+static SIMFS_ERROR simfsDoCreateFile(char *fileName, SIMFS_CONTENT_TYPE type)
+{
+    SIMFS_NAME_TYPE leaf;
+	SIMFS_INDEX_TYPE curr_index = simfsResolvePath(fileName, leaf);
+
+    if(curr_index == SIMFS_INVALID_INDEX)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_BLOCK_TYPE *curr_block = &simfsVolume->block[curr_index];
+
+    if(curr_block->type != FOLDER_CONTENT_TYPE){
+    	printf("Current Directory is not a Folder\n");
+    	return SIMFS_NOT_FOUND_ERROR;
+    }
+    
+    if(simfsVolume->block[curr_block->content.fileDescriptor.block_ref].type != INDEX_CONTENT_TYPE){
+    	printf("CurrentDirectory does not point to Index Block\n");
+    	return SIMFS_NOT_FOUND_ERROR;
+    }
+
+    if(type != FOLDER_CONTENT_TYPE && type != FILE_CONTENT_TYPE)
+    	return SIMFS_ACCESS_ERROR;
+
+    if(!(curr_block->content.fileDescriptor.accessRights & 0200))
+    	return SIMFS_ACCESS_ERROR;
+
+    if(simfsDirectoryFind(simfsContext, curr_index, leaf) != SIMFS_INVALID_INDEX){
+		//duplicate found
+		return SIMFS_DUPLICATE_ERROR;
+	}
+
+	//the descriptor, the index block of a folder, and maybe one more index block for the current folder
+	if(simfsCountFreeBlocks() < 3)
+		return SIMFS_ALLOC_ERROR;
+
+	//got here with no errors, so now set up actual file
+
+	SIMFS_USAGE_TYPE folderUsage, none;
+	simfsOwnUsage(curr_index, &folderUsage);
+	memset(&none, 0, sizeof(SIMFS_USAGE_TYPE));
+
+	SIMFS_INDEX_TYPE node = simfsAllocateBlock(type);
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+
+	fd->type = type;
+	strcpy(fd->name, leaf);
+	fd->parent = curr_index;
+
+	if(type == FOLDER_CONTENT_TYPE)
+		fd->block_ref = simfsAllocateBlock(INDEX_CONTENT_TYPE);
+	else
+		fd->block_ref = SIMFS_INVALID_INDEX; //files get their index block with the first content
+
+	//link the new node into the first unused slot of the current folder; the chain grows as needed
+	SIMFS_INDEX_TYPE *slot;
+	for(unsigned int i = 0; *(slot = simfsIndexSlot(&curr_block->content.fileDescriptor.block_ref, i, 1)) != 0; i++)
+		;
+	*slot = node;
+
+	fd->accessRights = curr_block->content.fileDescriptor.accessRights;
+    fd->owner = curr_block->content.fileDescriptor.owner; // arbitrarily simulated
+    curr_block->content.fileDescriptor.size++;
+
+    time_t now = simfsNow();
+    fd->creationTime = now;
+    fd->lastAccessTime = now;
+    fd->lastModificationTime = now;
+
+    //the new node and maybe a new index block of the folder count for the folders above
+    simfsTrackUsage(node, &none);
+    simfsTrackUsage(curr_index, &folderUsage);
+
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return simfsDirectoryInsert(simfsContext, node);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Deletes a file from the file system.
+ *
+ * Resolves the path in the directory. If the file is not there, then it returns SIMFS_NOT_FOUND_ERROR.
+ * Otherwise:
+ *    - finds the reference to the file descriptor block
+ *    - if the referenced block is a folder that is not empty, then returns SIMFS_NOT_EMPTY_ERROR.
+ *    - Otherwise:
+ *       - checks if the process owner can delete this file or folder, and that no process has it open (its
+ *         entry in the global open file table may hold appended bytes still to be stored); if not, it returns
+ *         SIMFS_ACCESS_ERROR.
+ *       - Otherwise:
+ *          - frees all blocks belonging to the file by flipping the corresponding bits in the in-memory bitvector
+ *          - frees the reference block by flipping the corresponding bit in the in-memory bitvector
+ *          - clears the entry in the folder by removing the corresponding node in the list associated with
+ *            the slot for this file
+ *          - copies the in-memory bitvector to the bitvector blocks on the simulated disk
+ */
+static SIMFS_ERROR simfsDoDeleteFile(char *fileName)
+{
+    //printf("Deleting: %s\n", fileName);
+    SIMFS_INDEX_TYPE node = simfsResolvePath(fileName, NULL);
+    if(node == SIMFS_INVALID_INDEX){
+    	//nothing hashed there, nothing to delete
+    	return SIMFS_NOT_FOUND_ERROR;
+    }
+
+
+    //getting here means the file exists
+    SIMFS_BLOCK_TYPE *curr_block = &simfsVolume->block[node];
+
+    if(curr_block->content.fileDescriptor.type == FOLDER_CONTENT_TYPE){
+    	if(curr_block->content.fileDescriptor.size > 0){
+    		return SIMFS_NOT_EMPTY_ERROR;
+    	}
+    }
+
+    //USE BIT MANIPULATION TO CHECK FOR OWNER
+    //U:rwxG:rwxO:rwx
+    //022 -> 000 000 001 
+    //an open file keeps its descriptor; buffered appends are stored through it later
+    if(simfsFindGlobalEntry(node) != NULL)
+    	return SIMFS_ACCESS_ERROR;
+
+    if(curr_block->content.fileDescriptor.accessRights&0001){
+    	//if the accessRight's owner execute bit is 1, then the owner can delete files
+    	SIMFS_INDEX_TYPE parent = curr_block->content.fileDescriptor.parent;
+    	if(parent == SIMFS_INVALID_INDEX)
+    		return SIMFS_ACCESS_ERROR; //the root of the volume or of a snapshot
+
+    	//clear the slot in the parent folder
+    	SIMFS_INDEX_TYPE *slot;
+    	for(unsigned int i = 0; (slot = simfsIndexSlot(&simfsVolume->block[parent].content.fileDescriptor.block_ref, i, 0)) != NULL; i++)
+    		if(*slot == node){
+    			*slot = 0;
+    			simfsVolume->block[parent].content.fileDescriptor.size--;
+    			break;
+    		}
+
+    	//the folders above lose what the node held
+    	simfsAddUsage(parent, &curr_block->content.fileDescriptor.usage, -1);
+
+    	//free all the blocks in the file; blocks shared with snapshots only lose a reference
+    	simfsTruncateChain(&curr_block->content.fileDescriptor.block_ref, 0);
+    	simfsDirectoryRemove(simfsContext, node);
+    	simfsReleaseBlock(node);
+    	memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+    }
+    else{
+    	return SIMFS_ACCESS_ERROR;
+    }
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Moves a file or a folder to a new path, which may be in another folder and may have another leaf name.
+ *
+ * Only the descriptor of the node changes: its leaf name and parent are set, and it is moved from a slot of the old
+ * folder to the first unused slot of the new one. Since descriptors do not hold paths, the descendants of a folder
+ * move with it untouched, and open handles stay valid. The only walk is along the parent chain of the new folder,
+ * to make sure a folder is not moved into its own subtree.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if oldName does not exist or the folder of newName does not, SIMFS_DUPLICATE_ERROR
+ * if newName exists, SIMFS_ACCESS_ERROR if the node is a root, if either folder is not writable, or if the new
+ * folder is inside the node, and SIMFS_ALLOC_ERROR if the new folder needs another index block and none is free.
+ */
+static SIMFS_ERROR simfsDoRename(char *oldName, char *newName)
+{
+    SIMFS_INDEX_TYPE node = simfsResolvePath(oldName, NULL);
+    if (node == SIMFS_INVALID_INDEX)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_NAME_TYPE leaf;
+    SIMFS_INDEX_TYPE newParent = simfsResolvePath(newName, leaf);
+    if (newParent == SIMFS_INVALID_INDEX || simfsVolume->block[newParent].type != FOLDER_CONTENT_TYPE)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+    SIMFS_INDEX_TYPE oldParent = fd->parent;
+    if (oldParent == SIMFS_INVALID_INDEX)
+        return SIMFS_ACCESS_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *oldFolder = &simfsVolume->block[oldParent].content.fileDescriptor;
+    SIMFS_FILE_DESCRIPTOR_TYPE *newFolder = &simfsVolume->block[newParent].content.fileDescriptor;
+    if (!(oldFolder->accessRights & 0200) || !(newFolder->accessRights & 0200))
+        return SIMFS_ACCESS_ERROR;
+
+    SIMFS_INDEX_TYPE existing = simfsDirectoryFind(simfsContext, newParent, leaf);
+    if (existing == node)
+        return SIMFS_NO_ERROR;
+    if (existing != SIMFS_INVALID_INDEX)
+        return SIMFS_DUPLICATE_ERROR;
+
+    for (SIMFS_INDEX_TYPE ancestor = newParent; ancestor != SIMFS_INVALID_INDEX;
+         ancestor = simfsVolume->block[ancestor].content.fileDescriptor.parent)
+        if (ancestor == node)
+            return SIMFS_ACCESS_ERROR;
+
+    if (newParent != oldParent) {
+        SIMFS_USAGE_TYPE folderUsage;
+        simfsOwnUsage(newParent, &folderUsage);
+
+        // link into the new folder first, since that may need a new index block
+        SIMFS_INDEX_TYPE *slot;
+        for (unsigned int i = 0; (slot = simfsIndexSlot(&newFolder->block_ref, i, 1)) != NULL && *slot != 0; i++)
+            ;
+        if (slot == NULL)
+            return SIMFS_ALLOC_ERROR;
+        *slot = node;
+        newFolder->size++;
+
+        for (unsigned int i = 0; (slot = simfsIndexSlot(&oldFolder->block_ref, i, 0)) != NULL; i++)
+            if (*slot == node) {
+                *slot = 0;
+                oldFolder->size--;
+                break;
+            }
+
+        // the usage of the subtree moves from the old folders above to the new ones
+        simfsAddUsage(oldParent, &fd->usage, -1);
+        simfsAddUsage(newParent, &fd->usage, 1);
+        simfsTrackUsage(newParent, &folderUsage);
+
+        memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+    }
+
+    // the entry is keyed by the parent and the leaf, so it is moved to its new slot in the directory
+    simfsDirectoryRemove(simfsContext, node);
+    strcpy(fd->name, leaf);
+    fd->parent = newParent;
+
+    time_t now = simfsNow();
+    oldFolder->lastModificationTime = now;
+    newFolder->lastModificationTime = now;
+
+    return simfsDirectoryInsert(simfsContext, node);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Finds the file in the in-memory directory and obtains the information about the file from the file descriptor
+ * block referenced from the directory.
+ *
+ * If the file is not found, then it returns SIMFS_NOT_FOUND_ERROR
+ */
+static SIMFS_ERROR simfsDoGetFileInfo(char *fileName, SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffer)
+{
+    SIMFS_INDEX_TYPE node = simfsResolvePath(fileName, NULL);
+
+    if(node == SIMFS_INVALID_INDEX)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    //the access is recorded according to the access time policy of the mount
+    simfsTouchAccessTime(&simfsVolume->block[node].content.fileDescriptor);
+
+    SIMFS_FILE_DESCRIPTOR_TYPE fd = simfsVolume->block[node].content.fileDescriptor;
+
+    infoBuffer->type = fd.type;
+    strcpy(infoBuffer->name, fd.name);
+    infoBuffer->parent = fd.parent;
+    infoBuffer->creationTime = fd.creationTime;
+    infoBuffer->lastAccessTime = fd.lastAccessTime;
+    infoBuffer->lastModificationTime = fd.lastModificationTime;
+    infoBuffer->owner = fd.owner;
+    infoBuffer->size = fd.size;
+    infoBuffer->reserved = fd.reserved;
+    infoBuffer->block_ref = fd.block_ref;
+    infoBuffer->usage = fd.usage;
+
+    //bytes appended through an open handle count even if they are still buffered
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsFindGlobalEntry(node);
+    if(entry != NULL)
+    	infoBuffer->size += entry->bufferedBytes;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Lists a page of the children of a folder, walking the index blocks of the folder from the slot in *cursor on.
+ *
+ * Up to capacity children are returned, their names through names, or their descriptors through infoBuffers
+ * (whichever is not NULL). The number returned goes through count, and *cursor is advanced past the last child
+ * returned, or set to SIMFS_DIRECTORY_END if the folder has no more children.
+ */
+static SIMFS_ERROR simfsListFolder(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor, SIMFS_NAME_TYPE *names,
+                                   SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffers, int capacity, int *count)
+{
+    *count = 0;
+
+    SIMFS_INDEX_TYPE node = simfsResolvePath(folderName, NULL);
+    if (node == SIMFS_INVALID_INDEX || simfsVolume->block[node].type != FOLDER_CONTENT_TYPE)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *folder = &simfsVolume->block[node].content.fileDescriptor;
+    if (!(folder->accessRights & 0400))
+        return SIMFS_ACCESS_ERROR;
+
+    if (*cursor == SIMFS_DIRECTORY_END)
+        return SIMFS_NO_ERROR;
+
+    simfsTouchAccessTime(folder);
+
+    SIMFS_SLOT_CURSOR_TYPE slots = { folder->block_ref, 0 };
+    unsigned int slot = *cursor;
+    unsigned int numberOfSlots = simfsCountIndexBlocks(folder->block_ref) * SIMFS_INDEX_ENTRIES_PER_BLOCK;
+
+    for (; slot < numberOfSlots && *count < capacity; slot++) {
+        SIMFS_INDEX_TYPE child = simfsSlotAt(&slots, slot);
+        if (child == 0)
+            continue;
+
+        SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[child].content.fileDescriptor;
+
+        if (names != NULL)
+            strcpy(names[*count], fd->name);
+
+        if (infoBuffers != NULL) {
+            infoBuffers[*count] = *fd;
+
+            //bytes appended through an open handle count even if they are still buffered
+            SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsFindGlobalEntry(child);
+            if (entry != NULL)
+                infoBuffers[*count].size += entry->bufferedBytes;
+        }
+
+        (*count)++;
+    }
+
+    // the next page starts with the next used slot, if there is any
+    while (slot < numberOfSlots && simfsSlotAt(&slots, slot) == 0)
+        slot++;
+    *cursor = slot < numberOfSlots ? slot : SIMFS_DIRECTORY_END;
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Lists the names of the children of a folder a page at a time.
+ *
+ * A listing starts with *cursor set to 0; every call returns up to capacity names through names and their number
+ * through count, and advances *cursor. When the last child has been returned, *cursor is SIMFS_DIRECTORY_END.
+ * Children created during the listing may or may not be listed; children that stay are listed exactly once.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if there is no folder at the path folderName ("/" is the root), and
+ * SIMFS_ACCESS_ERROR if the folder is not readable.
+ */
+static SIMFS_ERROR simfsDoReadDirectory(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor, SIMFS_NAME_TYPE *names,
+                                        int capacity, int *count)
+{
+    return simfsListFolder(folderName, cursor, names, NULL, capacity, count);
+}
+
+/*
+ * Works like simfsReadDirectory, but returns the descriptors of the children (as simfsGetFileInfo would) instead of
+ * their names, in the same walk over the index blocks of the folder.
+ */
+static SIMFS_ERROR simfsDoReadDirectoryPlus(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor,
+                                            SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffers, int capacity, int *count)
+{
+    return simfsListFolder(folderName, cursor, NULL, infoBuffers, capacity, count);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Resolves the path in the in-memory directory. If the file does not exist,
+ * the SIMFS_NOT_FOUND_ERROR is returned.
+ *
+ * Otherwise:
+ *    - checks the per-process open file table for the process, and if the file has already been opened
+ *      it returns the index of the openFileTable with the entry of the file through the parameter fileHandle, and
+ *      returns SIMFS_DUPLICATE_ERROR as the return value
+ *
+ *    - otherwise, checks if there is a global entry for the file, and if so, then:
+ *       - it increases the reference count for this file
+ *
+ *       - otherwise, it creates an entry in the global open file table for the file copying the information
+ *         from the file descriptor block referenced from the entry for this file in the directory
+ *
+*       - if the process does not have its process control block in the processControlBlocks list, then
+*         a file control block for the process is created and added to the list; the current working directory
+*         is initialized to the root of the volume and the number of the open files is initialized to 0
+*
+*       - if an entry for this file does not exits in the per-process open file table, the function finds an
+*         empty slot in the table and fills it with the information including the reference to the entry for
+*         this file in the global open file table.
+*
+*       - returns the index to the new element of the per-process open file table through the parameter fileHandle
+*         and SIMFS_NO_ERROR as the return value
+ *
+ * If there is no free slot for the file in either the global file table or in the per-process
+ * file table, or if there is any other allocation problem, then the function returns SIMFS_ALLOC_ERROR.
+ *
+ */
+static SIMFS_ERROR simfsDoOpenFile(char *fileName, SIMFS_FILE_HANDLE_TYPE *fileHandle)
+{
+    SIMFS_INDEX_TYPE node = simfsResolvePath(fileName, NULL);
+
+    if(node == SIMFS_INVALID_INDEX)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    pid_t pid = simfsCallerPid();
+    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsFindProcess(pid);
+
+    //check if the process has already opened the file, and keep track of the first free slot in its table
+    int per_pros_open_ind = -1;
+    if(process != NULL){
+    	for(int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS; i++){
+    		SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsPointer(process->openFileTable[i].globalEntry);
+    		if(entry == NULL){
+    			if(per_pros_open_ind < 0)
+    				per_pros_open_ind = i;
+    		}
+    		else if(entry->fileDescriptor == node){
+    			*fileHandle = i;
+    			return SIMFS_DUPLICATE_ERROR;
+    		}
+    	}
+    	if(per_pros_open_ind < 0)
+    		return SIMFS_ALLOC_ERROR;
+    }
+    else
+    	per_pros_open_ind = 0;
+
+    //find the global entry for the file, or a free one
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *global = simfsFindGlobalEntry(node);
+    SIMFS_BLOCK_TYPE *openBlock = &simfsVolume->block[node];
+
+    //update lastAccessTime according to the access time policy of the mount
+    simfsTouchAccessTime(&openBlock->content.fileDescriptor);
+
+    if(global == NULL){
+    	for(int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES && global == NULL; i++)
+    		if(simfsContext->globalOpenFileTable[i].referenceCount == 0)
+    			global = &simfsContext->globalOpenFileTable[i];
+
+    	if(global == NULL)
+    		return SIMFS_ALLOC_ERROR;
+
+    	global->type = openBlock->content.fileDescriptor.type;
+    	global->fileDescriptor = node;
+    	global->creationTime = openBlock->content.fileDescriptor.creationTime;
+    	global->lastAccessTime = openBlock->content.fileDescriptor.lastAccessTime;
+    	global->lastModificationTime = openBlock->content.fileDescriptor.lastModificationTime;
+    	global->accessRights = openBlock->content.fileDescriptor.accessRights;
+    	global->owner = openBlock->content.fileDescriptor.owner;
+    	global->size = openBlock->content.fileDescriptor.size;
+    	global->bufferedBytes = 0;
+    }
+
+    //create the process control block if this is the first file that the process opens
+    if(process == NULL){
+    	process = simfsPoolAllocate(&simfsContext->processControlBlockPool);
+    	if(process == NULL)
+    		return SIMFS_ALLOC_ERROR;
+
+    	memset(process, 0, sizeof(SIMFS_PROCESS_CONTROL_BLOCK_TYPE));
+    	process->pid = pid;
+    	process->currentWorkingDirectory = simfsVolume->superblock.rootNodeIndex;
+    	process->numberOfOpenFiles = 0;
+    	process->next = simfsContext->processControlBlocks;
+    	simfsContext->processControlBlocks = simfsOffset(process);
+    }
+
+    global->referenceCount++;
+
+    process->openFileTable[per_pros_open_ind].accessRights = openBlock->content.fileDescriptor.accessRights;
+    process->openFileTable[per_pros_open_ind].globalEntry = simfsOffset(global);
+    process->numberOfOpenFiles++;
+
+    *fileHandle = per_pros_open_ind;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * The function replaces content of a file with new one pointed to by the parameter writeBuffer.
+ *
+ * Checks if the file handle points to a valid file descriptor of an open file. If the entry is invalid
+ * (e.g., if the reference to the global table is NULL, or if the entry in the global table is INVALID_CONTENT_TYPE),
+ * or if the handle refers to a folder, then it returns SIMFS_NOT_FOUND_ERROR.
+ *
+ * Otherwise, it checks the access rights for writing. If the process owner is not allowed to write to the file,
+ * then the function returns SIMFS_ACCESS_ERROR.
+ *
+ * Then, the functions calculates the space needed for the new content and checks if the write buffer can fit into
+ * the remaining free space in the file system. If not, then the SIMFS_ALLOC_ERROR is returned.
+ *
+ * Otherwise, the function releases the blocks past the new end of the file, and then acquires new blocks as needed
+ * modifying bits in the in-memory bitvector as needed. Data blocks held only by this file are overwritten in place;
+ * data blocks that are shared with a snapshot are copied on write, i.e., the file gets a new block and the snapshot
+ * keeps the old one. If deduplication is enabled, blocks whose content already exists in the volume are shared
+ * with the existing block instead (see simfsStoreData).
+ *
+ * It then copies the characters pointed to by the parameter writeBuffer (until '\0' but excluding it) to the
+ * blocks that belong to the file. The function copies any modified block of the in-memory bitvector to
+ * the corresponding bitvector block on the disk.
+ *
+ * Finally, the file descriptor is modified to reflect the new size of the file, and the times of last modification
+ * and access.
+ *
+ * The function returns SIMFS_WRITE_ERROR in response to exception not specified earlier.
+ *
+ */
+static SIMFS_ERROR simfsDoWriteFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *writeBuffer)
+{
+	SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+	if(entry == NULL)
+		return SIMFS_NOT_FOUND_ERROR;
+
+	SIMFS_BLOCK_TYPE *write_block = &(simfsVolume->block[entry->fileDescriptor]);
+	if(write_block->type != FILE_CONTENT_TYPE)
+		return SIMFS_NOT_FOUND_ERROR; // the index chain of a folder holds its children
+
+    if(write_block->content.fileDescriptor.accessRights&0200){
+		//user CAN write
+		SIMFS_FILE_DESCRIPTOR_TYPE *fd = &write_block->content.fileDescriptor;
+
+		size_t length = strlen(writeBuffer);
+
+		//check if theres room for writeBuffer, and lay out the content (compressed if the volume is set so)
+		SIMFS_USAGE_TYPE before;
+		simfsOwnUsage(entry->fileDescriptor, &before);
+
+		simfsCleanSegmentsIfLow();
+		SIMFS_ERROR error = simfsReplaceContent(fd, writeBuffer, length);
+		simfsTrackUsage(entry->fileDescriptor, &before);
+		if(error != SIMFS_NO_ERROR){
+			memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+			return error;
+		}
+
+		//the new content replaces whatever was appended, too
+		entry->bufferedBytes = 0;
+		entry->size = length;
+
+		//copy in-memory bitvector to volume
+		memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+		//update lastModificationTime
+		fd->lastModificationTime = simfsNow();
+		entry->lastModificationTime = fd->lastModificationTime;
+
+		return SIMFS_NO_ERROR;
+	}
+	else
+		return SIMFS_ACCESS_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Appends the characters pointed to by the parameter appendBuffer (until '\0' but excluding it) to the end of
+ * a file.
+ *
+ * The handle and the access rights are checked as in simfsWriteFile. The characters are collected in the write
+ * buffer of the entry for the file in the global open file table, so all the processes that have the file open
+ * append to the same buffer. When the buffer is full, the bytes that complete blocks (for compressed files, chunks)
+ * are stored in the file; the partially filled tail stays buffered, so a sequence of small appends writes every
+ * block once instead of rewriting the last block on each call.
+ *
+ * The buffer is flushed when the file is read, when simfsFlushFile is called, and when the last handle for the
+ * file is closed. simfsWriteFile discards it, since the new content replaces the appended one.
+ *
+ * If the blocks cannot be allocated, the function returns SIMFS_ALLOC_ERROR and the bytes stay in the buffer.
+ */
+static SIMFS_ERROR simfsDoAppendFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *appendBuffer)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    if(!(simfsVolume->block[entry->fileDescriptor].content.fileDescriptor.accessRights&0200))
+    	return SIMFS_ACCESS_ERROR;
+
+    size_t length = strlen(appendBuffer);
+
+    while(length > 0){
+    	if(entry->bufferedBytes == SIMFS_WRITE_BUFFER_SIZE){
+    		SIMFS_ERROR error = simfsFlushBuffer(entry, 1);
+    		if(error != SIMFS_NO_ERROR)
+    			return error;
+    	}
+
+    	size_t count = SIMFS_WRITE_BUFFER_SIZE - entry->bufferedBytes;
+    	if(count > length)
+    		count = length;
+
+    	memcpy(entry->writeBuffer + entry->bufferedBytes, appendBuffer, count);
+    	entry->bufferedBytes += count;
+    	appendBuffer += count;
+    	length -= count;
+    }
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Stores all bytes appended to a file through simfsAppendFile in the blocks of the file.
+ */
+static SIMFS_ERROR simfsDoFlushFile(SIMFS_FILE_HANDLE_TYPE fileHandle)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    return simfsFlushBuffer(entry, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Preallocates space for a file that will grow to the given number of bytes, like fallocate(2) with
+ * FALLOC_FL_KEEP_SIZE: the size of the file does not change.
+ *
+ * The handle and the access rights are checked as in simfsWriteFile. The function allocates blocks for all slots
+ * that the content of the given size would use (with the layout of the file, or for an empty file without
+ * a reservation the compression setting of the volume) and that have no block yet. The blocks are taken from a single run of free blocks if the
+ * volume has one that is long enough, and from the longest runs otherwise, so the file is laid out contiguously.
+ * The blocks are allocated but unwritten: they are cleared, and the file descriptor records the reservation in
+ * its field reserved.
+ *
+ * Writes and appends up to the reserved size store the content in the reserved blocks in place, so they do not need
+ * the allocator; this holds in the deduplication mode and on a log-structured volume as well, and the file keeps
+ * its layout while it has a reservation, even if the compression setting of the volume changes. Rewriting the file with shorter content keeps the reserved blocks; they are released only when
+ * the file is deleted. Reserving less than the current reservation does nothing.
+ *
+ * If the volume does not have enough free blocks, nothing is allocated and SIMFS_ALLOC_ERROR is returned.
+ */
+static SIMFS_ERROR simfsDoReserve(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t bytes)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+    if(!(fd->accessRights&0200))
+    	return SIMFS_ACCESS_ERROR;
+
+    if(bytes <= fd->reserved)
+    	return SIMFS_NO_ERROR;
+
+    if(fd->size == 0 && fd->reserved == 0)
+    	fd->compression = simfsVolume->superblock.compression;
+
+    size_t previous = fd->reserved;
+    fd->reserved = bytes;
+    unsigned int slots = simfsReservedSlots(fd->reserved, fd->compression);
+
+    //count the missing blocks and index blocks
+    unsigned int blocksNeeded = 0;
+    SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+    for(unsigned int i = 0; i < slots; i++)
+    	if(simfsSlotAt(&cursor, i) == 0)
+    		blocksNeeded++;
+
+    unsigned int indexBlocks = simfsCountIndexBlocks(fd->block_ref);
+    unsigned int indexBlocksNeeded = (slots + SIMFS_INDEX_ENTRIES_PER_BLOCK - 1) / SIMFS_INDEX_ENTRIES_PER_BLOCK;
+    indexBlocksNeeded = indexBlocksNeeded > indexBlocks ? indexBlocksNeeded - indexBlocks : 0;
+
+    if(blocksNeeded + indexBlocksNeeded > simfsCountFreeBlocks()){
+    	fd->reserved = previous;
+    	return SIMFS_ALLOC_ERROR;
+    }
+
+    SIMFS_USAGE_TYPE before;
+    simfsOwnUsage(entry->fileDescriptor, &before);
+
+    //the index blocks go first, so that the data blocks can take one run
+    if(slots > 0 && simfsIndexSlot(&fd->block_ref, slots - 1, 1) == NULL){
+    	fd->reserved = previous;
+    	simfsTrackUsage(entry->fileDescriptor, &before);
+    	return SIMFS_ALLOC_ERROR;
+    }
+
+    unsigned int slot = 0;
+    while(blocksNeeded > 0){
+    	unsigned int runLength;
+    	SIMFS_INDEX_TYPE run = simfsFindFreeRun(blocksNeeded, &runLength);
+
+    	for(unsigned int i = 0; i < runLength; slot++){
+    		SIMFS_INDEX_TYPE *entrySlot = simfsIndexSlot(&fd->block_ref, slot, 0);
+    		if(*entrySlot != 0)
+    			continue;
+
+    		simfsClaimBlock(run + i, DATA_CONTENT_TYPE);
+    		*entrySlot = run + i;
+    		i++;
+    	}
+    	blocksNeeded -= runLength;
+    }
+
+    simfsTrackUsage(entry->fileDescriptor, &before);
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * The function returns the complete content of the file to the caller through the parameter readBuffer.
+ *
+ * Checks if the file handle points to a valid file descriptor of an open file. If the entry is invalid
+ * (e.g., if the reference to the global table is NULL, or if the entry in the global table is INVALID_CONTENT_TYPE),
+ * or if the handle refers to a folder, then it returns SIMFS_NOT_FOUND_ERROR.
+ *
+ * Otherwise, it checks the user's access right to read the file. If the process owner is not allowed to read the file,
+ * then the function returns SIMFS_ACCESS_ERROR.
+ *
+ * Otherwise, the function takes a buffer sufficient to hold the read content with an appended end of string
+ * character from the read buffer pool of the context; the pointer to the buffer is passed back through the readBuffer
+ * parameter. All the content of the blocks is concatenated using the buffer, and an end of string character is
+ * appended at the end of the concatenated content. The caller returns the buffer to the pool with
+ * simfsReleaseReadBuffer (not free); buffers that are not returned are released when the volume is unmounted.
+ *
+ * The function returns SIMFS_READ_ERROR in response to exception not specified earlier.
+ *
+ */
+static SIMFS_ERROR simfsDoReadFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char **readBuffer)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR; // the index chain of a folder holds its children
+
+    if(simfsVolume->block[entry->fileDescriptor].content.fileDescriptor.accessRights&0400){
+		//appended bytes must reach the blocks before they can be read back
+		SIMFS_ERROR error = simfsFlushBuffer(entry, 0);
+		if(error != SIMFS_NO_ERROR)
+			return error;
+
+		if(simfsTouchAccessTime(&simfsVolume->block[entry->fileDescriptor].content.fileDescriptor))
+			entry->lastAccessTime = simfsVolume->block[entry->fileDescriptor].content.fileDescriptor.lastAccessTime;
+
+		SIMFS_BLOCK_TYPE read_block = simfsVolume->block[entry->fileDescriptor];
+
+
+		//user CAN read
+		size_t size = read_block.content.fileDescriptor.size;
+
+		//take a buffer for the size of the data + one additional character from the pool
+		char *read = simfsAllocateReadBuffer(size + sizeof(char));
+		if(read == NULL)
+			return SIMFS_ALLOC_ERROR;
+
+		//concatenate the data blocks (decompressing the chunks of compressed files)
+		if(simfsReadRange(&read_block.content.fileDescriptor, 0, size, read) != SIMFS_NO_ERROR){
+			simfsReleaseReadBuffer(read);
+			return SIMFS_READ_ERROR;
+		}
+		read[size] = '\0';
+
+		//readBuffer needs to point to a char*
+		*readBuffer = read;
+
+		//printf("Message Read IN FUNCTION: %s\n", *readBuffer); //the first element in readBuffer, aka the char *
+
+		return SIMFS_NO_ERROR;
+	}
+	else
+		return SIMFS_ACCESS_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Returns a buffer obtained from simfsReadFile to the read buffer pool.
+ */
+void simfsReleaseReadBuffer(char *readBuffer)
+{
+    if (readBuffer == NULL)
+        return;
+
+    char *buffer = readBuffer - SIMFS_READ_BUFFER_HEADER;
+    int class = *(int *) buffer;
+
+    if (class < 0)
+        free(buffer);
+    else {
+        simfsLockMount();
+        simfsPoolRelease(&simfsContext->readBufferPool[class], buffer);
+        simfsUnlockMount();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copies up to length bytes of the content of a file starting at offset into the caller's buffer readBuffer,
+ * and returns the number of bytes copied through bytesRead (0 at or past the end of the file). No end of string
+ * character is appended.
+ *
+ * The handle is checked as in simfsReadFile. Only the blocks overlapping the range are read; for a compressed
+ * file, only the chunks overlapping the range are decompressed.
+ */
+static SIMFS_ERROR simfsDoReadFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, size_t length, char *readBuffer, size_t *bytesRead)
+{
+	SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+	if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+		return SIMFS_NOT_FOUND_ERROR;
+
+	SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+	if(!(fd->accessRights&0400))
+		return SIMFS_ACCESS_ERROR;
+
+	SIMFS_ERROR error = simfsFlushBuffer(entry, 0);
+	if(error != SIMFS_NO_ERROR)
+		return error;
+
+	*bytesRead = 0;
+	if(offset >= fd->size)
+		return SIMFS_NO_ERROR;
+
+	if(length > fd->size - offset)
+		length = fd->size - offset;
+
+	if(simfsReadRange(fd, offset, length, readBuffer) != SIMFS_NO_ERROR)
+		return SIMFS_READ_ERROR;
+
+	if(simfsTouchAccessTime(fd))
+		entry->lastAccessTime = fd->lastAccessTime;
+
+	*bytesRead = length;
+
+	return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Writes length bytes from the caller's buffer writeBuffer to a file at offset, like pwrite(2); the bytes may
+ * include '\0'. Writing past the end of the file leaves a hole between the end and offset.
+ *
+ * The handle and the access rights are checked as in simfsWriteFile. Bytes appended through simfsAppendFile are
+ * stored first. Only the blocks overlapping the range are written (for a compressed file, the chunks are decoded
+ * and encoded again), and a hole gets a block only when something is written into it.
+ *
+ * If the blocks cannot be allocated, the function returns SIMFS_ALLOC_ERROR and the content is unchanged.
+ */
+static SIMFS_ERROR simfsDoWriteFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, char *writeBuffer, size_t length)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+    if(!(fd->accessRights&0200))
+    	return SIMFS_ACCESS_ERROR;
+
+    SIMFS_ERROR error = simfsFlushBuffer(entry, 0);
+    if(error != SIMFS_NO_ERROR)
+    	return error;
+
+    SIMFS_USAGE_TYPE before;
+    simfsOwnUsage(entry->fileDescriptor, &before);
+
+    simfsCleanSegmentsIfLow();
+    error = simfsWriteRange(fd, offset, writeBuffer, length);
+    simfsTrackUsage(entry->fileDescriptor, &before);
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+    if(error != SIMFS_NO_ERROR)
+    	return error;
+
+    entry->size = fd->size;
+    fd->lastModificationTime = simfsNow();
+    entry->lastModificationTime = fd->lastModificationTime;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Sets the size of a file, like ftruncate(2): a file that grows gets a hole at its end, which takes no data
+ * blocks, and a file that shrinks releases the blocks past its new end (but not the ones reserved for it).
+ *
+ * The handle and the access rights are checked as in simfsWriteFile. Bytes appended through simfsAppendFile are
+ * stored first.
+ */
+static SIMFS_ERROR simfsDoTruncateFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t size)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+    if(!(fd->accessRights&0200))
+    	return SIMFS_ACCESS_ERROR;
+
+    SIMFS_ERROR error = simfsFlushBuffer(entry, 0);
+    if(error != SIMFS_NO_ERROR)
+    	return error;
+
+    SIMFS_USAGE_TYPE before;
+    simfsOwnUsage(entry->fileDescriptor, &before);
+
+    simfsCleanSegmentsIfLow();
+    error = simfsResizeContent(fd, size);
+    simfsTrackUsage(entry->fileDescriptor, &before);
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+    if(error != SIMFS_NO_ERROR)
+    	return error;
+
+    entry->size = fd->size;
+    fd->lastModificationTime = simfsNow();
+    entry->lastModificationTime = fd->lastModificationTime;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Finds the next data or hole in a file, like lseek(2) with SEEK_DATA or SEEK_HOLE, so that copying tools can skip
+ * the holes. The offset of the first byte at or after offset that is in a block (SIMFS_SEEK_DATA) or in a hole
+ * (SIMFS_SEEK_HOLE) is passed back through result; the end of the file counts as a hole.
+ *
+ * The handle is checked as in simfsReadFile. Only the index blocks of the file are read. The function returns
+ * SIMFS_NOT_FOUND_ERROR (like ENXIO) if offset is not within the file, or if there is no data at or after it.
+ */
+static SIMFS_ERROR simfsDoSeekFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, SIMFS_SEEK_TYPE whence, size_t *result)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL || simfsVolume->block[entry->fileDescriptor].type != FILE_CONTENT_TYPE)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_ERROR error = simfsFlushBuffer(entry, 0);
+    if(error != SIMFS_NO_ERROR)
+    	return error;
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[entry->fileDescriptor].content.fileDescriptor;
+    if(offset >= fd->size)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    size_t found = simfsSeekContent(fd, offset, whence == SIMFS_SEEK_DATA);
+    if(whence == SIMFS_SEEK_DATA && found == fd->size)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    *result = found;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Removes the entry for the file with the file handle provided as the parameter from the open file table
+ * for this process. It decreases the number of open files for in the process control block of this process, and
+ * if it becomes zero, then the process control block for this process is removed from the processControlBlocks list.
+ *
+ * Decreases the reference count in the global open file table, and if that number is 0, it also removes the entry
+ * for this file from the global open file table.
+ *
+ */
+
+static SIMFS_ERROR simfsDoCloseFile(SIMFS_FILE_HANDLE_TYPE fileHandle)
+{
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsGlobalEntry(fileHandle);
+
+    if(entry == NULL)
+    	return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsFindProcess(simfsCallerPid());
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    entry->referenceCount--;
+    if(entry->referenceCount == 0){
+    	//the last handle stores what is left in the write buffer; the file is closed even if that fails
+    	error = simfsFlushBuffer(entry, 0);
+    	entry->bufferedBytes = 0;
+    	entry->fileDescriptor = 0;
+    }
+
+    process->openFileTable[fileHandle].globalEntry = 0;
+    process->numberOfOpenFiles--;
+
+    if(process->numberOfOpenFiles == 0){
+    	SIMFS_OFFSET_TYPE *link = &simfsContext->processControlBlocks;
+    	while(simfsPointer(*link) != process)
+    		link = &((SIMFS_PROCESS_CONTROL_BLOCK_TYPE *) simfsPointer(*link))->next;
+    	*link = process->next;
+    	simfsPoolRelease(&simfsContext->processControlBlockPool, process);
+    }
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// snapshots
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Returns the slot of the snapshot with the given name in the snapshot table, or -1 if there is no such snapshot.
+ */
+static int simfsFindSnapshot(char *snapshotName)
+{
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_SNAPSHOTS; i++)
+        if (simfsVolume->snapshot[i].name[0] != '\0' && strcmp(simfsVolume->snapshot[i].name, snapshotName) == 0)
+            return i;
+
+    return -1;
+}
+
+/*
+ * Counts the folder, file, and index blocks of the subtree rooted at node, i.e., the blocks that a snapshot
+ * has to copy.
+ */
+static unsigned int simfsCountMetadataBlocks(SIMFS_INDEX_TYPE node)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+    unsigned int count = 1;
+
+    for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]) {
+        count++;
+        if (fd->type == FOLDER_CONTENT_TYPE)
+            for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++)
+                if (simfsVolume->block[indexBlock].content.index[i] != 0)
+                    count += simfsCountMetadataBlocks(simfsVolume->block[indexBlock].content.index[i]);
+    }
+
+    return count;
+}
+
+/*
+ * Returns 1 if a process has a file or folder of the subtree rooted at node open.
+ */
+static int simfsTreeIsOpen(SIMFS_INDEX_TYPE node)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+
+    if (simfsFindGlobalEntry(node) != NULL)
+        return 1;
+
+    if (fd->type == FOLDER_CONTENT_TYPE)
+        for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+             indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+            for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++)
+                if (simfsVolume->block[indexBlock].content.index[i] != 0 &&
+                    simfsTreeIsOpen(simfsVolume->block[indexBlock].content.index[i]))
+                    return 1;
+
+    return 0;
+}
+
+/*
+ * Copies the subtree rooted at node into the folder parent and returns the copy of node.
+ *
+ * Folders, files, and index blocks are copied, and the copies keep their leaf names. Data blocks are not copied;
+ * the copies of the index blocks share them with the original, so only their reference counts grow.
+ *
+ * The copies are read-only: the write bits and the bit that allows deletion (see simfsDeleteFile) are cleared.
+ */
+static SIMFS_INDEX_TYPE simfsCloneNode(SIMFS_INDEX_TYPE node, SIMFS_INDEX_TYPE parent)
+{
+    SIMFS_INDEX_TYPE copy = simfsAllocateBlock(simfsVolume->block[node].type);
+    simfsVolume->block[copy] = simfsVolume->block[node];
+
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[copy].content.fileDescriptor;
+    fd->parent = parent;
+    fd->accessRights &= ~(0222 | 0001);
+
+    SIMFS_INDEX_TYPE *link = &fd->block_ref;
+    for (SIMFS_INDEX_TYPE indexBlock = simfsVolume->block[node].content.fileDescriptor.block_ref;
+         indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]) {
+
+        SIMFS_INDEX_TYPE indexCopy = simfsAllocateBlock(INDEX_CONTENT_TYPE);
+        *link = indexCopy;
+
+        for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE entry = simfsVolume->block[indexBlock].content.index[i];
+            if (entry == 0)
+                continue;
+
+            if (fd->type == FOLDER_CONTENT_TYPE)
+                entry = simfsCloneNode(entry, copy);
+            else
+                simfsShareBlock(entry);
+            simfsVolume->block[indexCopy].content.index[i] = entry;
+        }
+
+        link = &simfsVolume->block[indexCopy].content.index[SIMFS_INDEX_SIZE - 1];
+    }
+
+    return copy;
+}
+
+/*
+ * Releases the subtree rooted at node; blocks shared with other trees only lose a reference.
+ */
+static void simfsReleaseTree(SIMFS_INDEX_TYPE node)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+
+    if (fd->type == FOLDER_CONTENT_TYPE)
+        for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+             indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+            for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++)
+                if (simfsVolume->block[indexBlock].content.index[i] != 0) {
+                    simfsReleaseTree(simfsVolume->block[indexBlock].content.index[i]);
+                    simfsVolume->block[indexBlock].content.index[i] = 0;
+                }
+
+    simfsTruncateChain(&fd->block_ref, 0);
+    simfsReleaseBlock(node);
+}
+
+/*
+ * Removes the entries for all descendants of a folder from the in-memory directory.
+ */
+static void simfsRemoveFolderFromContext(SIMFS_INDEX_TYPE folder, SIMFS_CONTEXT_TYPE *context)
+{
+    for (SIMFS_INDEX_TYPE indexBlock = simfsVolume->block[folder].content.fileDescriptor.block_ref;
+         indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE child = simfsVolume->block[indexBlock].content.index[i];
+            if (child == 0)
+                continue;
+
+            if (simfsVolume->block[child].content.fileDescriptor.type == FOLDER_CONTENT_TYPE)
+                simfsRemoveFolderFromContext(child, context);
+            simfsDirectoryRemove(context, child);
+        }
+}
+
+/*
+ * Takes a read-only snapshot of the whole volume under the given name.
+ *
+ * The snapshot gets its own copies of all folder, file, and index blocks, while all data blocks are shared with the
+ * live tree through their reference counts. The cost is thus proportional to the metadata of the volume and not to
+ * its content. Later writes to the live tree copy shared data blocks on write (see simfsWriteFile), so the snapshot
+ * keeps seeing the content from the time it was taken. Appends still buffered for open files are stored before
+ * the tree is copied, so the snapshot holds everything appended before it was taken.
+ *
+ * The copy of the root has no parent and is named after the snapshot with the prefix '@', which is how paths
+ * into the snapshot start (see simfsMountSnapshot).
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if a snapshot with that name exists, SIMFS_ACCESS_ERROR if the name is empty
+ * or contains '/', and SIMFS_ALLOC_ERROR if the snapshot table or the volume is full, or if the prefixed name
+ * would not fit into SIMFS_MAX_NAME_LENGTH characters.
+ */
+static SIMFS_ERROR simfsDoCreateSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    if (snapshotName[0] == '\0' || strchr(snapshotName, '/') != NULL)
+        return SIMFS_ACCESS_ERROR;
+
+    if (simfsFindSnapshot(snapshotName) >= 0)
+        return SIMFS_DUPLICATE_ERROR;
+
+    int slot = 0;
+    while (slot < SIMFS_MAX_NUMBER_OF_SNAPSHOTS && simfsVolume->snapshot[slot].name[0] != '\0')
+        slot++;
+    if (slot == SIMFS_MAX_NUMBER_OF_SNAPSHOTS)
+        return SIMFS_ALLOC_ERROR;
+
+    SIMFS_NAME_TYPE prefix;
+    if (snprintf(prefix, SIMFS_MAX_NAME_LENGTH, "@%s", snapshotName) >= SIMFS_MAX_NAME_LENGTH)
+        return SIMFS_ALLOC_ERROR;
+
+    // the snapshot shares the blocks the files point to, so appends still buffered must be in them first
+    simfsFlushOpenFiles();
+
+    if (simfsCountMetadataBlocks(simfsVolume->superblock.rootNodeIndex) > simfsCountFreeBlocks())
+        return SIMFS_ALLOC_ERROR;
+
+    SIMFS_INDEX_TYPE root = simfsCloneNode(simfsVolume->superblock.rootNodeIndex, SIMFS_INVALID_INDEX);
+    strcpy(simfsVolume->block[root].content.fileDescriptor.name, prefix);
+    simfsVolume->snapshot[slot].rootNodeIndex = root;
+    strcpy(simfsVolume->snapshot[slot].name, snapshotName);
+
+    simfsVolume->snapshot[slot].creationTime = simfsNow();
+
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return SIMFS_NO_ERROR;
+}
+
+static SIMFS_ERROR simfsDoUmountSnapshot(SIMFS_NAME_TYPE snapshotName);
+
+/*
+ * Deletes a snapshot (unmounting it first if needed) and releases its blocks.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if there is no such snapshot, and SIMFS_ACCESS_ERROR while a process has a file
+ * or folder of it open, as simfsDeleteFile does.
+ */
+static SIMFS_ERROR simfsDoDeleteSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    int slot = simfsFindSnapshot(snapshotName);
+    if (slot < 0)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    if (simfsTreeIsOpen(simfsVolume->snapshot[slot].rootNodeIndex))
+        return SIMFS_ACCESS_ERROR;
+
+    if (simfsContext->mountedSnapshots[slot])
+        simfsDoUmountSnapshot(snapshotName);
+
+    simfsReleaseTree(simfsVolume->snapshot[slot].rootNodeIndex);
+    memset(&simfsVolume->snapshot[slot], 0, sizeof(SIMFS_SNAPSHOT_TYPE));
+
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Adds the tree of a snapshot to the in-memory directory next to the live tree. The root of the snapshot is
+ * reachable as "@<snapshotName>/", and all files and folders in it under their original paths below it.
+ */
+static SIMFS_ERROR simfsDoMountSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    int slot = simfsFindSnapshot(snapshotName);
+    if (slot < 0)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    if (simfsContext->mountedSnapshots[slot])
+        return SIMFS_DUPLICATE_ERROR;
+
+    SIMFS_INDEX_TYPE root = simfsVolume->snapshot[slot].rootNodeIndex;
+    if (simfsDirectoryInsert(simfsContext, root) != SIMFS_NO_ERROR)
+        return SIMFS_ALLOC_ERROR;
+
+    simfsContext->mountedSnapshots[slot] = 1;
+
+    return AddFolderToContext(simfsVolume->block[root], simfsContext);
+}
+
+/*
+ * Removes the tree of a snapshot from the in-memory directory.
+ */
+static SIMFS_ERROR simfsDoUmountSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    int slot = simfsFindSnapshot(snapshotName);
+    if (slot < 0 || !simfsContext->mountedSnapshots[slot])
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_INDEX_TYPE root = simfsVolume->snapshot[slot].rootNodeIndex;
+    simfsRemoveFolderFromContext(root, simfsContext);
+    simfsDirectoryRemove(simfsContext, root);
+    simfsContext->mountedSnapshots[slot] = 0;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// deduplication, compression, and statistics
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Turns the deduplication mode of the mounted volume on or off; the setting is saved with the volume.
+ *
+ * When it is turned on, the fingerprint index is built from the data blocks already on the volume, so new content
+ * is also matched against older files. Turning it off keeps existing shared blocks shared.
+ */
+static SIMFS_ERROR simfsDoSetDeduplication(char enabled)
+{
+    simfsVolume->superblock.deduplication = enabled != 0;
+    simfsBuildFingerprintIndex();
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Selects the compression of the mounted volume (SIMFS_LZ_COMPRESSION to compress); the setting is saved with
+ * the volume.
+ *
+ * The setting applies to content written from now on. Every file records the compression of its content, so files
+ * written earlier stay readable and are converted by their next write.
+ */
+static SIMFS_ERROR simfsDoSetCompression(SIMFS_COMPRESSION_TYPE compression)
+{
+    if (compression != SIMFS_NO_COMPRESSION && compression != SIMFS_LZ_COMPRESSION)
+        return SIMFS_ACCESS_ERROR;
+
+    simfsVolume->superblock.compression = compression;
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Fills the statistics buffer with the usage of the mounted volume.
+ *
+ * The deduplication ratio is the number of references to data blocks divided by the number of allocated data
+ * blocks; it is 1.0 if nothing is shared. Data blocks shared between the live tree and snapshots count as well.
+ */
+static SIMFS_ERROR simfsDoGetStatistics(SIMFS_STATISTICS_TYPE *statistics)
+{
+    memset(statistics, 0, sizeof(SIMFS_STATISTICS_TYPE));
+
+    statistics->freeBlocks = simfsCountFreeBlocks();
+
+    for (int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->referenceCount[i] > 0 && simfsVolume->block[i].type == DATA_CONTENT_TYPE) {
+            statistics->physicalDataBlocks++;
+            statistics->logicalDataBlocks += simfsVolume->referenceCount[i];
+        }
+
+    statistics->deduplicationRatio = statistics->physicalDataBlocks == 0 ? 1.0 :
+        (double) statistics->logicalDataBlocks / statistics->physicalDataBlocks;
+
+    statistics->bytesWritten = simfsContext->bytesWritten;
+    statistics->bytesDeduplicated = simfsContext->bytesDeduplicated;
+    statistics->cleanSegments = simfsCountCleanSegments();
+    statistics->blocksCleaned = simfsContext->blocksCleaned;
+    statistics->generation = simfsVolume->superblock.generation;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// defragmentation
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Counts the extents of a file and the data blocks in them. Unused slots (e.g., the rest of a compressed chunk)
+ * are skipped, so they do not break an extent.
+ *
+ * If private is not NULL, it is set to zero if any of the data blocks is shared with another file or a snapshot.
+ */
+static unsigned int simfsCountExtents(SIMFS_INDEX_TYPE chainHead, unsigned int *dataBlocks, int *private)
+{
+    unsigned int extents = 0;
+    SIMFS_INDEX_TYPE previous = 0;
+
+    *dataBlocks = 0;
+    if (private != NULL)
+        *private = 1;
+
+    for (SIMFS_INDEX_TYPE indexBlock = chainHead; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsVolume->block[indexBlock].content.index[i];
+            if (blockIndex == 0)
+                continue;
+
+            if (previous == 0 || blockIndex != previous + 1)
+                extents++;
+            previous = blockIndex;
+
+            (*dataBlocks)++;
+            if (private != NULL && simfsVolume->referenceCount[blockIndex] > 1)
+                *private = 0;
+        }
+
+    return extents;
+}
+
+/*
+ * Moves the data blocks of a file into the run of free blocks starting at run, keeping their order.
+ *
+ * All blocks are copied first; then the slots are switched to the copies and the old blocks are released, so the
+ * file is readable at every step. The caller copies the in-memory bitvector to the volume.
+ *
+ * As in simfsMoveLiveBlock, the checksums are copied rather than computed, so a block that got corrupted is still
+ * detected by a scrub after it was moved.
+ */
+static void simfsRelocateFile(SIMFS_FILE_DESCRIPTOR_TYPE *fd, SIMFS_INDEX_TYPE run)
+{
+    SIMFS_INDEX_TYPE target = run;
+
+    for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE blockIndex = simfsVolume->block[indexBlock].content.index[i];
+            if (blockIndex == 0)
+                continue;
+
+            simfsClaimBlock(target, DATA_CONTENT_TYPE);
+            simfsVolume->block[target] = simfsVolume->block[blockIndex];
+            simfsVolume->checksum[target] = simfsVolume->checksum[blockIndex];
+            target++;
+        }
+
+    target = run;
+    unsigned int reservedSlots = simfsReservedSlots(fd->reserved, fd->compression), n = 0;
+    for (SIMFS_INDEX_TYPE indexBlock = fd->block_ref; indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++, n++) {
+            SIMFS_INDEX_TYPE *slot = &simfsVolume->block[indexBlock].content.index[i];
+            if (*slot == 0)
+                continue;
+
+            SIMFS_INDEX_TYPE old = *slot;
+            *slot = target;
+            if (simfsVolume->superblock.deduplication && n >= reservedSlots)
+                simfsRememberFingerprint(target); // reserved blocks stay out of the index (see simfsStoreData)
+            simfsReleaseBlock(old);
+            target++;
+        }
+}
+
+/*
+ * Reports the fragmentation of the files and of the free space on the volume.
+ */
+static SIMFS_ERROR simfsDoGetFragmentation(SIMFS_FRAGMENTATION_TYPE *fragmentation)
+{
+    memset(fragmentation, 0, sizeof(SIMFS_FRAGMENTATION_TYPE));
+
+    for (int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->referenceCount[i] > 0 && simfsVolume->block[i].type == FILE_CONTENT_TYPE) {
+            unsigned int dataBlocks;
+            unsigned int extents = simfsCountExtents(simfsVolume->block[i].content.fileDescriptor.block_ref, &dataBlocks, NULL);
+
+            fragmentation->files++;
+            fragmentation->dataBlocks += dataBlocks;
+            fragmentation->extents += extents;
+            if (extents > 1)
+                fragmentation->fragmentedFiles++;
+        }
+
+    unsigned int run = 0;
+    for (int i = 0; i <= SIMFS_NUMBER_OF_BLOCKS; i++) {
+        if (i < SIMFS_NUMBER_OF_BLOCKS && (simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) == 0) {
+            run++;
+            continue;
+        }
+
+        if (run > 0) {
+            fragmentation->freeExtents++;
+            if (run > fragmentation->largestFreeExtent)
+                fragmentation->largestFreeExtent = run;
+        }
+        run = 0;
+    }
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Runs one time slice of the online defragmenter.
+ *
+ * Starting where the previous slice stopped, the function looks for fragmented files and moves the data blocks of
+ * each into a run of free blocks that is long enough to hold them all (see simfsRelocateFile). The slice ends when
+ * blockBudget blocks have been moved, or when it has looked at every file once; a file that does not fit into
+ * the rest of the budget is left for the next slice, unless it is the first one in the slice. The number of
+ * blocks moved is passed back through blocksMoved; it is 0 when nothing more can be improved.
+ *
+ * Files whose data blocks are shared (with a snapshot, or through deduplication) are not moved, since the other
+ * references to the blocks would have to be changed, too. Index blocks stay where they are.
+ *
+ * Other operations can be called between the slices; the volume is consistent after each slice.
+ */
+static SIMFS_ERROR simfsDoDefragment(unsigned int blockBudget, unsigned int *blocksMoved)
+{
+    *blocksMoved = 0;
+
+    for (int n = 0; n < SIMFS_NUMBER_OF_BLOCKS; n++) {
+        SIMFS_INDEX_TYPE i = simfsContext->defragmentCursor;
+
+        if (simfsVolume->referenceCount[i] > 0 && simfsVolume->block[i].type == FILE_CONTENT_TYPE) {
+            SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[i].content.fileDescriptor;
+            unsigned int dataBlocks;
+            int private;
+
+            if (simfsCountExtents(fd->block_ref, &dataBlocks, &private) > 1 && private) {
+                if (*blocksMoved > 0 && *blocksMoved + dataBlocks > blockBudget)
+                    break; // the next slice starts with this file
+
+                unsigned int runLength;
+                SIMFS_INDEX_TYPE run = simfsFindFreeRun(dataBlocks, &runLength);
+                if (runLength == dataBlocks) {
+                    simfsRelocateFile(fd, run);
+                    *blocksMoved += dataBlocks;
+                }
+            }
+        }
+
+        simfsContext->defragmentCursor = (i + 1) % SIMFS_NUMBER_OF_BLOCKS;
+        if (*blocksMoved >= blockBudget)
+            break;
+    }
+
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// segment cleaning
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Maps every block referred to from an index chain to the entry that refers to it: the data blocks and the file
+ * descriptors in the slots, and the index blocks to the link of the previous index block (or to the block_ref of
+ * the file descriptor). A block with more than one reference is mapped to one of them.
+ */
+static void simfsMapReferences(SIMFS_INDEX_TYPE **reference)
+{
+    memset(reference, 0, SIMFS_NUMBER_OF_BLOCKS * sizeof(SIMFS_INDEX_TYPE *));
+
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++) {
+        if (simfsVolume->referenceCount[i] == 0 ||
+            (simfsVolume->block[i].type != FOLDER_CONTENT_TYPE && simfsVolume->block[i].type != FILE_CONTENT_TYPE))
+            continue;
+
+        SIMFS_INDEX_TYPE *link = &simfsVolume->block[i].content.fileDescriptor.block_ref;
+        while (*link != 0 && *link != SIMFS_INVALID_INDEX) {
+            SIMFS_INDEX_TYPE *entries = simfsVolume->block[*link].content.index;
+
+            reference[*link] = link;
+            for (unsigned int k = 0; k < SIMFS_INDEX_ENTRIES_PER_BLOCK; k++)
+                if (entries[k] != 0)
+                    reference[entries[k]] = &entries[k];
+
+            link = &entries[SIMFS_INDEX_SIZE - 1];
+        }
+    }
+}
+
+/*
+ * Returns non-zero if the cleaner can move all live blocks of a segment: they have to be data or index blocks
+ * with a single reference, which is known from the map of simfsMapReferences.
+ */
+static int simfsSegmentMovable(unsigned int segment, SIMFS_INDEX_TYPE **reference)
+{
+    for (SIMFS_INDEX_TYPE i = segment * SIMFS_SEGMENT_BLOCKS; i < (segment + 1) * SIMFS_SEGMENT_BLOCKS; i++) {
+        if ((simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) == 0)
+            continue;
+
+        if ((simfsVolume->block[i].type != DATA_CONTENT_TYPE && simfsVolume->block[i].type != INDEX_CONTENT_TYPE) ||
+            simfsVolume->referenceCount[i] != 1 || reference[i] == NULL)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Moves a live block to the head of the log and switches the entry referring to it over to the copy. The map of
+ * references is kept up to date, so the entries in a moved index block are found at their new place.
+ *
+ * The checksum is copied rather than computed, so a block that got corrupted is still detected by a scrub.
+ */
+static void simfsMoveLiveBlock(SIMFS_INDEX_TYPE blockIndex, SIMFS_INDEX_TYPE **reference)
+{
+    SIMFS_INDEX_TYPE target = simfsAllocateBlock(simfsVolume->block[blockIndex].type);
+
+    simfsVolume->block[target] = simfsVolume->block[blockIndex];
+    simfsVolume->checksum[target] = simfsVolume->checksum[blockIndex];
+
+    *reference[blockIndex] = target;
+    reference[target] = reference[blockIndex];
+
+    if (simfsVolume->block[target].type == INDEX_CONTENT_TYPE) {
+        SIMFS_INDEX_TYPE *entries = simfsVolume->block[target].content.index;
+        for (unsigned int k = 0; k < SIMFS_INDEX_SIZE; k++)
+            if (entries[k] != 0 && entries[k] != SIMFS_INVALID_INDEX)
+                reference[entries[k]] = &entries[k];
+    }
+    else if (simfsVolume->superblock.deduplication)
+        simfsRememberFingerprint(target);
+
+    simfsReleaseBlock(blockIndex);
+    simfsContext->blocksCleaned++;
+}
+
+/*
+ * Runs one time slice of the segment cleaner of a log-structured volume.
+ *
+ * The cleaner picks the segments with the fewest live blocks, up to SIMFS_CLEANER_MAX_UTILIZATION percent of
+ * a segment, and moves their live blocks to the head of the log; the segments are then clean, and the log continues
+ * in them later. The segment the log is filling is left alone. As for the defragmenter, the slice ends when
+ * blockBudget blocks have been moved, and a segment that does not fit into the rest of the budget is left for the
+ * next slice, unless it is the first one in the slice. The number of blocks moved is passed back through
+ * blocksMoved; it is 0 when no segment is worth cleaning, and always on volumes written in place.
+ *
+ * The index chains map the slots of the files to the latest location of their blocks, so a moved block only has
+ * to be switched over in the entry referring to it. File descriptors are referred to by their block number from
+ * everywhere, and shared blocks from several entries, so a segment holding any of these is not cleaned.
+ *
+ * Other operations can be called between the slices; the volume is consistent after each slice.
+ */
+static SIMFS_ERROR simfsDoCleanSegments(unsigned int blockBudget, unsigned int *blocksMoved)
+{
+    SIMFS_INDEX_TYPE *reference[SIMFS_NUMBER_OF_BLOCKS];
+    char considered[SIMFS_NUMBER_OF_SEGMENTS];
+    int mapped = 0;
+
+    *blocksMoved = 0;
+    if (simfsVolume->superblock.engine != SIMFS_LOG_STRUCTURED_ENGINE)
+        return SIMFS_NO_ERROR;
+
+    memset(considered, 0, sizeof(considered));
+
+    while (*blocksMoved < blockBudget) {
+        int open = simfsContext->logHead % SIMFS_SEGMENT_BLOCKS != 0 ? simfsContext->logHead / SIMFS_SEGMENT_BLOCKS : -1;
+        int victim = -1;
+        unsigned int victimLive = 0;
+
+        for (int segment = 0; segment < SIMFS_NUMBER_OF_SEGMENTS; segment++) {
+            unsigned int live = simfsSegmentLiveBlocks(segment);
+
+            if (segment == open || considered[segment] || live == 0 ||
+                live * 100 > SIMFS_SEGMENT_BLOCKS * SIMFS_CLEANER_MAX_UTILIZATION)
+                continue;
+            if (victim < 0 || live < victimLive) {
+                victim = segment;
+                victimLive = live;
+            }
+        }
+
+        if (victim < 0 || (*blocksMoved > 0 && *blocksMoved + victimLive > blockBudget))
+            break;
+        considered[victim] = 1;
+
+        // the live blocks need free blocks outside of the segment
+        if (simfsCountFreeBlocks() < SIMFS_SEGMENT_BLOCKS)
+            break;
+
+        if (!mapped) {
+            simfsMapReferences(reference);
+            mapped = 1;
+        }
+        if (!simfsSegmentMovable(victim, reference))
+            continue;
+
+        // the free blocks of the segment are taken while it is cleaned, so no live block moves within it
+        SIMFS_INDEX_TYPE first = victim * SIMFS_SEGMENT_BLOCKS;
+        char wasFree[SIMFS_SEGMENT_BLOCKS];
+
+        for (SIMFS_INDEX_TYPE i = first; i < first + SIMFS_SEGMENT_BLOCKS; i++) {
+            wasFree[i - first] = (simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) == 0;
+            if (wasFree[i - first])
+                simfsSetBit((unsigned char *) simfsContext->bitvector, i);
+        }
+
+        for (SIMFS_INDEX_TYPE i = first; i < first + SIMFS_SEGMENT_BLOCKS; i++)
+            if (!wasFree[i - first]) {
+                simfsMoveLiveBlock(i, reference);
+                (*blocksMoved)++;
+            }
+
+        for (SIMFS_INDEX_TYPE i = first; i < first + SIMFS_SEGMENT_BLOCKS; i++)
+            if (wasFree[i - first])
+                simfsClearBit((unsigned char *) simfsContext->bitvector, i);
+    }
+
+    memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Runs a slice of the segment cleaner before a write to a log-structured volume when fewer than
+ * SIMFS_CLEANER_LOW_WATER segments are clean, so the cleaning is spread over the writes and the log finds clean
+ * segments ahead of it.
+ */
+static void simfsCleanSegmentsIfLow()
+{
+    unsigned int blocksMoved;
+
+    if (simfsVolume->superblock.engine == SIMFS_LOG_STRUCTURED_ENGINE &&
+        simfsCountCleanSegments() < SIMFS_CLEANER_LOW_WATER)
+        simfsDoCleanSegments(SIMFS_SEGMENT_BLOCKS, &blocksMoved);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// integrity
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Work of one scrub thread: verifies the checksums of the allocated data blocks first, first + stride, ...
+ */
+typedef struct simfs_scrub_slice_type {
+    pthread_t thread;
+    SIMFS_INDEX_TYPE first;
+    SIMFS_INDEX_TYPE stride;
+    unsigned int blocksVerified;
+    unsigned int checksumErrors;
+} SIMFS_SCRUB_SLICE_TYPE;
+
+static void *simfsScrubSlice(void *argument)
+{
+    SIMFS_SCRUB_SLICE_TYPE *slice = argument;
+
+    for (unsigned int i = slice->first; i < SIMFS_NUMBER_OF_BLOCKS; i += slice->stride)
+        if ((simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) && simfsVolume->block[i].type == DATA_CONTENT_TYPE) {
+            slice->blocksVerified++;
+            if (!simfsChecksumValid(i))
+                slice->checksumErrors++;
+        }
+
+    return NULL;
+}
+
+/*
+ * Counts the references to the blocks of the tree under node: the index blocks of its chain, and the blocks in
+ * their slots. Folders are descended into; a node that was visited already is not walked again, so a corrupted
+ * chain cannot loop forever.
+ */
+static void simfsCountReferences(SIMFS_INDEX_TYPE node, unsigned short *references, char *visited)
+{
+    if (visited[node])
+        return;
+    visited[node] = 1;
+
+    SIMFS_BLOCK_TYPE *block = &simfsVolume->block[node];
+    if (block->type != FOLDER_CONTENT_TYPE && block->type != FILE_CONTENT_TYPE)
+        return;
+
+    for (SIMFS_INDEX_TYPE indexBlock = block->content.fileDescriptor.block_ref;
+         indexBlock < SIMFS_NUMBER_OF_BLOCKS && indexBlock != 0 && !visited[indexBlock];
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1]) {
+        references[indexBlock]++;
+        visited[indexBlock] = 1;
+
+        for (unsigned int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK; i++) {
+            SIMFS_INDEX_TYPE entry = simfsVolume->block[indexBlock].content.index[i];
+            if (entry == 0 || entry >= SIMFS_NUMBER_OF_BLOCKS)
+                continue;
+
+            references[entry]++;
+            if (block->type == FOLDER_CONTENT_TYPE)
+                simfsCountReferences(entry, references, visited);
+        }
+    }
+}
+
+/*
+ * Scrubs the mounted volume.
+ *
+ * The checksums of all allocated data blocks are verified by numberOfThreads threads, each taking every
+ * numberOfThreads-th block. Meanwhile, the calling thread walks the tree from the root and from the roots of the
+ * snapshots, counting the references to every block, and cross-checks them with the in-memory bitvector and the
+ * reference counts. The findings are returned through the parameter scrub.
+ *
+ * Folder, file and index blocks change with almost every operation, so their checksums are verified when the
+ * volume is mounted rather than by the scrub.
+ *
+ * Returns SIMFS_READ_ERROR if anything was found, SIMFS_ALLOC_ERROR if the threads could not be started, and
+ * SIMFS_NO_ERROR otherwise.
+ */
+static SIMFS_ERROR simfsDoScrub(int numberOfThreads, SIMFS_SCRUB_TYPE *scrub)
+{
+    memset(scrub, 0, sizeof(SIMFS_SCRUB_TYPE));
+
+    if (numberOfThreads < 1)
+        numberOfThreads = 1;
+
+    SIMFS_SCRUB_SLICE_TYPE *slices = calloc(numberOfThreads, sizeof(SIMFS_SCRUB_SLICE_TYPE));
+    unsigned short *references = calloc(SIMFS_NUMBER_OF_BLOCKS, sizeof(unsigned short));
+    char *visited = calloc(SIMFS_NUMBER_OF_BLOCKS, 1);
+    if (slices == NULL || references == NULL || visited == NULL) {
+        free(slices);
+        free(references);
+        free(visited);
+        return SIMFS_ALLOC_ERROR;
+    }
+
+    int started = 0;
+    for (; started < numberOfThreads; started++) {
+        slices[started].first = started;
+        slices[started].stride = numberOfThreads;
+        if (pthread_create(&slices[started].thread, NULL, simfsScrubSlice, &slices[started]) != 0)
+            break;
+    }
+
+    references[simfsVolume->superblock.rootNodeIndex]++;
+    simfsCountReferences(simfsVolume->superblock.rootNodeIndex, references, visited);
+    for (int s = 0; s < SIMFS_MAX_NUMBER_OF_SNAPSHOTS; s++)
+        if (simfsVolume->snapshot[s].name[0] != '\0') {
+            references[simfsVolume->snapshot[s].rootNodeIndex]++;
+            simfsCountReferences(simfsVolume->snapshot[s].rootNodeIndex, references, visited);
+        }
+
+    for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++) {
+        int allocated = (simfsContext->bitvector[i / 8] & (0x80 >> (i % 8))) != 0;
+
+        if (references[i] == 0) {
+            if (allocated)
+                scrub->lostBlocks++;
+        }
+        else if (!allocated)
+            scrub->freeReachableBlocks++;
+        else if (references[i] != simfsVolume->referenceCount[i])
+            scrub->referenceCountErrors++;
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(slices[t].thread, NULL);
+        scrub->blocksVerified += slices[t].blocksVerified;
+        scrub->checksumErrors += slices[t].checksumErrors;
+    }
+
+    free(slices);
+    free(references);
+    free(visited);
+
+    if (started < numberOfThreads)
+        return SIMFS_ALLOC_ERROR;
+
+    if (scrub->checksumErrors + scrub->lostBlocks + scrub->freeReachableBlocks + scrub->referenceCountErrors > 0)
+        return SIMFS_READ_ERROR;
+
+    return SIMFS_NO_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The following functions are provided only for testing without FUSE.
+//
+// When linked to the FUSE library, both user ID and process ID can be obtained by calling fuse_get_context().
+// See: http://libfuse.github.io/doxygen/structfuse__context.html
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Simulates FUSE context to get values for user ID, process ID, and umask through fuse_context
+ *
+ * Like fuse_get_context(), it returns the context of the calling thread, which is overwritten by the next call
+ * in the same thread; the caller does not free it.
+ */
+
+struct fuse_context *simfs_debug_get_context() {
+
+    // TODO: replace its use with FUSE's fuse_get_context()
+
+    static __thread struct fuse_context threadContext;
+    struct fuse_context *context = &threadContext;
+
+    context->fuse = NULL;
+    context->uid = (uid_t) rand()%10+1;
+    context->pid = (pid_t) rand()%10+1;
+    context->gid = (gid_t) rand()%10+1;
+    context->private_data = NULL;
+    context->umask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH; // can be changed as needed
+
+    return context;
+}
+
+char *simfsGenerateContent(int size)
+{
+    size = (size <= 0 ? rand()%1000 : size); // arbitrarily chosen as an example
+
+    char *content = malloc(size);
+
+    int firstPrintable = ' ';
+    int len = '~' - firstPrintable;
+
+    for (int i=0; i<size-1; i++)
+        *(content+i) = firstPrintable + rand()%len;
+
+    content[size - 1] = '\0';
+    return content;
+}
+
+/*
+ * Generates text-like content (random words from a small vocabulary) for benchmarks.
+ */
+static char *simfsGenerateText(int size)
+{
+    static char *words[] = { "the", "file", "system", "block", "index", "folder", "data", "of", "and", "to",
+                             "config", "value", "true", "false", "name", "size", "=", "\n", "#", "log" };
+    char *content = malloc(size);
+
+    int length = 0;
+    while (length < size - 1) {
+        char *word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        for (int i = 0; word[i] != '\0' && length < size - 1; i++)
+            content[length++] = word[i];
+        if (length < size - 1)
+            content[length++] = ' ';
+    }
+
+    content[size - 1] = '\0';
+    return content;
+}
+
+/*
+ * Returns the number of bytes of the heap in use, or 0 where the C library does not tell.
+ */
+static size_t simfsHeapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Compares the compressed and uncompressed paths on the mounted volume.
+ *
+ * With each compression setting, text-like content of the given size is written to and read back from the file
+ * "simfs_benchmark" (created in the root folder and deleted afterwards) the given number of times. The throughput
+ * of both directions and the number of data blocks the file occupies are printed, followed by the growth of the
+ * heap and of the arena of the context during the benchmark; in the steady state, both stay flat. The compression
+ * setting of the volume is restored at the end.
+ */
+SIMFS_ERROR simfsBenchmarkCompression(int size, int iterations)
+{
+    SIMFS_COMPRESSION_TYPE compression[] = { SIMFS_NO_COMPRESSION, SIMFS_LZ_COMPRESSION };
+    char *label[] = { "none", "lz" };
+    SIMFS_COMPRESSION_TYPE savedCompression = (SIMFS_COMPRESSION_TYPE) simfsVolume->superblock.compression;
+
+    SIMFS_NAME_TYPE fileName = "simfs_benchmark";
+    SIMFS_NAME_TYPE path = "/simfs_benchmark/";
+
+    char *content = simfsGenerateText(size);
+    SIMFS_ERROR error = simfsCreateFile(fileName, FILE_CONTENT_TYPE);
+    if (error != SIMFS_NO_ERROR) {
+        free(content);
+        return error;
+    }
+
+    SIMFS_FILE_HANDLE_TYPE fileHandle;
+    error = simfsOpenFile(path, &fileHandle);
+    if (error != SIMFS_NO_ERROR) {
+        simfsDeleteFile(path);
+        free(content);
+        return error;
+    }
+
+    size_t heapBefore = simfsHeapInUse();
+    size_t arenaBefore = simfsContext->arena.bytesReserved;
+
+    printf("%-6s %12s %12s %8s %8s\n", "codec", "write MB/s", "read MB/s", "blocks", "ratio");
+
+    for (int c = 0; c < 2 && error == SIMFS_NO_ERROR; c++) {
+        error = simfsSetCompression(compression[c]);
+        if (error != SIMFS_NO_ERROR)
+            break;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < iterations && error == SIMFS_NO_ERROR; i++)
+            error = simfsWriteFile(fileHandle, content);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double writeSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        char *readBuffer = NULL;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < iterations && error == SIMFS_NO_ERROR; i++) {
+            error = simfsReadFile(fileHandle, &readBuffer);
+            if (error == SIMFS_NO_ERROR) {
+                if (strcmp(readBuffer, content) != 0)
+                    error = SIMFS_READ_ERROR;
+                simfsReleaseReadBuffer(readBuffer);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double readSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[simfsResolvePath(path, NULL)].content.fileDescriptor;
+        unsigned int blocks = 0;
+        SIMFS_SLOT_CURSOR_TYPE cursor = { fd->block_ref, 0 };
+        for (unsigned int slot = 0; slot < (unsigned int) size; slot++)
+            if (simfsSlotAt(&cursor, slot) != 0)
+                blocks++;
+
+        double megabytes = (double) (size - 1) * iterations / (1024 * 1024);
+        printf("%-6s %12.2f %12.2f %8u %8.2f\n", label[c], megabytes / writeSeconds, megabytes / readSeconds, blocks,
+               blocks == 0 ? 0.0 : (double) (size - 1) / (blocks * SIMFS_DATA_SIZE));
+    }
+
+    printf("heap growth %ld bytes, arena growth %ld bytes\n", (long) (simfsHeapInUse() - heapBefore),
+           (long) (simfsContext->arena.bytesReserved - arenaBefore));
+
+    simfsCloseFile(fileHandle);
+    simfsDeleteFile(path);
+    SIMFS_ERROR restoreError = simfsSetCompression(savedCompression);
+    if (error == SIMFS_NO_ERROR)
+        error = restoreError;
+    free(content);
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// shared mounts
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Attaches the calling process to a volume that another process mounted with the given sharedName in its options.
+ *
+ * The segment is mapped into the process, and the functions of the API then work on the shared volume directly,
+ * under the lock in the segment. The process gets its own process control block (with its own open files) when it
+ * opens its first file, just like any process of the mounting one.
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if the process has a volume mounted or attached already, SIMFS_NOT_FOUND_ERROR if
+ * no volume is mounted under the name, and SIMFS_READ_ERROR if the object is not a segment of a shared mount.
+ */
+SIMFS_ERROR simfsAttachSharedFileSystem(char *sharedName)
+{
+    if (simfsContext != NULL)
+        return SIMFS_DUPLICATE_ERROR;
+
+    int descriptor = shm_open(sharedName, O_RDWR, 0);
+    if (descriptor < 0)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    struct stat status;
+    SIMFS_SHARED_SEGMENT_TYPE *segment = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && status.st_size == sizeof(SIMFS_SHARED_SEGMENT_TYPE))
+        segment = mmap(NULL, sizeof(SIMFS_SHARED_SEGMENT_TYPE), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (segment == MAP_FAILED)
+        return SIMFS_READ_ERROR;
+
+    // the volume may be unmounted meanwhile; the magic tells under the lock
+    simfsShared = segment;
+    simfsLockMount();
+    int mounted = memcmp(segment->magic, SIMFS_SHARED_MAGIC, sizeof(segment->magic)) == 0;
+    if (mounted)
+        segment->attachedProcesses++;
+    simfsUnlockMount();
+
+    if (!mounted) {
+        munmap(segment, sizeof(SIMFS_SHARED_SEGMENT_TYPE));
+        simfsShared = NULL;
+        return SIMFS_NOT_FOUND_ERROR;
+    }
+
+    simfsContext = &segment->context;
+    simfsVolume = &segment->volume;
+    simfsCrc32cInit();
+
+    return SIMFS_NO_ERROR;
+}
+
+/*
+ * Detaches the calling process from a shared mount: the files it has open are closed (storing what is still
+ * buffered for them), and the segment is unmapped. Any attached process may detach, including the one that mounted
+ * the volume; the volume stays mounted until an attached process unmounts it.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if the process is not attached to a shared mount, or the first error of closing
+ * the files.
+ */
+SIMFS_ERROR simfsDetachSharedFileSystem()
+{
+    if (simfsShared == NULL)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    simfsLockMount();
+
+    // the process control block goes away with the last file closed
+    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *process = simfsFindProcess(simfsCallerPid());
+    int openFiles = process == NULL ? 0 : process->numberOfOpenFiles;
+    for (SIMFS_FILE_HANDLE_TYPE fileHandle = 0; openFiles > 0; fileHandle++)
+        if (process->openFileTable[fileHandle].globalEntry != 0) {
+            openFiles--;
+            SIMFS_ERROR closed = simfsDoCloseFile(fileHandle);
+            if (error == SIMFS_NO_ERROR)
+                error = closed;
+        }
+
+    simfsShared->attachedProcesses--;
+    simfsUnlockMount();
+
+    munmap(simfsShared, sizeof(SIMFS_SHARED_SEGMENT_TYPE));
+    simfsShared = NULL;
+    simfsContext = NULL;
+    simfsVolume = NULL;
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// bulk import and export
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * State of an import of a host tree into a new volume.
+ *
+ * Blocks are handed out in order from nextBlock instead of being looked up in the bitvector, so the volume is laid
+ * out in the order the host tree is walked: a folder's index blocks, the descriptors of its children, and for each
+ * file its index blocks and data blocks. The data blocks are filled afterwards by the reader pool.
+ */
+typedef struct simfs_import_file_type {
+    char *hostPath;
+    SIMFS_INDEX_TYPE node; // the file descriptor
+    SIMFS_INDEX_TYPE firstDataBlock; // the data blocks of a file are consecutive
+    unsigned int numberOfDataBlocks;
+} SIMFS_IMPORT_FILE_TYPE;
+
+typedef struct simfs_import_type {
+    unsigned int nextBlock;
+    SIMFS_IMPORT_FILE_TYPE *files;
+    unsigned int numberOfFiles;
+    unsigned int capacity;
+    unsigned int nextFile; // next file for the reader pool
+    SIMFS_ERROR error; // set by a reader that failed
+} SIMFS_IMPORT_TYPE;
+
+typedef struct simfs_host_entry_type {
+    SIMFS_NAME_TYPE name;
+    SIMFS_CONTENT_TYPE type;
+    size_t size;
+    time_t lastAccessTime;
+    time_t lastModificationTime;
+    SIMFS_INDEX_TYPE node; // the descriptor it gets in the volume
+} SIMFS_HOST_ENTRY_TYPE;
+
+static int simfsCompareHostEntries(const void *a, const void *b)
+{
+    return strcmp(((const SIMFS_HOST_ENTRY_TYPE *) a)->name, ((const SIMFS_HOST_ENTRY_TYPE *) b)->name);
+}
+
+static SIMFS_INDEX_TYPE simfsImportBlock(SIMFS_IMPORT_TYPE *import, SIMFS_CONTENT_TYPE type)
+{
+    if (import->nextBlock >= SIMFS_NUMBER_OF_BLOCKS)
+        return SIMFS_INVALID_INDEX;
+
+    simfsClaimBlock(import->nextBlock, type);
+
+    return import->nextBlock++;
+}
+
+/*
+ * Extends the chain starting at *chainHead with new index blocks until it has at least the given number of slots.
+ * Returns 0 if the volume is full.
+ */
+static int simfsImportChain(SIMFS_IMPORT_TYPE *import, SIMFS_INDEX_TYPE *chainHead, unsigned int slots)
+{
+    SIMFS_INDEX_TYPE *link = chainHead;
+
+    for (unsigned int covered = 0; covered < slots; covered += SIMFS_INDEX_ENTRIES_PER_BLOCK) {
+        if (*link == 0 || *link == SIMFS_INVALID_INDEX)
+            if ((*link = simfsImportBlock(import, INDEX_CONTENT_TYPE)) == SIMFS_INVALID_INDEX)
+                return 0;
+        link = &simfsVolume->block[*link].content.index[SIMFS_INDEX_SIZE - 1];
+    }
+
+    return 1;
+}
+
+/*
+ * Lists the regular files and folders in a host folder, sorted by name; other entries (e.g., symbolic links) are
+ * skipped. Returns SIMFS_ALLOC_ERROR if a name does not fit into SIMFS_NAME_TYPE.
+ */
+static SIMFS_ERROR simfsListHostFolder(char *hostPath, SIMFS_HOST_ENTRY_TYPE **entries, unsigned int *count)
+{
+    *entries = NULL;
+    *count = 0;
+
+    DIR *directory = opendir(hostPath);
+    if (directory == NULL)
+        return SIMFS_READ_ERROR;
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    unsigned int capacity = 0;
+    char path[PATH_MAX];
+
+    for (struct dirent *entry; error == SIMFS_NO_ERROR && (entry = readdir(directory)) != NULL;) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        struct stat status;
+        if (snprintf(path, PATH_MAX, "%s/%s", hostPath, entry->d_name) >= PATH_MAX || lstat(path, &status) != 0) {
+            error = SIMFS_READ_ERROR;
+            break;
+        }
+        if (!S_ISREG(status.st_mode) && !S_ISDIR(status.st_mode))
+            continue;
+        if (strlen(entry->d_name) >= SIMFS_MAX_NAME_LENGTH) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity = capacity == 0 ? 16 : 2 * capacity;
+            SIMFS_HOST_ENTRY_TYPE *grown = realloc(*entries, capacity * sizeof(SIMFS_HOST_ENTRY_TYPE));
+            if (grown == NULL) {
+                error = SIMFS_ALLOC_ERROR;
+                break;
+            }
+            *entries = grown;
+        }
+
+        SIMFS_HOST_ENTRY_TYPE *hostEntry = &(*entries)[(*count)++];
+        strcpy(hostEntry->name, entry->d_name);
+        hostEntry->type = S_ISDIR(status.st_mode) ? FOLDER_CONTENT_TYPE : FILE_CONTENT_TYPE;
+        hostEntry->size = S_ISDIR(status.st_mode) ? 0 : status.st_size;
+        hostEntry->lastAccessTime = status.st_atime;
+        hostEntry->lastModificationTime = status.st_mtime;
+    }
+
+    closedir(directory);
+
+    if (error == SIMFS_NO_ERROR && *count > 1)
+        qsort(*entries, *count, sizeof(SIMFS_HOST_ENTRY_TYPE), simfsCompareHostEntries);
+
+    return error;
+}
+
+/*
+ * Lays out the subtree of a host folder below the given folder of the volume, depth first. The files are queued
+ * for the reader pool with the data blocks they got.
+ */
+static SIMFS_ERROR simfsImportFolder(SIMFS_IMPORT_TYPE *import, char *hostPath, SIMFS_INDEX_TYPE folder)
+{
+    SIMFS_HOST_ENTRY_TYPE *entries;
+    unsigned int count;
+    SIMFS_ERROR error = simfsListHostFolder(hostPath, &entries, &count);
+
+    // a folder always has an index block (see simfsCreateFile)
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[folder].content.fileDescriptor;
+    if (error == SIMFS_NO_ERROR && !simfsImportChain(import, &fd->block_ref, count > 0 ? count : 1))
+        error = SIMFS_ALLOC_ERROR;
+
+    time_t now = simfsNow();
+    SIMFS_INDEX_TYPE slotBlock = fd->block_ref;
+    char path[PATH_MAX];
+
+    for (unsigned int i = 0; i < count && error == SIMFS_NO_ERROR; i++) {
+        SIMFS_INDEX_TYPE node = simfsImportBlock(import, entries[i].type);
+        if (node == SIMFS_INVALID_INDEX) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+
+        SIMFS_FILE_DESCRIPTOR_TYPE *child = &simfsVolume->block[node].content.fileDescriptor;
+        child->type = entries[i].type;
+        strcpy(child->name, entries[i].name);
+        child->parent = folder;
+        child->accessRights = fd->accessRights;
+        child->owner = fd->owner;
+        child->creationTime = now;
+        child->lastAccessTime = entries[i].lastAccessTime;
+        child->lastModificationTime = entries[i].lastModificationTime;
+        child->block_ref = SIMFS_INVALID_INDEX;
+
+        if (i > 0 && i % SIMFS_INDEX_ENTRIES_PER_BLOCK == 0)
+            slotBlock = simfsVolume->block[slotBlock].content.index[SIMFS_INDEX_SIZE - 1];
+        simfsVolume->block[slotBlock].content.index[i % SIMFS_INDEX_ENTRIES_PER_BLOCK] = node;
+        fd->size++;
+        entries[i].node = node;
+
+        if (entries[i].type != FILE_CONTENT_TYPE || entries[i].size == 0)
+            continue;
+
+        unsigned int numberOfDataBlocks = (entries[i].size + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+        if (entries[i].size > SIMFS_NUMBER_OF_BLOCKS * SIMFS_DATA_SIZE ||
+            !simfsImportChain(import, &child->block_ref, numberOfDataBlocks) ||
+            import->nextBlock + numberOfDataBlocks > SIMFS_NUMBER_OF_BLOCKS) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+        child->size = entries[i].size;
+
+        if (import->numberOfFiles == import->capacity) {
+            unsigned int capacity = import->capacity == 0 ? 64 : 2 * import->capacity;
+            SIMFS_IMPORT_FILE_TYPE *grown = realloc(import->files, capacity * sizeof(SIMFS_IMPORT_FILE_TYPE));
+            if (grown == NULL) {
+                error = SIMFS_ALLOC_ERROR;
+                break;
+            }
+            import->files = grown;
+            import->capacity = capacity;
+        }
+
+        SIMFS_IMPORT_FILE_TYPE *file = &import->files[import->numberOfFiles];
+        snprintf(path, PATH_MAX, "%s/%s", hostPath, entries[i].name);
+        if ((file->hostPath = strdup(path)) == NULL) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+        file->node = node;
+        file->firstDataBlock = import->nextBlock;
+        file->numberOfDataBlocks = numberOfDataBlocks;
+        import->numberOfFiles++;
+
+        SIMFS_INDEX_TYPE indexBlock = child->block_ref;
+        for (unsigned int slot = 0; slot < numberOfDataBlocks; slot++) {
+            if (slot > 0 && slot % SIMFS_INDEX_ENTRIES_PER_BLOCK == 0)
+                indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1];
+            simfsVolume->block[indexBlock].content.index[slot % SIMFS_INDEX_ENTRIES_PER_BLOCK] =
+                simfsImportBlock(import, DATA_CONTENT_TYPE);
+        }
+    }
+
+    // the subfolders follow the descriptors of all children
+    for (unsigned int i = 0; i < count && error == SIMFS_NO_ERROR; i++)
+        if (entries[i].type == FOLDER_CONTENT_TYPE) {
+            snprintf(path, PATH_MAX, "%s/%s", hostPath, entries[i].name);
+            error = simfsImportFolder(import, path, entries[i].node);
+        }
+
+    free(entries);
+
+    return error;
+}
+
+/*
+ * Reads the content of queued files into their data blocks until the queue is empty; several readers share the
+ * queue. A file that got shorter since it was listed keeps its data blocks, but gets its new size.
+ */
+static void *simfsImportReader(void *argument)
+{
+    SIMFS_IMPORT_TYPE *import = argument;
+    char buffer[SIMFS_DATA_SIZE * 256];
+    unsigned int f;
+
+    while ((f = __atomic_fetch_add(&import->nextFile, 1, __ATOMIC_RELAXED)) < import->numberOfFiles) {
+        SIMFS_IMPORT_FILE_TYPE *file = &import->files[f];
+        SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[file->node].content.fileDescriptor;
+
+        FILE *host = fopen(file->hostPath, "rb");
+        if (host == NULL) {
+            __atomic_store_n(&import->error, SIMFS_READ_ERROR, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        size_t bytesRead = 0;
+        while (bytesRead < fd->size) {
+            size_t wanted = fd->size - bytesRead < sizeof(buffer) ? fd->size - bytesRead : sizeof(buffer);
+            size_t got = fread(buffer, 1, wanted, host);
+
+            // bytesRead stays a multiple of SIMFS_DATA_SIZE until the last piece
+            for (size_t k = 0; k < got; k += SIMFS_DATA_SIZE)
+                memcpy(simfsVolume->block[file->firstDataBlock + (bytesRead + k) / SIMFS_DATA_SIZE].content.data,
+                       buffer + k, got - k < SIMFS_DATA_SIZE ? got - k : SIMFS_DATA_SIZE);
+
+            bytesRead += got;
+            if (got < wanted)
+                break;
+        }
+        fclose(host);
+
+        fd->size = bytesRead;
+        for (unsigned int b = 0; b < file->numberOfDataBlocks; b++)
+            simfsUpdateChecksum(file->firstDataBlock + b);
+    }
+
+    return NULL;
+}
+
+/*
+ * Creates a new volume image from a host folder and everything in it.
+ *
+ * The host tree is walked once to lay out the volume (see SIMFS_IMPORT_TYPE); then numberOfThreads readers (the
+ * calling thread being one of them) read the content of the files directly into their data blocks, and the image
+ * is saved with the bitvector written once at the end. Files and folders get the access rights and owner of the
+ * root, and the access and modification times of their host counterparts. The content is stored uncompressed.
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if a volume is mounted, SIMFS_NOT_FOUND_ERROR if hostPath is not a folder,
+ * SIMFS_ALLOC_ERROR if the tree does not fit into the volume or a name is too long, SIMFS_READ_ERROR if the host
+ * tree cannot be read, and SIMFS_WRITE_ERROR if the image cannot be written.
+ */
+SIMFS_ERROR simfsImportTree(char *hostPath, char *simfsFileName, int numberOfThreads)
+{
+    // the new volume is laid out in simfsVolume and simfsContext, which belong to the mounted volume
+    if (simfsContext != NULL)
+        return SIMFS_DUPLICATE_ERROR;
+
+    struct stat status;
+    if (stat(hostPath, &status) != 0 || !S_ISDIR(status.st_mode))
+        return SIMFS_NOT_FOUND_ERROR;
+
+    if (numberOfThreads < 1)
+        numberOfThreads = 1;
+
+    SIMFS_ERROR error = simfsFormatVolume(SIMFS_IN_PLACE_ENGINE);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    SIMFS_IMPORT_TYPE import;
+    memset(&import, 0, sizeof(SIMFS_IMPORT_TYPE));
+    import.nextBlock = simfsFindFreeBlock((unsigned char *) simfsContext->bitvector);
+    import.error = SIMFS_NO_ERROR;
+
+    error = simfsImportFolder(&import, hostPath, simfsVolume->superblock.rootNodeIndex);
+
+    if (error == SIMFS_NO_ERROR) {
+        pthread_t *readers = calloc(numberOfThreads, sizeof(pthread_t));
+        int started = 0;
+        while (readers != NULL && started < numberOfThreads - 1 &&
+               pthread_create(&readers[started], NULL, simfsImportReader, &import) == 0)
+            started++;
+
+        simfsImportReader(&import);
+
+        for (int t = 0; t < started; t++)
+            pthread_join(readers[t], NULL);
+        free(readers);
+
+        error = import.error;
+    }
+
+    if (error == SIMFS_NO_ERROR) {
+        memcpy(simfsVolume->bitvector, simfsContext->bitvector, sizeof(simfsVolume->bitvector));
+        simfsRecountUsage(simfsVolume->superblock.rootNodeIndex);
+        simfsSealChecksums(1);
+        error = simfsTransferVolume(&simfsFileName, 1, 1);
+    }
+
+    for (unsigned int f = 0; f < import.numberOfFiles; f++)
+        free(import.files[f].hostPath);
+    free(import.files);
+
+    free(simfsVolume);
+    free(simfsContext);
+    simfsVolume = NULL;
+    simfsContext = NULL;
+
+    return error;
+}
+
+/*
+ * Copies the content of a file to a host file a buffer at a time. Holes are skipped, so the host file is sparse
+ * where the file is (if the host file system supports it).
+ */
+static SIMFS_ERROR simfsExportFile(SIMFS_INDEX_TYPE node, char *hostPath)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[node].content.fileDescriptor;
+    if (!(fd->accessRights & 0400))
+        return SIMFS_ACCESS_ERROR;
+
+    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *entry = simfsFindGlobalEntry(node);
+    SIMFS_ERROR error = entry == NULL ? SIMFS_NO_ERROR : simfsFlushBuffer(entry, 0);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    FILE *host = fopen(hostPath, "wb");
+    if (host == NULL)
+        return SIMFS_WRITE_ERROR;
+
+    // whole chunks, so every chunk of a compressed file is decoded once
+    char buffer[SIMFS_COMPRESSION_CHUNK_SIZE * 32];
+
+    size_t offset = 0;
+    while (offset < fd->size && error == SIMFS_NO_ERROR) {
+        size_t data = simfsSeekContent(fd, offset, 1);
+        if (data == fd->size)
+            break;
+        size_t hole = simfsSeekContent(fd, data, 0);
+
+        if (fseeko(host, data, SEEK_SET) != 0)
+            error = SIMFS_WRITE_ERROR;
+
+        for (offset = data; offset < hole && error == SIMFS_NO_ERROR; offset += sizeof(buffer)) {
+            size_t length = hole - offset < sizeof(buffer) ? hole - offset : sizeof(buffer);
+
+            if (simfsReadRange(fd, offset, length, buffer) != SIMFS_NO_ERROR)
+                error = SIMFS_READ_ERROR;
+            else if (fwrite(buffer, 1, length, host) != length)
+                error = SIMFS_WRITE_ERROR;
+        }
+        offset = hole;
+    }
+
+    // a hole at the end has to be made by setting the size
+    if (error == SIMFS_NO_ERROR && (fflush(host) != 0 || ftruncate(fileno(host), fd->size) != 0))
+        error = SIMFS_WRITE_ERROR;
+
+    if (fclose(host) != 0 && error == SIMFS_NO_ERROR)
+        error = SIMFS_WRITE_ERROR;
+
+    return error;
+}
+
+static SIMFS_ERROR simfsExportFolder(SIMFS_INDEX_TYPE folder, char *hostPath)
+{
+    if (mkdir(hostPath, 0777) != 0 && errno != EEXIST)
+        return SIMFS_WRITE_ERROR;
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    char path[PATH_MAX];
+
+    for (SIMFS_INDEX_TYPE indexBlock = simfsVolume->block[folder].content.fileDescriptor.block_ref;
+         indexBlock != 0 && indexBlock != SIMFS_INVALID_INDEX && error == SIMFS_NO_ERROR;
+         indexBlock = simfsVolume->block[indexBlock].content.index[SIMFS_INDEX_SIZE - 1])
+        for (int i = 0; i < SIMFS_INDEX_ENTRIES_PER_BLOCK && error == SIMFS_NO_ERROR; i++) {
+            SIMFS_INDEX_TYPE child = simfsVolume->block[indexBlock].content.index[i];
+            if (child == 0)
+                continue;
+
+            SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[child].content.fileDescriptor;
+            if (snprintf(path, PATH_MAX, "%s/%s", hostPath, fd->name) >= PATH_MAX)
+                error = SIMFS_WRITE_ERROR;
+            else if (fd->type == FOLDER_CONTENT_TYPE)
+                error = simfsExportFolder(child, path);
+            else
+                error = simfsExportFile(child, path);
+        }
+
+    return error;
+}
+
+/*
+ * Copies a folder of the mounted volume and everything in it to a host folder, which is created if needed.
+ *
+ * The tree is walked through the index blocks, without building paths on the volume, and the content of every
+ * file is streamed through a fixed buffer, so the memory used does not depend on the size of the files.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if there is no such folder, SIMFS_ACCESS_ERROR if a file is not readable,
+ * SIMFS_READ_ERROR if a data block does not match its checksum, and SIMFS_WRITE_ERROR if the host tree cannot be
+ * written.
+ */
+SIMFS_ERROR simfsExportTree(char *folderName, char *hostPath)
+{
+    simfsLockMount();
+
+    SIMFS_ERROR error = SIMFS_NOT_FOUND_ERROR;
+    SIMFS_INDEX_TYPE folder = simfsResolvePath(folderName, NULL);
+    if (folder != SIMFS_INVALID_INDEX && simfsVolume->block[folder].type == FOLDER_CONTENT_TYPE)
+        error = simfsExportFolder(folder, hostPath);
+
+    simfsUnlockMount();
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// replication
+//
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Seals the mounted volume with toGeneration and writes the blocks stamped with a later generation than
+ * fromGeneration to a stream (see SIMFS_SEND_HEADER_TYPE), along with their reference counts, checksums and
+ * generations, the superblock and the snapshot table; of a block whose reference count is the only change, just
+ * the record is written. Appends still buffered for open files are stored first, as
+ * when the volume is saved; the volume itself is not saved. The stream grows with the blocks that changed, not with
+ * the volume.
+ *
+ * Returns SIMFS_ACCESS_ERROR if toGeneration is not later than the generation of the volume or fromGeneration is,
+ * SIMFS_ALLOC_ERROR if the stream file cannot be created (the volume is not sealed then), and SIMFS_WRITE_ERROR if
+ * it cannot be written completely.
+ */
+SIMFS_ERROR simfsSend(unsigned int fromGeneration, unsigned int toGeneration, char *streamFileName)
+{
+    simfsLockMount();
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    FILE *stream = NULL;
+    if (toGeneration <= simfsVolume->superblock.generation || fromGeneration > simfsVolume->superblock.generation)
+        error = SIMFS_ACCESS_ERROR;
+    else if ((stream = fopen(streamFileName, "wb")) == NULL)
+        error = SIMFS_ALLOC_ERROR;
+
+    if (error == SIMFS_NO_ERROR) {
+        simfsFlushOpenFiles();
+        simfsSealChecksums(toGeneration);
+
+        SIMFS_SEND_HEADER_TYPE header;
+        memset(&header, 0, sizeof(SIMFS_SEND_HEADER_TYPE));
+        memcpy(header.magic, SIMFS_SEND_MAGIC, sizeof(header.magic));
+        header.fromGeneration = fromGeneration;
+        header.superblock = simfsVolume->superblock;
+        header.superblock.numberOfMembers = 1;
+        header.superblock.memberIndex = 0;
+        memcpy(header.snapshot, simfsVolume->snapshot, sizeof(header.snapshot));
+        for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+            if (simfsVolume->generation[i] > fromGeneration || simfsVolume->referenceGeneration[i] > fromGeneration)
+                header.numberOfBlocks++;
+
+        int complete = simfsTransfer(&header, sizeof(SIMFS_SEND_HEADER_TYPE), stream, 1);
+
+        for (SIMFS_INDEX_TYPE i = 0; i < SIMFS_NUMBER_OF_BLOCKS && complete; i++) {
+            if (simfsVolume->generation[i] <= fromGeneration && simfsVolume->referenceGeneration[i] <= fromGeneration)
+                continue;
+
+            SIMFS_SEND_RECORD_TYPE record;
+            memset(&record, 0, sizeof(SIMFS_SEND_RECORD_TYPE));
+            record.blockIndex = i;
+            record.referenceCount = simfsVolume->referenceCount[i];
+            record.checksum = simfsVolume->checksum[i];
+            record.generation = simfsVolume->generation[i];
+            record.referenceGeneration = simfsVolume->referenceGeneration[i];
+            record.content = record.referenceCount > 0 && record.generation > fromGeneration;
+
+            complete = simfsTransfer(&record, sizeof(SIMFS_SEND_RECORD_TYPE), stream, 1);
+            if (complete && record.content)
+                complete = simfsTransfer(&simfsVolume->block[i], sizeof(SIMFS_BLOCK_TYPE), stream, 1);
+        }
+
+        if (fclose(stream) != 0)
+            complete = 0;
+        if (!complete)
+            error = SIMFS_WRITE_ERROR;
+    }
+
+    simfsUnlockMount();
+
+    return error;
+}
+
+static int simfsTransferAt(void *buffer, size_t size, FILE *file, size_t offset, int write)
+{
+    return fseek(file, (long) offset, SEEK_SET) == 0 && simfsTransfer(buffer, size, file, write);
+}
+
+/*
+ * Reads the next record of a stream, and the block following it if there is one. Returns 0 if the stream ends, the
+ * record is not valid, or the block does not match its checksum.
+ */
+static int simfsReadSendRecord(FILE *stream, SIMFS_SEND_RECORD_TYPE *record, SIMFS_BLOCK_TYPE *block)
+{
+    return simfsTransfer(record, sizeof(SIMFS_SEND_RECORD_TYPE), stream, 0) &&
+           record->blockIndex < SIMFS_NUMBER_OF_BLOCKS &&
+           (!record->content ||
+            (simfsTransfer(block, sizeof(SIMFS_BLOCK_TYPE), stream, 0) &&
+             simfsCrc32c((unsigned char *) block, sizeof(SIMFS_BLOCK_TYPE)) == record->checksum));
+}
+
+/*
+ * Applies a stream written by simfsSend to the replica image in simfsFileName, which is laid out in one file. Only
+ * the blocks in the stream and their entries in the metadata are written, in place; the superblock, which carries
+ * the new generation, is written last, so a receive that did not complete can be repeated with the same stream.
+ * A stream sent from generation 0 creates the replica in a new file next to it (named like the replica, with
+ * ".receive" appended), which replaces the replica only once it is complete. The whole stream is read
+ * and its blocks are verified against their checksums before anything is written, so a damaged stream leaves the
+ * replica alone.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if the stream or the replica does not exist, SIMFS_READ_ERROR if the stream is not
+ * complete or a block in it does not match its checksum, SIMFS_ACCESS_ERROR if the replica is not one of the volume
+ * in one file at a generation from fromGeneration to the one sent up to, and SIMFS_WRITE_ERROR if the replica
+ * cannot be written.
+ */
+SIMFS_ERROR simfsReceive(char *streamFileName, char *simfsFileName)
+{
+    FILE *stream = fopen(streamFileName, "rb");
+    if (stream == NULL)
+        return SIMFS_NOT_FOUND_ERROR;
+
+    SIMFS_SEND_HEADER_TYPE header;
+    if (!simfsTransfer(&header, sizeof(SIMFS_SEND_HEADER_TYPE), stream, 0) ||
+        memcmp(header.magic, SIMFS_SEND_MAGIC, sizeof(header.magic)) != 0) {
+        fclose(stream);
+        return SIMFS_READ_ERROR;
+    }
+
+    // the first pass only verifies the stream
+    simfsCrc32cInit();
+
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+    SIMFS_SEND_RECORD_TYPE record;
+    SIMFS_BLOCK_TYPE block;
+    for (unsigned int r = 0; r < header.numberOfBlocks && error == SIMFS_NO_ERROR; r++)
+        if (!simfsReadSendRecord(stream, &record, &block))
+            error = SIMFS_READ_ERROR;
+
+    if (error == SIMFS_NO_ERROR && fseek(stream, sizeof(SIMFS_SEND_HEADER_TYPE), SEEK_SET) != 0)
+        error = SIMFS_READ_ERROR;
+    if (error != SIMFS_NO_ERROR) {
+        fclose(stream);
+        return error;
+    }
+
+    FILE *replica = NULL;
+    char *newFileName = NULL;
+    if (header.fromGeneration == 0) {
+        // a new replica starts out with all blocks free and not stamped
+        newFileName = malloc(strlen(simfsFileName) + sizeof(".receive"));
+        if (newFileName == NULL) {
+            fclose(stream);
+            return SIMFS_ALLOC_ERROR;
+        }
+        sprintf(newFileName, "%s.receive", simfsFileName);
+
+        replica = fopen(newFileName, "w+b");
+        if (replica == NULL || ftruncate(fileno(replica), sizeof(SIMFS_VOLUME)) != 0)
+            error = SIMFS_WRITE_ERROR;
+    }
+    else {
+        SIMFS_SUPERBLOCK_TYPE superblock;
+        replica = fopen(simfsFileName, "r+b");
+        if (replica == NULL)
+            error = SIMFS_NOT_FOUND_ERROR;
+        else if (!simfsTransferAt(&superblock, sizeof(SIMFS_SUPERBLOCK_TYPE), replica, 0, 0))
+            error = SIMFS_READ_ERROR;
+        else if (superblock.volumeId != header.superblock.volumeId || superblock.numberOfMembers != 1 ||
+                 superblock.generation < header.fromGeneration ||
+                 superblock.generation > header.superblock.generation)
+            error = SIMFS_ACCESS_ERROR;
+    }
+
+    char bitvector[SIMFS_NUMBER_OF_BLOCKS / 8];
+    if (error == SIMFS_NO_ERROR &&
+        !simfsTransferAt(bitvector, sizeof(bitvector), replica, offsetof(SIMFS_VOLUME, bitvector), 0))
+        error = SIMFS_READ_ERROR;
+
+    for (unsigned int r = 0; r < header.numberOfBlocks && error == SIMFS_NO_ERROR; r++) {
+        if (!simfsReadSendRecord(stream, &record, &block)) {
+            error = SIMFS_READ_ERROR;
+            break;
+        }
+
+        SIMFS_INDEX_TYPE i = record.blockIndex;
+        int complete =
+            simfsTransferAt(&record.referenceCount, sizeof(unsigned short), replica,
+                            offsetof(SIMFS_VOLUME, referenceCount) + i * sizeof(unsigned short), 1) &&
+            simfsTransferAt(&record.checksum, sizeof(unsigned int), replica,
+                            offsetof(SIMFS_VOLUME, checksum) + i * sizeof(unsigned int), 1) &&
+            simfsTransferAt(&record.generation, sizeof(unsigned int), replica,
+                            offsetof(SIMFS_VOLUME, generation) + i * sizeof(unsigned int), 1) &&
+            simfsTransferAt(&record.referenceGeneration, sizeof(unsigned int), replica,
+                            offsetof(SIMFS_VOLUME, referenceGeneration) + i * sizeof(unsigned int), 1) &&
+            (!record.content ||
+             simfsTransferAt(&block, sizeof(SIMFS_BLOCK_TYPE), replica,
+                             offsetof(SIMFS_VOLUME, block) + i * sizeof(SIMFS_BLOCK_TYPE), 1));
+        if (!complete)
+            error = SIMFS_WRITE_ERROR;
+
+        if (record.referenceCount > 0)
+            simfsSetBit((unsigned char *) bitvector, i);
+        else
+            simfsClearBit((unsigned char *) bitvector, i);
+    }
+
+    if (error == SIMFS_NO_ERROR &&
+        !(simfsTransferAt(bitvector, sizeof(bitvector), replica, offsetof(SIMFS_VOLUME, bitvector), 1) &&
+          simfsTransferAt(header.snapshot, sizeof(header.snapshot), replica, offsetof(SIMFS_VOLUME, snapshot), 1) &&
+          simfsTransferAt(&header.superblock, sizeof(SIMFS_SUPERBLOCK_TYPE), replica, 0, 1)))
+        error = SIMFS_WRITE_ERROR;
+
+    if (replica != NULL && fclose(replica) != 0 && error == SIMFS_NO_ERROR)
+        error = SIMFS_WRITE_ERROR;
+    fclose(stream);
+
+    if (newFileName != NULL) {
+        if (error == SIMFS_NO_ERROR && rename(newFileName, simfsFileName) != 0)
+            error = SIMFS_WRITE_ERROR;
+        if (error != SIMFS_NO_ERROR)
+            unlink(newFileName);
+        free(newFileName);
+    }
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// per-process I/O scheduling
+//
+//////////////////////////////////////////////////////////////////////////
+
+static unsigned long long simfsTraceClock();
+
+/*
+ * Returns the entry of a process in the I/O scheduler, or NULL if it has none. If create is non-zero, an entry is
+ * made for a process without one; the entry of a process that has exited is reused if the table is full. NULL is
+ * returned as well if no volume is mounted or the table is full.
+ */
+static SIMFS_IO_QUEUE_TYPE *simfsFindIoQueue(pid_t pid, int create)
+{
+    SIMFS_IO_QUEUE_TYPE *unused = NULL;
+
+    if (simfsContext == NULL)
+        return NULL;
+
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_PROCESSES; i++) {
+        if (simfsContext->ioQueue[i].pid == pid)
+            return &simfsContext->ioQueue[i];
+        if (unused == NULL && simfsContext->ioQueue[i].pid == 0)
+            unused = &simfsContext->ioQueue[i];
+    }
+
+    if (!create)
+        return NULL;
+
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_PROCESSES && unused == NULL; i++)
+        if (simfsContext->ioQueue[i].statistics.queueDepth == 0 && kill(simfsContext->ioQueue[i].pid, 0) != 0 &&
+            errno == ESRCH)
+            unused = &simfsContext->ioQueue[i];
+
+    if (unused == NULL)
+        return NULL;
+
+    memset(unused, 0, sizeof(SIMFS_IO_QUEUE_TYPE));
+    unused->pid = pid;
+    unused->virtualTime = simfsContext->ioVirtualTime;
+    unused->statistics.weight = SIMFS_DEFAULT_IO_WEIGHT;
+
+    return unused;
+}
+
+/*
+ * Chooses the process whose call runs next: of the processes with waiting calls that their rate caps let run, the
+ * one with the lowest virtual time. Returns 0 if there is none; *wake is then the time at which the first call held
+ * back by a rate cap may run, or 0 if no call is waiting at all.
+ */
+static pid_t simfsChooseNextCall(unsigned long long now, unsigned long long *wake)
+{
+    SIMFS_IO_QUEUE_TYPE *next = NULL;
+
+    *wake = 0;
+
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_PROCESSES; i++) {
+        SIMFS_IO_QUEUE_TYPE *queue = &simfsContext->ioQueue[i];
+        if (queue->pid == 0 || queue->statistics.queueDepth == 0)
+            continue;
+
+        if (queue->nextDispatch > now) {
+            if (*wake == 0 || queue->nextDispatch < *wake)
+                *wake = queue->nextDispatch;
+        }
+        else if (next == NULL || queue->virtualTime < next->virtualTime)
+            next = queue;
+    }
+
+    return next == NULL ? 0 : next->pid;
+}
+
+/*
+ * Waits until the scheduler chooses the next call, until wake (if it is not 0), or for SIMFS_IO_WAIT_TIMEOUT,
+ * whichever comes first; the lock of a shared mount is released meanwhile. A private mount serves one call at
+ * a time, so there the caller only sleeps until its rate cap lets it run.
+ *
+ * Returns non-zero if the wait timed out.
+ */
+static int simfsWaitForTurn(unsigned long long now, unsigned long long wake)
+{
+    if (simfsShared == NULL) {
+        if (wake > now) {
+            struct timespec pause = { (wake - now) / 1000000000ULL, (wake - now) % 1000000000ULL };
+            nanosleep(&pause, NULL);
+        }
+        return 1;
+    }
+
+    unsigned long long deadline = now + SIMFS_IO_WAIT_TIMEOUT * 1000000ULL;
+    if (wake != 0 && wake < deadline)
+        deadline = wake;
+
+    struct timespec until = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+    int result = pthread_cond_timedwait(&simfsShared->turn, &simfsShared->lock, &until);
+    if (result == EOWNERDEAD)
+        pthread_mutex_consistent(&simfsShared->lock);
+
+    return result == ETIMEDOUT;
+}
+
+/*
+ * State of a scheduled call between its start and its end.
+ */
+typedef struct simfs_io_request_type {
+    SIMFS_IO_QUEUE_TYPE *queue; // NULL if the call is not scheduled
+    unsigned long long start;
+} SIMFS_IO_REQUEST_TYPE;
+
+/*
+ * Locks the mount for a read, write, or create call, and returns when the scheduler has chosen the call.
+ *
+ * The call runs unscheduled if no volume is mounted (it fails anyway) or the table of the scheduler is full. If
+ * the process chosen to run next exited before its call ran, its calls are dropped after SIMFS_IO_WAIT_TIMEOUT.
+ */
+static void simfsBeginScheduledCall(SIMFS_IO_REQUEST_TYPE *request)
+{
+    simfsLockMount();
+
+    request->start = simfsTraceClock();
+    request->queue = simfsFindIoQueue(simfsCallerPid(), 1);
+    if (request->queue == NULL)
+        return;
+
+    SIMFS_IO_QUEUE_TYPE *queue = request->queue;
+    SIMFS_IO_STATISTICS_TYPE *statistics = &queue->statistics;
+
+    if (statistics->queueDepth == 0 && queue->virtualTime < simfsContext->ioVirtualTime)
+        queue->virtualTime = simfsContext->ioVirtualTime; // idle, so no share was saved up
+    if (++statistics->queueDepth > statistics->maxQueueDepth)
+        statistics->maxQueueDepth = statistics->queueDepth;
+
+    while (1) {
+        unsigned long long now = simfsTraceClock();
+        unsigned long long wake = 0;
+
+        if (simfsContext->ioTurn == 0)
+            simfsContext->ioTurn = simfsChooseNextCall(now, &wake);
+        if (simfsContext->ioTurn == queue->pid)
+            break;
+
+        if (simfsWaitForTurn(now, wake) && simfsContext->ioTurn != 0 && simfsContext->ioTurn != queue->pid &&
+            kill(simfsContext->ioTurn, 0) != 0 && errno == ESRCH) {
+            SIMFS_IO_QUEUE_TYPE *gone = simfsFindIoQueue(simfsContext->ioTurn, 0);
+            if (gone != NULL)
+                gone->statistics.queueDepth = 0;
+            simfsContext->ioTurn = 0;
+        }
+    }
+
+    simfsContext->ioTurn = 0;
+    simfsContext->ioVirtualTime = queue->virtualTime;
+    statistics->queueDepth--;
+    statistics->totalWait += simfsTraceClock() - request->start;
+}
+
+/*
+ * Charges a scheduled call that read or wrote the given number of bytes to its process, chooses the next call, and
+ * unlocks the mount.
+ */
+static void simfsEndScheduledCall(SIMFS_IO_REQUEST_TYPE *request, size_t bytes)
+{
+    SIMFS_IO_QUEUE_TYPE *queue = request->queue;
+
+    if (queue != NULL) {
+        SIMFS_IO_STATISTICS_TYPE *statistics = &queue->statistics;
+        unsigned long long now = simfsTraceClock();
+        unsigned long long cost = bytes + SIMFS_IO_REQUEST_COST;
+        unsigned long long wake;
+
+        queue->virtualTime += cost * SIMFS_DEFAULT_IO_WEIGHT / statistics->weight;
+        if (statistics->rateLimit != 0)
+            queue->nextDispatch = (queue->nextDispatch > now ? queue->nextDispatch : now) +
+                                  cost * 1000000000ULL / statistics->rateLimit;
+
+        statistics->requests++;
+        statistics->bytes += bytes;
+        statistics->totalLatency += now - request->start;
+        if (now - request->start > statistics->maxLatency)
+            statistics->maxLatency = now - request->start;
+
+        simfsContext->ioTurn = simfsChooseNextCall(now, &wake);
+        if (simfsShared != NULL)
+            pthread_cond_broadcast(&simfsShared->turn);
+    }
+
+    simfsUnlockMount();
+}
+
+/*
+ * Sets the weight and the byte-rate cap of a process in the I/O scheduler; the process need not have called
+ * anything yet.
+ *
+ * Returns SIMFS_NOT_FOUND_ERROR if no volume is mounted, SIMFS_ACCESS_ERROR if the weight is 0, and
+ * SIMFS_ALLOC_ERROR if the table of the scheduler is full.
+ */
+SIMFS_ERROR simfsSetIoShare(pid_t pid, unsigned int weight, unsigned long rateLimit)
+{
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    simfsLockMount();
+
+    SIMFS_IO_QUEUE_TYPE *queue;
+    if (simfsContext == NULL)
+        error = SIMFS_NOT_FOUND_ERROR;
+    else if (weight == 0)
+        error = SIMFS_ACCESS_ERROR;
+    else if ((queue = simfsFindIoQueue(pid == 0 ? simfsCallerPid() : pid, 1)) == NULL)
+        error = SIMFS_ALLOC_ERROR;
+    else {
+        queue->statistics.weight = weight;
+        queue->statistics.rateLimit = rateLimit;
+    }
+
+    simfsUnlockMount();
+
+    return error;
+}
+
+/*
+ * Copies the statistics of a process in the I/O scheduler. Returns SIMFS_NOT_FOUND_ERROR if the process has
+ * neither made a scheduled call nor got a share set.
+ */
+SIMFS_ERROR simfsGetIoStatistics(pid_t pid, SIMFS_IO_STATISTICS_TYPE *statistics)
+{
+    SIMFS_ERROR error = SIMFS_NOT_FOUND_ERROR;
+
+    simfsLockMount();
+
+    SIMFS_IO_QUEUE_TYPE *queue = simfsFindIoQueue(pid == 0 ? simfsCallerPid() : pid, 0);
+    if (queue != NULL) {
+        *statistics = queue->statistics;
+        error = SIMFS_NO_ERROR;
+    }
+
+    simfsUnlockMount();
+
+    return error;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// tracing and replay
+//
+//////////////////////////////////////////////////////////////////////////
+
+static FILE *simfsTraceFile; // NULL unless a trace is started
+static pthread_mutex_t simfsTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long simfsTraceStart;
+static unsigned int simfsTraceGeneration; // counts the traces started, so threads are numbered anew in every trace
+static unsigned short simfsTraceThreads;
+
+static __thread unsigned int simfsTraceThreadGeneration;
+static __thread unsigned short simfsTraceThread;
+
+static unsigned long long simfsTraceClock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * Returns the time at which a call starts, or 0 if no trace is started; the clock is only read while tracing.
+ */
+static unsigned long long simfsTraceBegin()
+{
+    return simfsTraceFile == NULL ? 0 : simfsTraceClock();
+}
+
+/*
+ * Appends the record of a call that started at the given time, followed by the names passed to it (either may be
+ * NULL), to the trace. Calls that started before the trace did are not recorded.
+ */
+static void simfsTraceEnd(SIMFS_TRACE_OPERATION_TYPE operation, SIMFS_ERROR error, unsigned long long start,
+                          int handle, unsigned long long size, unsigned long long offset, char *name, char *secondName)
+{
+    unsigned long long end = simfsTraceClock();
+
+    size_t nameLength = name == NULL ? 0 : strlen(name) + 1;
+    size_t secondNameLength = secondName == NULL ? 0 : strlen(secondName) + 1;
+
+    SIMFS_TRACE_RECORD_TYPE record;
+    memset(&record, 0, sizeof(SIMFS_TRACE_RECORD_TYPE));
+    record.nameLength = nameLength + secondNameLength;
+    record.operation = operation;
+    record.error = error;
+    record.process = simfsCallerPid();
+    record.handle = handle;
+    record.duration = end - start;
+    record.size = size;
+    record.offset = offset;
+
+    pthread_mutex_lock(&simfsTraceLock);
+
+    if (simfsTraceFile != NULL && start >= simfsTraceStart) {
+        if (simfsTraceThreadGeneration != simfsTraceGeneration) {
+            simfsTraceThreadGeneration = simfsTraceGeneration;
+            simfsTraceThread = ++simfsTraceThreads;
+        }
+        record.thread = simfsTraceThread;
+        record.start = start - simfsTraceStart;
+
+        fwrite(&record, sizeof(SIMFS_TRACE_RECORD_TYPE), 1, simfsTraceFile);
+        if (name != NULL)
+            fwrite(name, 1, nameLength, simfsTraceFile);
+        if (secondName != NULL)
+            fwrite(secondName, 1, secondNameLength, simfsTraceFile);
+    }
+
+    pthread_mutex_unlock(&simfsTraceLock);
+}
+
+/*
+ * Starts tracing the calls of the API to a new trace file (see SIMFS_TRACE_RECORD_TYPE).
+ *
+ * The records are buffered by stdio and written under a lock, so calls from several threads are recorded in the
+ * order they return. Without a trace, a call only pays for checking whether there is one.
+ *
+ * Returns SIMFS_DUPLICATE_ERROR if a trace is already started, and SIMFS_ALLOC_ERROR if the file cannot be created.
+ */
+SIMFS_ERROR simfsStartTrace(char *traceFileName)
+{
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    pthread_mutex_lock(&simfsTraceLock);
+
+    if (simfsTraceFile != NULL)
+        error = SIMFS_DUPLICATE_ERROR;
+    else if ((simfsTraceFile = fopen(traceFileName, "wb")) == NULL)
+        error = SIMFS_ALLOC_ERROR;
+    else {
+        fwrite(SIMFS_TRACE_MAGIC, 1, strlen(SIMFS_TRACE_MAGIC), simfsTraceFile);
+        simfsTraceStart = simfsTraceClock();
+        simfsTraceGeneration++;
+        simfsTraceThreads = 0;
+    }
+
+    pthread_mutex_unlock(&simfsTraceLock);
+
+    return error;
+}
+
+/*
+ * Stops tracing and closes the trace file. Returns SIMFS_NOT_FOUND_ERROR if no trace is started, and
+ * SIMFS_WRITE_ERROR if the trace could not be written completely.
+ */
+SIMFS_ERROR simfsStopTrace()
+{
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    pthread_mutex_lock(&simfsTraceLock);
+
+    if (simfsTraceFile == NULL)
+        error = SIMFS_NOT_FOUND_ERROR;
+    else {
+        if (ferror(simfsTraceFile) | fclose(simfsTraceFile))
+            error = SIMFS_WRITE_ERROR;
+        simfsTraceFile = NULL;
+    }
+
+    pthread_mutex_unlock(&simfsTraceLock);
+
+    return error;
+}
+
+/*
+ * The functions of the API record their calls while a trace is started, and run under the lock of a shared mount;
+ * the read, write, and create calls are dispatched by the I/O scheduler.
+ */
+SIMFS_ERROR simfsCreateFile(char *fileName, SIMFS_CONTENT_TYPE type)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoCreateFile(fileName, type);
+    simfsEndScheduledCall(&request, 0);
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_CREATE_FILE, error, start, -1, type, 0, fileName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsDeleteFile(char *fileName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoDeleteFile(fileName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_DELETE_FILE, error, start, -1, 0, 0, fileName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsRename(char *oldName, char *newName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoRename(oldName, newName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_RENAME, error, start, -1, 0, 0, oldName, newName);
+    return error;
+}
+
+SIMFS_ERROR simfsGetFileInfo(char *fileName, SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffer)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoGetFileInfo(fileName, infoBuffer);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_GET_FILE_INFO, error, start, -1, 0, 0, fileName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsReadDirectory(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor, SIMFS_NAME_TYPE *names,
+                               int capacity, int *count)
+{
+    SIMFS_DIRECTORY_CURSOR_TYPE first = *cursor;
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoReadDirectory(folderName, cursor, names, capacity, count);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_READ_DIRECTORY, error, start, -1, capacity, first, folderName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsReadDirectoryPlus(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor,
+                                   SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffers, int capacity, int *count)
+{
+    SIMFS_DIRECTORY_CURSOR_TYPE first = *cursor;
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoReadDirectoryPlus(folderName, cursor, infoBuffers, capacity, count);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_READ_DIRECTORY_PLUS, error, start, -1, capacity, first, folderName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsOpenFile(char *fileName, SIMFS_FILE_HANDLE_TYPE *fileHandle)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoOpenFile(fileName, fileHandle);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_OPEN_FILE, error, start,
+                      error == SIMFS_NO_ERROR || error == SIMFS_DUPLICATE_ERROR ? *fileHandle : -1, 0, 0, fileName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsWriteFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *writeBuffer)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoWriteFile(fileHandle, writeBuffer);
+    simfsEndScheduledCall(&request, strlen(writeBuffer));
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_WRITE_FILE, error, start, fileHandle, strlen(writeBuffer), 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsAppendFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *appendBuffer)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoAppendFile(fileHandle, appendBuffer);
+    simfsEndScheduledCall(&request, strlen(appendBuffer));
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_APPEND_FILE, error, start, fileHandle, strlen(appendBuffer), 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsFlushFile(SIMFS_FILE_HANDLE_TYPE fileHandle)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoFlushFile(fileHandle);
+    simfsEndScheduledCall(&request, 0);
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_FLUSH_FILE, error, start, fileHandle, 0, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsReserve(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t bytes)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoReserve(fileHandle, bytes);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_RESERVE, error, start, fileHandle, bytes, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsReadFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char **readBuffer)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoReadFile(fileHandle, readBuffer);
+    simfsEndScheduledCall(&request, error == SIMFS_NO_ERROR ? strlen(*readBuffer) : 0);
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_READ_FILE, error, start, fileHandle,
+                      error == SIMFS_NO_ERROR ? strlen(*readBuffer) : 0, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsReadFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, size_t length, char *readBuffer, size_t *bytesRead)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoReadFileAt(fileHandle, offset, length, readBuffer, bytesRead);
+    simfsEndScheduledCall(&request, error == SIMFS_NO_ERROR ? *bytesRead : 0);
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_READ_FILE_AT, error, start, fileHandle, length, offset, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsWriteFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, char *writeBuffer, size_t length)
+{
+    unsigned long long start = simfsTraceBegin();
+    SIMFS_IO_REQUEST_TYPE request;
+    simfsBeginScheduledCall(&request);
+    SIMFS_ERROR error = simfsDoWriteFileAt(fileHandle, offset, writeBuffer, length);
+    simfsEndScheduledCall(&request, length);
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_WRITE_FILE_AT, error, start, fileHandle, length, offset, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsTruncateFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t size)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoTruncateFile(fileHandle, size);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_TRUNCATE_FILE, error, start, fileHandle, size, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsSeekFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, SIMFS_SEEK_TYPE whence, size_t *result)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoSeekFile(fileHandle, offset, whence, result);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_SEEK_FILE, error, start, fileHandle, whence, offset, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsCloseFile(SIMFS_FILE_HANDLE_TYPE fileHandle)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoCloseFile(fileHandle);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_CLOSE_FILE, error, start, fileHandle, 0, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsCreateSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoCreateSnapshot(snapshotName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_CREATE_SNAPSHOT, error, start, -1, 0, 0, snapshotName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsDeleteSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoDeleteSnapshot(snapshotName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_DELETE_SNAPSHOT, error, start, -1, 0, 0, snapshotName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsMountSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoMountSnapshot(snapshotName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_MOUNT_SNAPSHOT, error, start, -1, 0, 0, snapshotName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsUmountSnapshot(SIMFS_NAME_TYPE snapshotName)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoUmountSnapshot(snapshotName);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_UMOUNT_SNAPSHOT, error, start, -1, 0, 0, snapshotName, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsSetDeduplication(char enabled)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoSetDeduplication(enabled);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_SET_DEDUPLICATION, error, start, -1, enabled, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsSetCompression(SIMFS_COMPRESSION_TYPE compression)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoSetCompression(compression);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_SET_COMPRESSION, error, start, -1, compression, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsGetStatistics(SIMFS_STATISTICS_TYPE *statistics)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoGetStatistics(statistics);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_GET_STATISTICS, error, start, -1, 0, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsGetFragmentation(SIMFS_FRAGMENTATION_TYPE *fragmentation)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoGetFragmentation(fragmentation);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_GET_FRAGMENTATION, error, start, -1, 0, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsDefragment(unsigned int blockBudget, unsigned int *blocksMoved)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoDefragment(blockBudget, blocksMoved);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_DEFRAGMENT, error, start, -1, blockBudget, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsCleanSegments(unsigned int blockBudget, unsigned int *blocksMoved)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoCleanSegments(blockBudget, blocksMoved);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_CLEAN_SEGMENTS, error, start, -1, blockBudget, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsScrub(int numberOfThreads, SIMFS_SCRUB_TYPE *scrub)
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoScrub(numberOfThreads, scrub);
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_SCRUB, error, start, -1, numberOfThreads, 0, NULL, NULL);
+    return error;
+}
+
+SIMFS_ERROR simfsSyncFileSystem()
+{
+    unsigned long long start = simfsTraceBegin();
+    simfsLockMount();
+    SIMFS_ERROR error = simfsDoSyncFileSystem();
+    simfsUnlockMount();
+    if (start != 0)
+        simfsTraceEnd(SIMFS_TRACE_SYNC_FILE_SYSTEM, error, start, -1, 0, 0, NULL, NULL);
+    return error;
+}
+
+/*
+ * Latencies of the calls of one operation in a replay.
+ */
+typedef struct simfs_replay_operation_type {
+    unsigned long long *latency; // nanoseconds of every call in the replay
+    unsigned int calls;
+    unsigned int capacity;
+    unsigned int mismatches; // calls that returned another error than they did in the trace
+    unsigned long long tracedNanoseconds; // time of the calls in the trace
+} SIMFS_REPLAY_OPERATION_TYPE;
+
+/*
+ * Handles of the replay that stand for the handles one traced process had open; handles in a trace are only unique
+ * within the process that opened them.
+ */
+typedef struct simfs_replay_process_type {
+    int process; // the process in the trace, or -1 for an unused entry
+    SIMFS_FILE_HANDLE_TYPE handles[SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS];
+} SIMFS_REPLAY_PROCESS_TYPE;
+
+/*
+ * Returns the handle map of the traced process, taking an unused entry for a process not seen before, or NULL if the
+ * trace has more processes than there are entries.
+ */
+static SIMFS_REPLAY_PROCESS_TYPE *simfsReplayProcess(SIMFS_REPLAY_PROCESS_TYPE *processes, int process)
+{
+    SIMFS_REPLAY_PROCESS_TYPE *unused = NULL;
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_PROCESSES; i++) {
+        if (processes[i].process == process)
+            return &processes[i];
+        if (processes[i].process == -1 && unused == NULL)
+            unused = &processes[i];
+    }
+
+    if (unused != NULL) {
+        unused->process = process;
+        for (int i = 0; i < SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS; i++)
+            unused->handles[i] = -1;
+    }
+    return unused;
+}
+
+static int simfsCompareLatency(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a, y = *(const unsigned long long *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Makes one call recorded in a trace. Handles recorded in the trace are mapped to the handles of the replay through
+ * handles, the map of the process that made the call; content to write is in content, and buffer has room for what
+ * the call reads.
+ */
+static SIMFS_ERROR simfsReplayCall(SIMFS_TRACE_RECORD_TYPE *record, char *name, char *secondName,
+                                   SIMFS_FILE_HANDLE_TYPE *handles, char *content, void *buffer)
+{
+    SIMFS_FILE_HANDLE_TYPE handle = -1;
+    if (record->handle >= 0 && record->handle < SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS)
+        handle = handles[record->handle];
+
+    SIMFS_DIRECTORY_CURSOR_TYPE cursor = record->offset;
+    SIMFS_STATISTICS_TYPE statistics;
+    SIMFS_FRAGMENTATION_TYPE fragmentation;
+    SIMFS_SCRUB_TYPE scrub;
+    unsigned int blocksMoved;
+    size_t bytesRead;
+    char *readBuffer;
+    int count;
+    char *nullDevice = "/dev/null"; // a replayed sync keeps the image as it was
+    SIMFS_ERROR error = SIMFS_NO_ERROR;
+
+    switch (record->operation) {
+    case SIMFS_TRACE_CREATE_FILE:
+        return simfsDoCreateFile(name, record->size);
+    case SIMFS_TRACE_DELETE_FILE:
+        return simfsDoDeleteFile(name);
+    case SIMFS_TRACE_RENAME:
+        return simfsDoRename(name, secondName);
+    case SIMFS_TRACE_GET_FILE_INFO:
+        return simfsDoGetFileInfo(name, buffer);
+    case SIMFS_TRACE_READ_DIRECTORY:
+        return simfsDoReadDirectory(name, &cursor, buffer, record->size, &count);
+    case SIMFS_TRACE_READ_DIRECTORY_PLUS:
+        return simfsDoReadDirectoryPlus(name, &cursor, buffer, record->size, &count);
+    case SIMFS_TRACE_OPEN_FILE:
+        error = simfsDoOpenFile(name, &handle);
+        if ((error == SIMFS_NO_ERROR || error == SIMFS_DUPLICATE_ERROR) && record->handle >= 0 &&
+            record->handle < SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS)
+            handles[record->handle] = handle;
+        return error;
+    case SIMFS_TRACE_WRITE_FILE:
+        return simfsDoWriteFile(handle, content);
+    case SIMFS_TRACE_APPEND_FILE:
+        return simfsDoAppendFile(handle, content);
+    case SIMFS_TRACE_FLUSH_FILE:
+        return simfsDoFlushFile(handle);
+    case SIMFS_TRACE_RESERVE:
+        return simfsDoReserve(handle, record->size);
+    case SIMFS_TRACE_READ_FILE:
+        error = simfsDoReadFile(handle, &readBuffer);
+        if (error == SIMFS_NO_ERROR)
+            simfsReleaseReadBuffer(readBuffer);
+        return error;
+    case SIMFS_TRACE_READ_FILE_AT:
+        return simfsDoReadFileAt(handle, record->offset, record->size, buffer, &bytesRead);
+    case SIMFS_TRACE_CLOSE_FILE:
+        return simfsDoCloseFile(handle);
+    case SIMFS_TRACE_CREATE_SNAPSHOT:
+        return simfsDoCreateSnapshot(name);
+    case SIMFS_TRACE_DELETE_SNAPSHOT:
+        return simfsDoDeleteSnapshot(name);
+    case SIMFS_TRACE_MOUNT_SNAPSHOT:
+        return simfsDoMountSnapshot(name);
+    case SIMFS_TRACE_UMOUNT_SNAPSHOT:
+        return simfsDoUmountSnapshot(name);
+    case SIMFS_TRACE_SET_DEDUPLICATION:
+        return simfsDoSetDeduplication(record->size);
+    case SIMFS_TRACE_SET_COMPRESSION:
+        return simfsDoSetCompression(record->size);
+    case SIMFS_TRACE_GET_STATISTICS:
+        return simfsDoGetStatistics(&statistics);
+    case SIMFS_TRACE_GET_FRAGMENTATION:
+        return simfsDoGetFragmentation(&fragmentation);
+    case SIMFS_TRACE_DEFRAGMENT:
+        return simfsDoDefragment(record->size, &blocksMoved);
+    case SIMFS_TRACE_SCRUB:
+        return simfsDoScrub(record->size, &scrub);
+    case SIMFS_TRACE_SYNC_FILE_SYSTEM:
+        return simfsSaveVolume(&nullDevice, 1);
+    case SIMFS_TRACE_WRITE_FILE_AT:
+        return simfsDoWriteFileAt(handle, record->offset, content, record->size);
+    case SIMFS_TRACE_TRUNCATE_FILE:
+        return simfsDoTruncateFile(handle, record->size);
+    case SIMFS_TRACE_SEEK_FILE:
+        return simfsDoSeekFile(handle, record->offset, record->size, &bytesRead);
+    case SIMFS_TRACE_CLEAN_SEGMENTS:
+        return simfsDoCleanSegments(record->size, &blocksMoved);
+    }
+
+    return error;
+}
+
+/*
+ * Replays a trace against the volume in an image, e.g., a fresh one or a copy taken before the traced workload.
+ *
+ * The image is mounted, the calls of the trace are made one after the other in the order of the trace, and the
+ * volume is released without being saved, so the image stays as it was and the replay can be repeated; a sync in
+ * the trace saves the volume to /dev/null instead of the image. With
+ * originalTiming, every call is delayed until the time it was made in the trace relative to the first call;
+ * otherwise, the calls are made as fast as possible. The content written is text-like content of the recorded
+ * size, generated before the call is timed from a fixed seed of rand(), so every replay writes the same content.
+ * A handle in the trace stands for the file that the traced process it belongs to opened under it; the calls are all
+ * made from the replaying process. Traced processes that opened the same file thus share one handle in the replay:
+ * the opens after the first return SIMFS_DUPLICATE_ERROR (and are counted as differing from the trace), their calls
+ * work on the position and buffered appends of the first open, and the first close closes the file for all of them.
+ *
+ * For each operation in the trace, the number of calls, the calls that returned another error than in the trace,
+ * the mean latency in the trace, and the mean, median, 99th percentile and maximum latency in the replay are
+ * printed in microseconds.
+ *
+ * Returns SIMFS_ALLOC_ERROR if the trace cannot be opened, memory runs out or the trace has more than
+ * SIMFS_MAX_NUMBER_OF_PROCESSES processes, SIMFS_READ_ERROR if the trace is damaged, or the error of mounting the
+ * image.
+ */
+SIMFS_ERROR simfsReplayTrace(char *traceFileName, char *simfsFileName, char originalTiming)
+{
+    static char *label[SIMFS_NUMBER_OF_TRACE_OPERATIONS] = {
+        "create", "delete", "rename", "getinfo", "readdir", "readdirplus", "open", "write", "append", "flush",
+        "reserve", "read", "readat", "close", "snapshot", "delsnapshot", "mountsnap", "umountsnap", "dedup",
+        "compression", "statistics", "fragmentation", "defragment", "scrub", "sync", "writeat", "truncate", "seek",
+        "clean" };
+
+    FILE *trace = fopen(traceFileName, "rb");
+    if (trace == NULL)
+        return SIMFS_ALLOC_ERROR;
+
+    char magic[sizeof(SIMFS_TRACE_MAGIC)];
+    if (fread(magic, 1, strlen(SIMFS_TRACE_MAGIC), trace) != strlen(SIMFS_TRACE_MAGIC) ||
+        memcmp(magic, SIMFS_TRACE_MAGIC, strlen(SIMFS_TRACE_MAGIC)) != 0) {
+        fclose(trace);
+        return SIMFS_READ_ERROR;
+    }
+
+    SIMFS_ERROR error = simfsMountFileSystem(simfsFileName, NULL);
+    if (error != SIMFS_NO_ERROR) {
+        fclose(trace);
+        return error;
+    }
+
+    SIMFS_REPLAY_OPERATION_TYPE operation[SIMFS_NUMBER_OF_TRACE_OPERATIONS];
+    memset(operation, 0, sizeof(operation));
+
+    SIMFS_REPLAY_PROCESS_TYPE processes[SIMFS_MAX_NUMBER_OF_PROCESSES];
+    for (int i = 0; i < SIMFS_MAX_NUMBER_OF_PROCESSES; i++)
+        processes[i].process = -1;
+
+    char *names = NULL;
+    size_t namesCapacity = 0;
+    unsigned long long firstCall = 0;
+    char timed = 0;
+    unsigned long long replayStart = simfsTraceClock();
+    srand(1);
+
+    SIMFS_TRACE_RECORD_TYPE record;
+    while (error == SIMFS_NO_ERROR && fread(&record, sizeof(SIMFS_TRACE_RECORD_TYPE), 1, trace) == 1) {
+        if (record.operation >= SIMFS_NUMBER_OF_TRACE_OPERATIONS) {
+            error = SIMFS_READ_ERROR;
+            break;
+        }
+
+        SIMFS_REPLAY_PROCESS_TYPE *process = simfsReplayProcess(processes, record.process);
+        if (process == NULL) {
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+
+        if (record.nameLength + 2 > namesCapacity) {
+            char *grown = realloc(names, record.nameLength + 2);
+            if (grown == NULL) {
+                error = SIMFS_ALLOC_ERROR;
+                break;
+            }
+            names = grown;
+            namesCapacity = record.nameLength + 2;
+        }
+        if (fread(names, 1, record.nameLength, trace) != record.nameLength) {
+            error = SIMFS_READ_ERROR;
+            break;
+        }
+        // the names end with '\0'; the terminators appended stand in for names that are not in the trace
+        names[record.nameLength] = names[record.nameLength + 1] = '\0';
+        char *name = names;
+        char *secondName = name + strlen(name) + 1;
+
+        // what the call writes or reads is set up before the call is timed
+        char *content = NULL;
+        size_t bufferSize = sizeof(SIMFS_FILE_DESCRIPTOR_TYPE);
+        if (record.operation == SIMFS_TRACE_WRITE_FILE || record.operation == SIMFS_TRACE_APPEND_FILE ||
+            record.operation == SIMFS_TRACE_WRITE_FILE_AT)
+            content = simfsGenerateText(record.size + 1);
+        else if (record.operation == SIMFS_TRACE_READ_FILE_AT)
+            bufferSize = record.size;
+        else if (record.operation == SIMFS_TRACE_READ_DIRECTORY)
+            bufferSize = record.size * sizeof(SIMFS_NAME_TYPE);
+        else if (record.operation == SIMFS_TRACE_READ_DIRECTORY_PLUS)
+            bufferSize = record.size * sizeof(SIMFS_FILE_DESCRIPTOR_TYPE);
+        void *buffer = malloc(bufferSize > 0 ? bufferSize : 1);
+
+        SIMFS_REPLAY_OPERATION_TYPE *statistics = &operation[record.operation];
+        if (statistics->calls == statistics->capacity) {
+            unsigned int capacity = statistics->capacity == 0 ? 64 : 2 * statistics->capacity;
+            unsigned long long *grown = realloc(statistics->latency, capacity * sizeof(unsigned long long));
+            if (grown != NULL) {
+                statistics->latency = grown;
+                statistics->capacity = capacity;
+            }
+        }
+        if (buffer == NULL || statistics->calls == statistics->capacity ||
+            ((record.operation == SIMFS_TRACE_WRITE_FILE || record.operation == SIMFS_TRACE_APPEND_FILE ||
+              record.operation == SIMFS_TRACE_WRITE_FILE_AT) && content == NULL)) {
+            free(content);
+            free(buffer);
+            error = SIMFS_ALLOC_ERROR;
+            break;
+        }
+
+        if (originalTiming) {
+            if (!timed) {
+                firstCall = record.start;
+                timed = 1;
+            }
+            unsigned long long due = replayStart + (record.start - firstCall);
+            unsigned long long now = simfsTraceClock();
+            if (due > now) {
+                struct timespec delay = { (due - now) / 1000000000ULL, (due - now) % 1000000000ULL };
+                nanosleep(&delay, NULL);
+            }
+        }
+
+        unsigned long long start = simfsTraceClock();
+        SIMFS_ERROR result = simfsReplayCall(&record, name, secondName, process->handles, content, buffer);
+        statistics->latency[statistics->calls++] = simfsTraceClock() - start;
+
+        statistics->tracedNanoseconds += record.duration;
+        if (result != record.error)
+            statistics->mismatches++;
+
+        free(content);
+        free(buffer);
+    }
+
+    fclose(trace);
+    free(names);
+
+    printf("%-14s %8s %8s %10s %10s %10s %10s %10s\n", "operation", "calls", "differ", "trace us", "mean us",
+           "p50 us", "p99 us", "max us");
+    for (int o = 0; o < SIMFS_NUMBER_OF_TRACE_OPERATIONS; o++) {
+        SIMFS_REPLAY_OPERATION_TYPE *statistics = &operation[o];
+        if (statistics->calls > 0) {
+            qsort(statistics->latency, statistics->calls, sizeof(unsigned long long), simfsCompareLatency);
+
+            unsigned long long total = 0;
+            for (unsigned int c = 0; c < statistics->calls; c++)
+                total += statistics->latency[c];
+
+            printf("%-14s %8u %8u %10.2f %10.2f %10.2f %10.2f %10.2f\n", label[o], statistics->calls,
+                   statistics->mismatches, statistics->tracedNanoseconds / 1e3 / statistics->calls,
+                   total / 1e3 / statistics->calls, statistics->latency[(statistics->calls - 1) / 2] / 1e3,
+                   statistics->latency[(statistics->calls - 1) * 99 / 100] / 1e3,
+                   statistics->latency[statistics->calls - 1] / 1e3);
+        }
+        free(statistics->latency);
+    }
+
+    simfsReleaseVolume();
+
+    return error;
 }
 
 SIMFS_ERROR PrintError(SIMFS_ERROR er){
@@ -7,9 +7,23 @@
 #define __SIMFS_H_
 
 #include <time.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <fuse.h>
 
 //////////////////////////////////////////////////////////////////////////
@@ -23,6 +37,13 @@
 #define SIMFS_MAX_NAME_LENGTH 64 // 128
 #define SIMFS_DATA_SIZE 14 // 254 // SIMFS_BLOCK_SIZE - sizeof(SIMFS_NODE_TYPE)
 #define SIMFS_INDEX_SIZE 7 // 127 // two bytes => x0000 - xFFFF => 2^16 range
+#define SIMFS_INDEX_ENTRIES_PER_BLOCK (SIMFS_INDEX_SIZE - 1) // the last index entry links to the next index block
+#define SIMFS_MAX_NUMBER_OF_SNAPSHOTS 8
+#define SIMFS_COMPRESSION_CHUNK_BLOCKS 8 // 16 // slots reserved for every compressed chunk of a file
+#define SIMFS_COMPRESSION_CHUNK_SIZE (SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE - 2) // two bytes hold the chunk header
+#define SIMFS_STRIPE_BLOCKS 8 // 256 // consecutive blocks kept on one backing file of a striped volume
+#define SIMFS_SEGMENT_BLOCKS 16 // 512 // blocks in one segment of the log of a log-structured volume
+#define SIMFS_NUMBER_OF_SEGMENTS (SIMFS_NUMBER_OF_BLOCKS / SIMFS_SEGMENT_BLOCKS)
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -34,6 +55,16 @@
 #define SIMFS_MAX_NUMBER_OF_OPEN_FILES 64 // 1024
 #define SIMFS_MAX_NUMBER_OF_PROCESSES 64 // 1024
 #define SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS 16 // 64
+#define SIMFS_FINGERPRINT_TABLE_SIZE 509 // 65537 // prime number of chains in the fingerprint index for deduplication
+#define SIMFS_WRITE_BUFFER_SIZE (2 * SIMFS_COMPRESSION_CHUNK_BLOCKS * SIMFS_DATA_SIZE) // appended bytes held per open file
+#define SIMFS_ARENA_CHUNK_SIZE 16384 // 1048576 // bytes the arena takes from the heap at a time
+#define SIMFS_READ_BUFFER_CLASSES 8 // read buffers of 64, 128, ..., 8192 bytes are pooled; larger ones are not
+#define SIMFS_SHARED_ARENA_SIZE 262144 // 16777216 // bytes of the arena in the segment of a volume mounted in shared memory
+#define SIMFS_CLEANER_LOW_WATER 3 // 8 // writes to a log-structured volume clean segments while fewer are clean
+#define SIMFS_CLEANER_MAX_UTILIZATION 75 // percent of live blocks above which a segment is not worth cleaning
+#define SIMFS_DEFAULT_IO_WEIGHT 100 // weight of a process in the I/O scheduler unless it is set
+#define SIMFS_IO_REQUEST_COST 64 // bytes a scheduled call is charged besides the bytes it reads or writes
+#define SIMFS_IO_WAIT_TIMEOUT 100 // milliseconds after which a call waiting for its turn checks that the chosen process lives
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -49,8 +80,42 @@ typedef enum {
     INVALID_CONTENT_TYPE
 } SIMFS_CONTENT_TYPE;
 
+//
+// algorithms for compressing file content
+//
+// compressed files are split into chunks of SIMFS_COMPRESSION_CHUNK_SIZE bytes; every chunk is encoded on its
+// own into the slots from (chunk * SIMFS_COMPRESSION_CHUNK_BLOCKS) on, so a chunk can be read without the others
+//
+typedef enum {
+    SIMFS_NO_COMPRESSION,
+    SIMFS_LZ_COMPRESSION // byte-oriented LZ77 with a hash table of recent positions
+} SIMFS_COMPRESSION_TYPE;
+
+//
+// queries of simfsSeekFile, like lseek(2) with SEEK_DATA and SEEK_HOLE
+//
+// a slot of a file without a block is a hole, which reads as zeros; holes are found in whole blocks, or in whole
+// chunks for compressed files, and the end of a file counts as a hole
+//
+typedef enum {
+    SIMFS_SEEK_DATA,
+    SIMFS_SEEK_HOLE
+} SIMFS_SEEK_TYPE;
+
+//
+// write engines, selected when a volume is created
+//
+// the in-place engine overwrites the blocks of a file and takes new blocks from the first hole of the bitvector;
+// the log-structured engine writes all new data and index blocks sequentially into clean segments (the log), never
+// overwrites a data block, and a cleaner moves the live blocks out of sparsely used segments to make them clean again
+//
+typedef enum {
+    SIMFS_IN_PLACE_ENGINE,
+    SIMFS_LOG_STRUCTURED_ENGINE
+} SIMFS_ENGINE_TYPE;
+
 typedef unsigned short SIMFS_INDEX_TYPE; // is used to index blocks in the file system
-#define SIMFS_INVALID_INDEX 0xFF
+#define SIMFS_INVALID_INDEX 0xFFFF // never a valid block number (SIMFS_NUMBER_OF_BLOCKS < 2^16)
 
 //
 // superblock starting block in the whole file system
@@ -64,6 +129,17 @@ typedef struct simfs_superblock_type { // size of the block with some unused par
     SIMFS_INDEX_TYPE rootNodeIndex; // should point to the first block after the last bitvector block
     int numberOfBlocks;
     int blockSize;
+    char deduplication; // non-zero if data blocks with identical content are shared
+    char compression; // SIMFS_COMPRESSION_TYPE used for new content
+    char engine; // SIMFS_ENGINE_TYPE
+
+    // layout of the backing files (members) of the volume; every member starts with a copy of the superblock
+    unsigned int volumeId; // the same in all members of a volume
+    int numberOfMembers;
+    int stripeBlocks; // blocks in one stripe; stripes are dealt to the members round-robin
+    int memberIndex; // position of the member holding this copy
+
+    unsigned int generation; // of the last seal (see SIMFS_VOLUME); 0 before the volume is first saved
 } SIMFS_SUPERBLOCK_TYPE;
 
 //
@@ -78,18 +154,39 @@ typedef struct simfs_superblock_type { // size of the block with some unused par
 //       the size indicates the number of files or directories in this folder
 //       the block reference points to an index block that holds references to the file and folder blocks
 //
+//   the name is only the last component of the path; the path is given by the chain of parent references, which
+//   ends with SIMFS_INVALID_INDEX at the root of the volume (named "/") or at the root of a snapshot
+//
 typedef char SIMFS_NAME_TYPE[SIMFS_MAX_NAME_LENGTH]; // for folder and file names
 
+//
+// usage of the subtree rooted at a node: for a file, the file itself; for a folder, the folder and everything
+// below it
+//
+// every descriptor keeps the usage of its subtree, and every change is added along the parent chain, so the usage
+// of a folder is read from its descriptor (see simfsGetFileInfo) instead of walking the subtree
+//
+typedef struct simfs_usage_type {
+    size_t bytes; // sizes of the files; bytes appended but still buffered are counted once they are stored
+    unsigned int files;
+    unsigned int folders;
+    unsigned int blocks; // descriptor, index, and data blocks; a data block shared by several files counts for each
+} SIMFS_USAGE_TYPE;
+
 typedef struct simfs_file_descriptor_type {
     SIMFS_CONTENT_TYPE type; // folder or file
-    SIMFS_NAME_TYPE name;
+    SIMFS_NAME_TYPE name; // leaf name
+    SIMFS_INDEX_TYPE parent; // folder holding this file or folder
     time_t creationTime; // creation time
     time_t lastAccessTime; // last access
     time_t lastModificationTime; // last modification
     mode_t accessRights; // access rights for the file
     uid_t owner; // owner ID
     size_t size; // capacity limited for this project to 2s^16
+    size_t reserved; // bytes preallocated for a file with simfsReserve (may exceed the size)
     SIMFS_INDEX_TYPE block_ref; // reference to the data or index block
+    char compression; // SIMFS_COMPRESSION_TYPE of the content of a file
+    SIMFS_USAGE_TYPE usage; // of the subtree rooted here
 } SIMFS_FILE_DESCRIPTOR_TYPE;
 
 //
@@ -110,19 +207,51 @@ typedef struct simfs_node_type {
     } content;
 } SIMFS_BLOCK_TYPE;
 
+//
+// named read-only snapshot of the volume
+//
+// the snapshot owns private copies of all folder, file and index blocks reachable from the root at the time
+// it was taken; data blocks are shared with the live tree and kept alive by their reference counts
+//
+typedef struct simfs_snapshot_type {
+    SIMFS_NAME_TYPE name; // an empty name marks a free slot
+    SIMFS_INDEX_TYPE rootNodeIndex; // the copy of the root folder
+    time_t creationTime;
+} SIMFS_SNAPSHOT_TYPE;
+
 //
 // "physical" file system structure
 //
 // superblock - one block
 //
+// (a volume striped across several backing files keeps a copy of the superblock at the start of each, followed by
+//  its stripes of blocks; the bitvector, the reference counts, the checksums and the snapshot table are kept in the
+//  first file, between its superblock and its stripes, so a volume in one file is laid out as below)
+//
 // bitvector - one bit per block ( (SIMFS_NUMBER_OF_BLOCKS/8 / SIMFS_BLOCK_SIZE) blocks )
 //
+// reference counts - one counter per block; a block is free (and its bit is clear) when its count drops to 0
+//
+// checksums - one CRC32C per block; data blocks are checksummed whenever they are written and verified whenever
+//             they are read, the other blocks are checksummed when the volume is saved and verified when it is loaded
+//
+// generations - the generations in which the content and the reference count of each block last changed; the
+//               generation of the volume is advanced whenever it is sealed (saved, or sent with simfsSend), and the
+//               blocks that changed since the last seal are stamped with the new one
+//
+// snapshot table - SIMFS_MAX_NUMBER_OF_SNAPSHOTS entries
+//
 // blocks (folder, file, data, or index) - SIMFS_NUMBER_OF_BLOCKS
 //
 //
 typedef struct simfs_volume {
     SIMFS_SUPERBLOCK_TYPE superblock;
     char bitvector[SIMFS_NUMBER_OF_BLOCKS / 8]; //
+    unsigned short referenceCount[SIMFS_NUMBER_OF_BLOCKS]; // number of folders, files and snapshots sharing a block
+    unsigned int checksum[SIMFS_NUMBER_OF_BLOCKS]; // CRC32C of each block
+    unsigned int generation[SIMFS_NUMBER_OF_BLOCKS];
+    unsigned int referenceGeneration[SIMFS_NUMBER_OF_BLOCKS];
+    SIMFS_SNAPSHOT_TYPE snapshot[SIMFS_MAX_NUMBER_OF_SNAPSHOTS];
     SIMFS_BLOCK_TYPE block[SIMFS_NUMBER_OF_BLOCKS];
 } SIMFS_VOLUME;
 
@@ -132,13 +261,53 @@ typedef struct simfs_volume {
 //
 //////////////////////////////////////////////////////////////////////////
 
+//
+// reference between the in-memory structures of a mounted volume
+//
+// the structures refer to each other by their distance from the context rather than by pointers, so a context in
+// shared memory stays valid at whatever address a process maps it; 0 refers to nothing
+//
+typedef size_t SIMFS_OFFSET_TYPE;
+
+//
+// arena for the in-memory metadata of a mounted volume
+//
+// memory is taken from the heap in chunks and handed out sequentially; it is never returned piecemeal, all chunks
+// are released at once when the volume is unmounted
+//
+// the arena of a volume mounted in shared memory is a single chunk in the shared segment, which cannot grow
+//
+typedef struct simfs_arena_chunk_type {
+    SIMFS_OFFSET_TYPE next;
+    size_t size; // bytes in memory
+    size_t used;
+    char memory[];
+} SIMFS_ARENA_CHUNK_TYPE;
+
+typedef struct simfs_arena_type {
+    SIMFS_OFFSET_TYPE chunks;
+    size_t bytesReserved; // bytes taken from the heap
+    char fixed; // non-zero if the arena is the chunk in a shared segment
+} SIMFS_ARENA_TYPE;
+
+//
+// slab pool of objects of one size carved from the arena
+//
+// released objects are kept on a free list (linked through their first bytes) and handed out again
+//
+typedef struct simfs_pool_type {
+    size_t objectSize;
+    SIMFS_OFFSET_TYPE freeList;
+    unsigned int objectsInUse;
+} SIMFS_POOL_TYPE;
+
 //
 // directory entry in the conflict resolution linked list with the head in the hash table slot for
-// the corresponding name
+// the corresponding parent and leaf name
 //
 typedef struct simfs_dir_ent {
     SIMFS_INDEX_TYPE nodeReference; // points to the "physical" file descriptor node
-    struct simfs_dir_ent *next;
+    SIMFS_OFFSET_TYPE next;
 } SIMFS_DIR_ENT;
 
 //
@@ -146,7 +315,7 @@ typedef struct simfs_dir_ent {
 //
 // directory implemented as a hash table
 //
-// slots are heads to resolution lists for conflicting names
+// slots are heads to resolution lists for conflicting (parent, leaf name) pairs
 //
 typedef SIMFS_DIR_ENT SIMFS_DIRECTORY[SIMFS_DIRECTORY_SIZE];
 
@@ -163,8 +332,16 @@ typedef struct simfs_open_file_global_type {
     mode_t accessRights; // access rights for the file
     uid_t owner; // owner ID
     size_t size;
+    size_t bufferedBytes; // bytes appended to the file, but not stored in its blocks yet
+    char writeBuffer[SIMFS_WRITE_BUFFER_SIZE];
 } SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE;
 
+//
+// position in a listing of a folder; a listing starts at 0 and is complete when the cursor is SIMFS_DIRECTORY_END
+//
+typedef unsigned int SIMFS_DIRECTORY_CURSOR_TYPE;
+#define SIMFS_DIRECTORY_END ((SIMFS_DIRECTORY_CURSOR_TYPE) -1)
+
 //
 // per-process open file table
 //
@@ -172,7 +349,7 @@ typedef int SIMFS_FILE_HANDLE_TYPE;
 typedef struct simfs_per_process_open_file_type // a node for a local list of open files (per process)
 {
     mode_t accessRights; // access rights for this process
-    SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE *globalEntry; // link to the entry for the file in the global table
+    SIMFS_OFFSET_TYPE globalEntry; // link to the entry for the file in the global table
 } SIMFS_PER_PROCESS_OPEN_FILE_TYPE;
 
 typedef struct simfs_process_control_block_type {
@@ -180,19 +357,248 @@ typedef struct simfs_process_control_block_type {
     int numberOfOpenFiles;
     SIMFS_INDEX_TYPE currentWorkingDirectory; // current working directory; set to the root of the volume on mounting
     SIMFS_PER_PROCESS_OPEN_FILE_TYPE openFileTable[SIMFS_MAX_NUMBER_OF_OPEN_FILES_PER_PROCESS];
-    struct simfs_process_control_block_type *next;
+    SIMFS_OFFSET_TYPE next;
 } SIMFS_PROCESS_CONTROL_BLOCK_TYPE;
 
+/*
+ * options for mounting a volume
+ *
+ * access times follow one of the policies of Linux: strictatime updates the time of the last access on every
+ * access, relatime only if it is not later than the time of the last modification or is a day old, and noatime
+ * never; with coarseClock, timestamps come from CLOCK_REALTIME_COARSE, which is advanced once per kernel tick and
+ * read without a system call; with a sharedName (e.g., "/simfs"), the volume and its context are kept in a POSIX
+ * shared memory object of that name, and other processes can attach to the mount (see simfsAttachSharedFileSystem)
+ */
+typedef enum {
+    SIMFS_RELATIME, // the default
+    SIMFS_STRICTATIME,
+    SIMFS_NOATIME
+} SIMFS_ATIME_TYPE;
+
+typedef struct simfs_mount_options_type {
+    SIMFS_ATIME_TYPE atime;
+    char coarseClock; // non-zero to trade the resolution of timestamps for cheaper clock reads
+    char sharedName[SIMFS_MAX_NAME_LENGTH]; // if not empty, the POSIX shared memory object to mount the volume in
+} SIMFS_MOUNT_OPTIONS_TYPE;
+
+/*
+ * trace of the calls of the API
+ *
+ * a trace file starts with SIMFS_TRACE_MAGIC and holds a record for every call, followed by the path names passed
+ * to the call, each with its terminating '\0'; the content written is not recorded, only its size
+ */
+#define SIMFS_TRACE_MAGIC "SIMFSTR1"
+
+typedef enum {
+    SIMFS_TRACE_CREATE_FILE,
+    SIMFS_TRACE_DELETE_FILE,
+    SIMFS_TRACE_RENAME,
+    SIMFS_TRACE_GET_FILE_INFO,
+    SIMFS_TRACE_READ_DIRECTORY,
+    SIMFS_TRACE_READ_DIRECTORY_PLUS,
+    SIMFS_TRACE_OPEN_FILE,
+    SIMFS_TRACE_WRITE_FILE,
+    SIMFS_TRACE_APPEND_FILE,
+    SIMFS_TRACE_FLUSH_FILE,
+    SIMFS_TRACE_RESERVE,
+    SIMFS_TRACE_READ_FILE,
+    SIMFS_TRACE_READ_FILE_AT,
+    SIMFS_TRACE_CLOSE_FILE,
+    SIMFS_TRACE_CREATE_SNAPSHOT,
+    SIMFS_TRACE_DELETE_SNAPSHOT,
+    SIMFS_TRACE_MOUNT_SNAPSHOT,
+    SIMFS_TRACE_UMOUNT_SNAPSHOT,
+    SIMFS_TRACE_SET_DEDUPLICATION,
+    SIMFS_TRACE_SET_COMPRESSION,
+    SIMFS_TRACE_GET_STATISTICS,
+    SIMFS_TRACE_GET_FRAGMENTATION,
+    SIMFS_TRACE_DEFRAGMENT,
+    SIMFS_TRACE_SCRUB,
+    SIMFS_TRACE_SYNC_FILE_SYSTEM,
+    SIMFS_TRACE_WRITE_FILE_AT,
+    SIMFS_TRACE_TRUNCATE_FILE,
+    SIMFS_TRACE_SEEK_FILE,
+    SIMFS_TRACE_CLEAN_SEGMENTS,
+    SIMFS_NUMBER_OF_TRACE_OPERATIONS
+} SIMFS_TRACE_OPERATION_TYPE;
+
+typedef struct simfs_trace_record_type {
+    unsigned int nameLength; // bytes of the names following the record
+    unsigned char operation; // SIMFS_TRACE_OPERATION_TYPE
+    unsigned char error; // SIMFS_ERROR returned by the call
+    unsigned short thread; // calling thread, numbered in the order of their first traced call
+    int process; // calling process
+    int handle; // file handle passed to the call or returned by it; -1 if there is none
+    unsigned long long start; // nanoseconds from the start of the trace to the call
+    unsigned long long duration; // nanoseconds spent in the call
+    unsigned long long size; // bytes written, read, or reserved, the type, or another numeric argument of the call
+    unsigned long long offset; // offset of simfsReadFileAt, simfsWriteFileAt or simfsSeekFile, or the cursor of a directory listing
+} SIMFS_TRACE_RECORD_TYPE;
+
+/*
+ * stream of the blocks of a volume that changed between two generations (see simfsSend)
+ *
+ * a stream starts with a header, followed by a record for every block stamped with a later generation than
+ * fromGeneration; the record is followed by the block if its content changed and it is allocated, so a block that
+ * was only shared or released takes just its record
+ */
+#define SIMFS_SEND_MAGIC "SIMFSSN1"
+
+typedef struct simfs_send_header_type {
+    char magic[8];
+    unsigned int fromGeneration; // 0 if the stream holds every block that was ever allocated
+    unsigned int numberOfBlocks; // records following the header
+    SIMFS_SUPERBLOCK_TYPE superblock; // of the volume laid out in one file; its generation is the one sent up to
+    SIMFS_SNAPSHOT_TYPE snapshot[SIMFS_MAX_NUMBER_OF_SNAPSHOTS];
+} SIMFS_SEND_HEADER_TYPE;
+
+typedef struct simfs_send_record_type {
+    SIMFS_INDEX_TYPE blockIndex;
+    unsigned short referenceCount; // 0 if the block is free
+    unsigned int checksum;
+    unsigned int generation;
+    unsigned int referenceGeneration;
+    char content; // non-zero if the block follows
+} SIMFS_SEND_RECORD_TYPE;
+
+/*
+ * per-process I/O scheduling
+ *
+ * the read, write, and create calls (simfsCreateFile, simfsWriteFile, simfsAppendFile, simfsFlushFile,
+ * simfsReadFile, simfsReadFileAt, and simfsWriteFileAt) of the processes using a volume are dispatched in weighted
+ * fair order: every process has a virtual time, which grows by the cost of each of its calls (the bytes read or
+ * written plus SIMFS_IO_REQUEST_COST) divided by its weight, and the waiting call of the process with the lowest
+ * virtual time runs next; a process that was idle starts at the virtual time of the last call dispatched, so it
+ * cannot save up a share while it is not using it
+ *
+ * a process with a byte-rate cap is held back until its calls so far fit into the cap; calls are not split, so
+ * a large call delays the next one of the process accordingly
+ */
+typedef struct simfs_io_statistics_type {
+    unsigned int weight;
+    unsigned long rateLimit; // bytes per second; 0 if not capped
+    unsigned int queueDepth; // calls waiting for their turn
+    unsigned int maxQueueDepth;
+    unsigned long requests; // calls dispatched
+    unsigned long long bytes; // bytes read or written by the calls
+    unsigned long long totalWait; // nanoseconds the calls waited for their turn, summed up
+    unsigned long long totalLatency; // nanoseconds from the start to the end of the calls, summed up
+    unsigned long long maxLatency;
+} SIMFS_IO_STATISTICS_TYPE;
+
+typedef struct simfs_io_queue_type {
+    pid_t pid; // 0 if the entry is unused
+    unsigned long long virtualTime;
+    unsigned long long nextDispatch; // earliest time the rate cap lets the next call run
+    SIMFS_IO_STATISTICS_TYPE statistics;
+} SIMFS_IO_QUEUE_TYPE;
+
 /*
  * file system context
  */
 typedef struct simfs_context_type {
+    SIMFS_MOUNT_OPTIONS_TYPE options; // as given on mounting
     SIMFS_DIRECTORY directory; // the hashtable-based in-memory directory
     char bitvector[SIMFS_NUMBER_OF_BLOCKS / 8]; // an in-memory copy of the bitvector of the simulated volume
     SIMFS_OPEN_FILE_GLOBAL_TABLE_TYPE globalOpenFileTable[SIMFS_MAX_NUMBER_OF_OPEN_FILES]; // in-memory
-    SIMFS_PROCESS_CONTROL_BLOCK_TYPE *processControlBlocks;
+    SIMFS_OFFSET_TYPE processControlBlocks; // list of SIMFS_PROCESS_CONTROL_BLOCK_TYPE
+    char mountedSnapshots[SIMFS_MAX_NUMBER_OF_SNAPSHOTS]; // non-zero if the snapshot's tree is in the directory
+
+    // fingerprint index of the data blocks for deduplication; rebuilt on mounting
+    SIMFS_INDEX_TYPE fingerprintTable[SIMFS_FINGERPRINT_TABLE_SIZE]; // heads of the chains of blocks; 0 if empty
+    SIMFS_INDEX_TYPE fingerprintNext[SIMFS_NUMBER_OF_BLOCKS]; // next block in the same chain; 0 at the end
+    unsigned int fingerprint[SIMFS_NUMBER_OF_BLOCKS];
+
+    unsigned long bytesWritten; // bytes copied into data blocks
+    unsigned long bytesDeduplicated; // bytes that were not copied, since a block with the same content existed
+
+    SIMFS_INDEX_TYPE defragmentCursor; // block at which the next slice of the defragmenter starts looking for files
+
+    SIMFS_INDEX_TYPE logHead; // next block of the log of a log-structured volume; at the start of a segment, the log
+                              // continues in the next clean segment from there on
+    unsigned long blocksCleaned;
+
+    // blocks changed since the last seal: allocated or with data stored, and shared or released; changed folder,
+    // file and index blocks are found by their checksums when the volume is sealed
+    char changedBlocks[SIMFS_NUMBER_OF_BLOCKS / 8];
+    char changedReferences[SIMFS_NUMBER_OF_BLOCKS / 8];
+
+    // I/O scheduler; the entries are kept while the volume is mounted, so the settings of a process stay when it
+    // closes its last file
+    SIMFS_IO_QUEUE_TYPE ioQueue[SIMFS_MAX_NUMBER_OF_PROCESSES];
+    pid_t ioTurn; // process whose call runs next; 0 if none is chosen
+    unsigned long long ioVirtualTime; // virtual time of the call dispatched last
+
+    SIMFS_OFFSET_TYPE memberFileNames; // the backing files the volume was mounted from (an array of offsets of the
+                                       // names); simfsSyncFileSystem saves it to them
+    int numberOfMembers;
+
+    // memory for the in-memory structures; released on unmounting
+    SIMFS_ARENA_TYPE arena;
+    SIMFS_POOL_TYPE directoryEntryPool; // collision nodes of the directory
+    SIMFS_POOL_TYPE processControlBlockPool;
+    SIMFS_POOL_TYPE readBufferPool[SIMFS_READ_BUFFER_CLASSES]; // buffers returned by simfsReadFile
 } SIMFS_CONTEXT_TYPE;
 
+/*
+ * shared memory segment of a volume mounted with a sharedName
+ *
+ * the processes attached to the mount run the file operations on the segment directly, one at a time under the
+ * process-shared lock; the segment maps to different addresses in the processes, so nothing in it holds a pointer
+ */
+#define SIMFS_SHARED_MAGIC "SIMFSSH1"
+
+typedef struct simfs_shared_segment_type {
+    char magic[8];
+    pthread_mutex_t lock; // process-shared and robust: a process that dies holding it does not block the others
+    pthread_cond_t turn; // signalled when the I/O scheduler chooses the next call
+    int attachedProcesses; // including the one that mounted the volume
+    SIMFS_CONTEXT_TYPE context;
+    SIMFS_VOLUME volume;
+    _Alignas(16) char arena[SIMFS_SHARED_ARENA_SIZE];
+} SIMFS_SHARED_SEGMENT_TYPE;
+
+/*
+ * usage statistics of the mounted volume
+ */
+typedef struct simfs_statistics_type {
+    unsigned int freeBlocks;
+    unsigned int physicalDataBlocks; // allocated data blocks
+    unsigned int logicalDataBlocks; // references to data blocks from files in the live tree and in snapshots
+    double deduplicationRatio; // logicalDataBlocks / physicalDataBlocks
+    unsigned long bytesWritten;
+    unsigned long bytesDeduplicated;
+    unsigned int cleanSegments; // segments without allocated blocks
+    unsigned long blocksCleaned; // live blocks moved by the segment cleaner of a log-structured volume
+    unsigned int generation; // of the last seal
+} SIMFS_STATISTICS_TYPE;
+
+/*
+ * fragmentation of the mounted volume
+ *
+ * an extent is a run of consecutive blocks holding consecutive slots of a file; a file with more than one extent
+ * is fragmented
+ */
+typedef struct simfs_fragmentation_type {
+    unsigned int files; // files in the live tree and in snapshots
+    unsigned int fragmentedFiles;
+    unsigned int dataBlocks; // data blocks referenced from the files
+    unsigned int extents; // extents of all files
+    unsigned int freeExtents; // runs of free blocks
+    unsigned int largestFreeExtent;
+} SIMFS_FRAGMENTATION_TYPE;
+
+/*
+ * findings of a scrub of the mounted volume
+ */
+typedef struct simfs_scrub_type {
+    unsigned int blocksVerified; // data blocks whose checksums were verified
+    unsigned int checksumErrors; // data blocks whose content does not match the checksum
+    unsigned int lostBlocks; // allocated in the bitvector, but not reachable from the root or a snapshot
+    unsigned int freeReachableBlocks; // reachable, but free in the bitvector
+    unsigned int referenceCountErrors; // reachable blocks whose reference count differs from the references found
+} SIMFS_SCRUB_TYPE;
+
 //////////////////////////////////////////////////////////////////////////
 //
 // file system function declarations
@@ -212,22 +618,109 @@ typedef enum simfs_error {
 
 //SIMFS_ERROR simfsMountFileSystem(SIMFS_VOLUME *fileSystem);
 
-SIMFS_ERROR simfsCreateFile(SIMFS_NAME_TYPE fileName, SIMFS_CONTENT_TYPE type);
+/*
+ * Files and folders are named by paths: a path starting with '/' is resolved from the root of the volume, a path
+ * starting with '@' from the root of a mounted snapshot, and any other path from the current working directory of
+ * the caller. Trailing slashes are optional, e.g., "/docs/a.txt" and "/docs/a.txt/" name the same file. There is
+ * no limit on the length of a path; only each leaf name is limited to SIMFS_MAX_NAME_LENGTH - 1 characters.
+ */
+SIMFS_ERROR simfsCreateFile(char *fileName, SIMFS_CONTENT_TYPE type);
+
+SIMFS_ERROR simfsDeleteFile(char *fileName);
 
-SIMFS_ERROR simfsDeleteFile(SIMFS_NAME_TYPE fileName);
+SIMFS_ERROR simfsRename(char *oldName, char *newName);
 
-SIMFS_ERROR simfsGetFileInfo(SIMFS_NAME_TYPE fileName, SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffer);
+SIMFS_ERROR simfsGetFileInfo(char *fileName, SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffer);
 
-SIMFS_ERROR simfsOpenFile(SIMFS_NAME_TYPE fileName, SIMFS_FILE_HANDLE_TYPE *fileHandle);
+SIMFS_ERROR simfsReadDirectory(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor, SIMFS_NAME_TYPE *names,
+                               int capacity, int *count);
+
+SIMFS_ERROR simfsReadDirectoryPlus(char *folderName, SIMFS_DIRECTORY_CURSOR_TYPE *cursor,
+                                   SIMFS_FILE_DESCRIPTOR_TYPE *infoBuffers, int capacity, int *count);
+
+SIMFS_ERROR simfsOpenFile(char *fileName, SIMFS_FILE_HANDLE_TYPE *fileHandle);
 
 SIMFS_ERROR simfsWriteFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *writeBuffer);
 
+SIMFS_ERROR simfsAppendFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char *appendBuffer);
+
+SIMFS_ERROR simfsFlushFile(SIMFS_FILE_HANDLE_TYPE fileHandle);
+
+SIMFS_ERROR simfsReserve(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t bytes);
+
 SIMFS_ERROR simfsReadFile(SIMFS_FILE_HANDLE_TYPE fileHandle, char **readBuffer);
 
+void simfsReleaseReadBuffer(char *readBuffer);
+
+SIMFS_ERROR simfsReadFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, size_t length, char *readBuffer, size_t *bytesRead);
+
+/*
+ * Files may be sparse: writing past the end of a file with simfsWriteFileAt, or growing it with simfsTruncateFile,
+ * leaves a hole that reads as zeros and takes no data blocks until something is written into it.
+ */
+SIMFS_ERROR simfsWriteFileAt(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, char *writeBuffer, size_t length);
+
+SIMFS_ERROR simfsTruncateFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t size);
+
+SIMFS_ERROR simfsSeekFile(SIMFS_FILE_HANDLE_TYPE fileHandle, size_t offset, SIMFS_SEEK_TYPE whence, size_t *result);
+
 SIMFS_ERROR simfsCloseFile(SIMFS_FILE_HANDLE_TYPE fileHandle);
 
 SIMFS_ERROR AddFolderToContext(SIMFS_BLOCK_TYPE folder, SIMFS_CONTEXT_TYPE *context);
 
+/*
+ * Snapshots are named, read-only copies of the whole tree. Files of a mounted snapshot are reachable under
+ * the name of the snapshot prefixed with '@', e.g., "/docs/" in the snapshot "monday" is "@monday/docs/".
+ */
+SIMFS_ERROR simfsCreateSnapshot(SIMFS_NAME_TYPE snapshotName);
+SIMFS_ERROR simfsDeleteSnapshot(SIMFS_NAME_TYPE snapshotName);
+SIMFS_ERROR simfsMountSnapshot(SIMFS_NAME_TYPE snapshotName);
+SIMFS_ERROR simfsUmountSnapshot(SIMFS_NAME_TYPE snapshotName);
+
+SIMFS_ERROR simfsSetDeduplication(char enabled);
+SIMFS_ERROR simfsSetCompression(SIMFS_COMPRESSION_TYPE compression);
+SIMFS_ERROR simfsGetStatistics(SIMFS_STATISTICS_TYPE *statistics);
+
+SIMFS_ERROR simfsGetFragmentation(SIMFS_FRAGMENTATION_TYPE *fragmentation);
+SIMFS_ERROR simfsDefragment(unsigned int blockBudget, unsigned int *blocksMoved);
+SIMFS_ERROR simfsCleanSegments(unsigned int blockBudget, unsigned int *blocksMoved);
+
+SIMFS_ERROR simfsScrub(int numberOfThreads, SIMFS_SCRUB_TYPE *scrub);
+
+/*
+ * Bulk transfer between the volume and the host: simfsImportTree creates a new volume image holding a copy of
+ * a host folder (no volume may be mounted meanwhile), and simfsExportTree copies a folder of the mounted volume
+ * to the host.
+ */
+SIMFS_ERROR simfsImportTree(char *hostPath, char *simfsFileName, int numberOfThreads);
+SIMFS_ERROR simfsExportTree(char *folderName, char *hostPath);
+
+/*
+ * Replication of the mounted volume to a replica image in one file: simfsSend seals the volume with toGeneration
+ * (which must be later than its generation, see simfsGetStatistics) and writes the blocks that changed after
+ * fromGeneration to a stream file; simfsReceive applies a stream to a replica that is at a generation from
+ * fromGeneration to the one sent up to, and creates the replica from a stream sent from generation 0. The replica
+ * is changed only by simfsReceive and must not be mounted meanwhile. Neither call is traced.
+ */
+SIMFS_ERROR simfsSend(unsigned int fromGeneration, unsigned int toGeneration, char *streamFileName);
+SIMFS_ERROR simfsReceive(char *streamFileName, char *simfsFileName);
+
+/*
+ * Sets the weight (SIMFS_DEFAULT_IO_WEIGHT unless set) and the byte-rate cap (0 for none) of a process in the I/O
+ * scheduler, and reads its statistics; pid 0 selects the caller. Neither call is traced.
+ */
+SIMFS_ERROR simfsSetIoShare(pid_t pid, unsigned int weight, unsigned long rateLimit);
+SIMFS_ERROR simfsGetIoStatistics(pid_t pid, SIMFS_IO_STATISTICS_TYPE *statistics);
+
+/*
+ * While a trace is started, every call of the functions above from simfsCreateFile to simfsScrub, and of simfsSyncFileSystem,
+ * is appended to the trace file; simfsReplayTrace repeats the calls of a trace against an image and prints their
+ * latencies. Creating, mounting, and unmounting the volume is not traced.
+ */
+SIMFS_ERROR simfsStartTrace(char *traceFileName);
+SIMFS_ERROR simfsStopTrace();
+SIMFS_ERROR simfsReplayTrace(char *traceFileName, char *simfsFileName, char originalTiming);
+
 /*
  * The following functions can be used to simulate FUSE context's user and process identifiers for testing.
  *
@@ -236,6 +729,7 @@ SIMFS_ERROR AddFolderToContext(SIMFS_BLOCK_TYPE folder, SIMFS_CONTEXT_TYPE *cont
 
 struct fuse_context *simfs_debug_get_context(); // follows FUSE naming convention
 char *simfsGenerateContent(int size);
+SIMFS_ERROR simfsBenchmarkCompression(int size, int iterations);
 SIMFS_ERROR PrintError(SIMFS_ERROR er);
 //char *fileNameGenerator(size_t length);
 
@@ -244,12 +738,41 @@ SIMFS_ERROR PrintError(SIMFS_ERROR er);
 
 SIMFS_ERROR simfsCreateFileSystem(char *simfsFileName);
 SIMFS_ERROR simfsUmountFileSystem(char *simfsFileName);
-SIMFS_ERROR simfsMountFileSystem(char *simfsFileName);
+SIMFS_ERROR simfsMountFileSystem(char *simfsFileName, SIMFS_MOUNT_OPTIONS_TYPE *options);
+
+/*
+ * A volume can be striped across several backing files (e.g., on different disks), which are then read and written
+ * in parallel. The files must be given in the same order as when the volume was created; a volume in one file is
+ * the same as a volume striped across that one file.
+ */
+SIMFS_ERROR simfsCreateStripedFileSystem(char **memberFileNames, int numberOfMembers);
+SIMFS_ERROR simfsMountStripedFileSystem(char **memberFileNames, int numberOfMembers, SIMFS_MOUNT_OPTIONS_TYPE *options);
+SIMFS_ERROR simfsUmountStripedFileSystem(char **memberFileNames, int numberOfMembers);
+SIMFS_ERROR simfsSyncFileSystem();
+
+/*
+ * Creates a volume (striped as above) that is written by the log-structured engine (see SIMFS_ENGINE_TYPE); it is
+ * mounted like any other volume. simfsCleanSegments runs a slice of the segment cleaner explicitly; writes also run
+ * one when the clean segments run low.
+ */
+SIMFS_ERROR simfsCreateLogStructuredFileSystem(char **memberFileNames, int numberOfMembers);
+
+/*
+ * Other processes attach to a volume mounted with a sharedName in its options and run the functions above on it
+ * directly; the calls of all attached processes are serialized by a lock in the shared memory. A process detaches
+ * (which closes the files it has open) before the volume is unmounted; simfsUmountFileSystem returns
+ * SIMFS_NOT_EMPTY_ERROR while another process is attached.
+ */
+SIMFS_ERROR simfsAttachSharedFileSystem(char *sharedName);
+SIMFS_ERROR simfsDetachSharedFileSystem();
 // ... other functions already in there
-unsigned long hash(unsigned char *str);
+unsigned long hash(SIMFS_INDEX_TYPE parent, unsigned char *str);
 void simfsFlipBit(unsigned char *bitvector, unsigned short bitIndex);
 void simfsSetBit(unsigned char *bitvector, unsigned short bitIndex);
 void simfsClearBit(unsigned char *bitvector, unsigned short bitIndex);
 unsigned short simfsFindFreeBlock(unsigned char *bitvector);
+SIMFS_INDEX_TYPE simfsAllocateBlock(SIMFS_CONTENT_TYPE type);
+void simfsShareBlock(SIMFS_INDEX_TYPE blockIndex);
+void simfsReleaseBlock(SIMFS_INDEX_TYPE blockIndex);
 
 #endif
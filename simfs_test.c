@@ -0,0 +1,1447 @@
+/**
+ * Test driver of the file system
+ *
+ * Every test creates a fresh volume in the folder given as the first argument (the current folder by default),
+ * calls the file system through its public functions, and checks what the calls return and what they leave in the
+ * volume. Built together with simfs.c, e.g., with
+ *
+ *     gcc -std=gnu11 -o simfs_test simfs.c simfs_test.c -lpthread
+ *
+ * the driver prints every failed check and returns the number of failed tests.
+ */
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "simfs.h"
+
+extern SIMFS_CONTEXT_TYPE *simfsContext;
+extern SIMFS_VOLUME *simfsVolume;
+
+static char *simfsTestFolder = ".";
+static int simfsTestFailures;
+
+/*
+ * Prints a check that does not hold and makes the test it is in fail.
+ */
+#define SIMFS_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: %s\n", __func__, __LINE__, #condition); \
+            simfsTestFailures++; \
+        } \
+    } while (0)
+
+/*
+ * Returns the path of the file with the given name in the test folder; the path is valid until the next call.
+ */
+static char *simfsTestPath(char *name)
+{
+    static char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", simfsTestFolder, name);
+    return path;
+}
+
+/*
+ * Creates and mounts a fresh volume in the image with the given name.
+ */
+static SIMFS_ERROR simfsTestCreateVolume(char *name)
+{
+    SIMFS_ERROR error = simfsCreateFileSystem(simfsTestPath(name));
+    if (error != SIMFS_NO_ERROR)
+        return error;
+    return simfsMountFileSystem(simfsTestPath(name), NULL);
+}
+
+/*
+ * Returns 1 if the file has exactly the given content, which is read through simfsReadFile.
+ */
+static int simfsTestHasContent(char *fileName, char *content)
+{
+    SIMFS_NAME_TYPE name;
+    snprintf(name, SIMFS_MAX_NAME_LENGTH, "%s", fileName);
+
+    SIMFS_FILE_HANDLE_TYPE handle;
+    if (simfsOpenFile(name, &handle) != SIMFS_NO_ERROR)
+        return 0;
+
+    char *readBuffer = NULL;
+    int same = simfsReadFile(handle, &readBuffer) == SIMFS_NO_ERROR && strcmp(readBuffer, content) == 0;
+    if (readBuffer != NULL)
+        simfsReleaseReadBuffer(readBuffer);
+
+    return simfsCloseFile(handle) == SIMFS_NO_ERROR && same;
+}
+
+/*
+ * Creates a file in the root folder with the given content.
+ */
+static SIMFS_ERROR simfsTestWriteFile(char *fileName, char *content)
+{
+    SIMFS_NAME_TYPE name;
+    snprintf(name, SIMFS_MAX_NAME_LENGTH, "%s", fileName);
+    SIMFS_ERROR error = simfsCreateFile(name, FILE_CONTENT_TYPE);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    SIMFS_FILE_HANDLE_TYPE handle;
+    snprintf(name, SIMFS_MAX_NAME_LENGTH, "/%s/", fileName);
+    error = simfsOpenFile(name, &handle);
+    if (error != SIMFS_NO_ERROR)
+        return error;
+
+    error = simfsWriteFile(handle, content);
+    SIMFS_ERROR closeError = simfsCloseFile(handle);
+    return error != SIMFS_NO_ERROR ? error : closeError;
+}
+
+/*
+ * Returns 1 if a scrub of the mounted volume finds neither damaged blocks nor inconsistent metadata.
+ */
+static int simfsTestScrubIsClean()
+{
+    SIMFS_SCRUB_TYPE scrub;
+    return simfsScrub(2, &scrub) == SIMFS_NO_ERROR && scrub.checksumErrors == 0 && scrub.lostBlocks == 0 &&
+           scrub.freeReachableBlocks == 0 && scrub.referenceCountErrors == 0;
+}
+
+/*
+ * Returns the block in a slot of a chain of index blocks.
+ */
+static SIMFS_INDEX_TYPE simfsTestSlot(SIMFS_INDEX_TYPE chain, unsigned int slot)
+{
+    for (; slot >= SIMFS_INDEX_ENTRIES_PER_BLOCK; slot -= SIMFS_INDEX_ENTRIES_PER_BLOCK)
+        chain = simfsVolume->block[chain].content.index[SIMFS_INDEX_SIZE - 1];
+    return simfsVolume->block[chain].content.index[slot];
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * A file changed after a snapshot keeps its old content in the snapshot, a file deleted after it stays in it, a
+ * snapshot is not deleted while a file of it is open, and deleting it leaves the live files alone.
+ */
+static void simfsTestSnapshot()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("snapshot.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("changed", "before the snapshot, over a few blocks") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("kept", "not changed after the snapshot") == SIMFS_NO_ERROR);
+
+    SIMFS_NAME_TYPE snapshot = "s";
+    SIMFS_CHECK(simfsCreateSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateSnapshot(snapshot) == SIMFS_DUPLICATE_ERROR);
+
+    SIMFS_NAME_TYPE changed = "/changed/", kept = "/kept/";
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile(changed, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "after the snapshot") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsDeleteFile(kept) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestHasContent("@s/changed/", "") == 0);
+    SIMFS_CHECK(simfsMountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/changed/", "after the snapshot"));
+    SIMFS_CHECK(simfsTestHasContent("@s/changed/", "before the snapshot, over a few blocks"));
+    SIMFS_CHECK(simfsTestHasContent("@s/kept/", "not changed after the snapshot"));
+
+    // the blocks of an open file of the snapshot are not released under it
+    SIMFS_CHECK(simfsOpenFile("@s/kept/", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsDeleteSnapshot(snapshot) == SIMFS_ACCESS_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsUmountSnapshot(snapshot) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsDeleteSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountSnapshot(snapshot) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/changed/", "after the snapshot"));
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("snapshot.simfs")) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("snapshot.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/changed/", "after the snapshot"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("snapshot.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Files with the same content share their blocks, a snapshot shares them as well, and a change to one of the files
+ * leaves the other alone. Without deduplication, every file gets its own blocks.
+ */
+static void simfsTestDeduplication()
+{
+    char *content = "the same content in two files, long enough for several blocks";
+    SIMFS_STATISTICS_TYPE statistics;
+
+    SIMFS_CHECK(simfsTestCreateVolume("deduplication.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("private", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSetDeduplication(1) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("a", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("b", content) == SIMFS_NO_ERROR);
+
+    unsigned int blocks = (strlen(content) + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE;
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.logicalDataBlocks == 3 * blocks);
+    SIMFS_CHECK(statistics.physicalDataBlocks == blocks);
+    SIMFS_CHECK(statistics.bytesDeduplicated == 2 * strlen(content));
+
+    SIMFS_NAME_TYPE snapshot = "s", b = "/b/";
+    SIMFS_CHECK(simfsCreateSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile(b, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "the SAME content in two files, long enough for several blocks") ==
+                SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestHasContent("/a/", content));
+    SIMFS_CHECK(simfsTestHasContent("/b/", "the SAME content in two files, long enough for several blocks"));
+    SIMFS_CHECK(simfsMountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("@s/b/", content));
+    SIMFS_CHECK(simfsUmountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsDeleteSnapshot(snapshot) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsSetDeduplication(0) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("c", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.logicalDataBlocks == 4 * blocks);
+    SIMFS_CHECK(statistics.physicalDataBlocks > 2 * blocks);
+
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("deduplication.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("deduplication.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/a/", content));
+    SIMFS_CHECK(simfsTestHasContent("/c/", content));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("deduplication.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Compressed files read back as written, as a whole and in ranges across chunks, also after a remount, and a file
+ * keeps its compression when the compression of the volume changes; the benchmark leaves neither its file nor its
+ * compression settings behind.
+ */
+static void simfsTestCompression()
+{
+    char content[3 * SIMFS_COMPRESSION_CHUNK_SIZE + 1];
+    for (int i = 0; i < 3 * SIMFS_COMPRESSION_CHUNK_SIZE; i++)
+        content[i] = "abcabcabd"[i % 9];
+    content[3 * SIMFS_COMPRESSION_CHUNK_SIZE] = '\0';
+    char *random = simfsGenerateContent(2 * SIMFS_COMPRESSION_CHUNK_SIZE);
+
+    SIMFS_CHECK(simfsTestCreateVolume("compression.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSetCompression(SIMFS_LZ_COMPRESSION) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("compressed", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("random", random) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/compressed/", content));
+    SIMFS_CHECK(simfsTestHasContent("/random/", random));
+
+    SIMFS_STATISTICS_TYPE statistics;
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.physicalDataBlocks * SIMFS_DATA_SIZE < strlen(content) + strlen(random));
+
+    SIMFS_NAME_TYPE compressed = "/compressed/";
+    SIMFS_FILE_HANDLE_TYPE handle;
+    char part[2 * SIMFS_DATA_SIZE];
+    size_t bytesRead;
+    SIMFS_CHECK(simfsOpenFile(compressed, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReadFileAt(handle, SIMFS_COMPRESSION_CHUNK_SIZE - 5, sizeof(part), part, &bytesRead) ==
+                SIMFS_NO_ERROR);
+    SIMFS_CHECK(bytesRead == sizeof(part) &&
+                memcmp(part, content + SIMFS_COMPRESSION_CHUNK_SIZE - 5, sizeof(part)) == 0);
+    SIMFS_CHECK(simfsReadFileAt(handle, strlen(content) - 3, sizeof(part), part, &bytesRead) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(bytesRead == 3 && memcmp(part, content + strlen(content) - 3, 3) == 0);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsSetCompression(SIMFS_NO_COMPRESSION) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("plain", "stored as it is") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/compressed/", content));
+
+    SIMFS_CHECK(simfsBenchmarkCompression(4 * SIMFS_COMPRESSION_CHUNK_SIZE, 2) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsVolume->superblock.compression == SIMFS_NO_COMPRESSION);
+    SIMFS_NAME_TYPE benchmark = "/simfs_benchmark/";
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_CHECK(simfsGetFileInfo(benchmark, &info) == SIMFS_NOT_FOUND_ERROR);
+
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("compression.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("compression.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/compressed/", content));
+    SIMFS_CHECK(simfsTestHasContent("/random/", random));
+    SIMFS_CHECK(simfsTestHasContent("/plain/", "stored as it is"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("compression.simfs")) == SIMFS_NO_ERROR);
+    free(random);
+}
+
+/*
+ * Appends held in the write buffer of an open file take no blocks until they fill one, are seen by reads, and are
+ * stored when the file is flushed or closed, when a snapshot is taken, or when the volume is unmounted while the
+ * file is open; a write replaces them, and the file cannot be deleted meanwhile.
+ */
+static void simfsTestBufferedAppend()
+{
+    char content[2 * SIMFS_WRITE_BUFFER_SIZE + sizeof("flushed")] = "";
+    SIMFS_NAME_TYPE closed = "closed", closedPath = "/closed/", open = "open", openPath = "/open/";
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_STATISTICS_TYPE before, after;
+
+    SIMFS_CHECK(simfsTestCreateVolume("append.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile(closed, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(closedPath, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&before) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, "held") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == before.physicalDataBlocks);
+    strcat(content, "held");
+    while (strlen(content) < 2 * SIMFS_WRITE_BUFFER_SIZE - 7) {
+        SIMFS_CHECK(simfsAppendFile(handle, "append ") == SIMFS_NO_ERROR);
+        strcat(content, "append ");
+    }
+
+    char *readBuffer = NULL;
+    SIMFS_CHECK(simfsReadFile(handle, &readBuffer) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(readBuffer != NULL && strcmp(readBuffer, content) == 0);
+    if (readBuffer != NULL)
+        simfsReleaseReadBuffer(readBuffer);
+    SIMFS_CHECK(simfsAppendFile(handle, "flushed") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsFlushFile(handle) == SIMFS_NO_ERROR);
+    strcat(content, "flushed");
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == (strlen(content) + SIMFS_DATA_SIZE - 1) / SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/closed/", content));
+
+    SIMFS_CHECK(simfsCreateFile(open, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(openPath, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, "replaced") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "written, ") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, "then held in the buffer") == SIMFS_NO_ERROR);
+    SIMFS_NAME_TYPE snapshot = "buffered";
+    SIMFS_CHECK(simfsCreateSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("@buffered/open/", "written, then held in the buffer"));
+    SIMFS_CHECK(simfsUmountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    // the buffered bytes would be stored through the descriptor of a deleted file
+    SIMFS_CHECK(simfsDeleteFile(openPath) == SIMFS_ACCESS_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("append.simfs")) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("append.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/closed/", content));
+    SIMFS_CHECK(simfsTestHasContent("/open/", "written, then held in the buffer"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("append.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * A reservation takes one run of blocks even if the free space is fragmented and keeps the size of the file, and
+ * the content written up to the reserved size goes into the reserved blocks in place.
+ */
+static void simfsTestReserve()
+{
+    SIMFS_NAME_TYPE name, path;
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_STATISTICS_TYPE before, after;
+
+    SIMFS_CHECK(simfsTestCreateVolume("reserve.simfs") == SIMFS_NO_ERROR);
+    for (int f = 0; f < 12; f++) {
+        snprintf(name, SIMFS_MAX_NAME_LENGTH, "f%d", f);
+        SIMFS_CHECK(simfsTestWriteFile(name, "one block") == SIMFS_NO_ERROR);
+    }
+    for (int f = 0; f < 12; f += 2) {
+        snprintf(path, SIMFS_MAX_NAME_LENGTH, "/f%d/", f);
+        SIMFS_CHECK(simfsDeleteFile(path) == SIMFS_NO_ERROR);
+    }
+
+    snprintf(name, SIMFS_MAX_NAME_LENGTH, "reserved");
+    snprintf(path, SIMFS_MAX_NAME_LENGTH, "/reserved/");
+    SIMFS_CHECK(simfsCreateFile(name, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&before) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, 10 * SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(info.size == 0 && info.reserved == 10 * SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == before.physicalDataBlocks + 10);
+    SIMFS_INDEX_TYPE first = simfsTestSlot(info.block_ref, 0);
+    int contiguous = 1;
+    for (unsigned int slot = 1; slot < 10; slot++)
+        contiguous = contiguous && simfsTestSlot(info.block_ref, slot) == first + slot;
+    SIMFS_CHECK(contiguous);
+
+    char content[10 * SIMFS_DATA_SIZE + 1];
+    memset(content, 'r', 8 * SIMFS_DATA_SIZE);
+    content[8 * SIMFS_DATA_SIZE] = '\0';
+    SIMFS_CHECK(simfsWriteFile(handle, content) == SIMFS_NO_ERROR);
+    memset(content + 8 * SIMFS_DATA_SIZE, 'a', 2 * SIMFS_DATA_SIZE);
+    content[10 * SIMFS_DATA_SIZE] = '\0';
+    SIMFS_CHECK(simfsAppendFile(handle, content + 8 * SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsFlushFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == before.physicalDataBlocks + 10);
+    SIMFS_CHECK(simfsTestSlot(info.block_ref, 0) == first && simfsTestSlot(info.block_ref, 9) == first + 9);
+
+    SIMFS_CHECK(simfsWriteFile(handle, "short") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, SIMFS_NUMBER_OF_BLOCKS * SIMFS_DATA_SIZE) == SIMFS_ALLOC_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(info.size == 5 && info.reserved == 10 * SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == before.physicalDataBlocks + 10);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/reserved/", "short"));
+
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("reserve.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("reserve.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR && info.reserved == 10 * SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsDeleteFile(path) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.physicalDataBlocks == before.physicalDataBlocks);
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("reserve.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Two files that grew block by block in turns are fragmented; the defragmenter moves each into one run of blocks in
+ * slices of at most the given budget, and leaves their content alone.
+ */
+static void simfsTestDefragment()
+{
+    SIMFS_NAME_TYPE a = "a", b = "b", aPath = "/a/", bPath = "/b/";
+    SIMFS_FILE_HANDLE_TYPE aHandle, bHandle;
+    char aContent[8 * SIMFS_DATA_SIZE + 1] = "", bContent[8 * SIMFS_DATA_SIZE + 1] = "";
+    char block[SIMFS_DATA_SIZE + 1];
+
+    SIMFS_CHECK(simfsTestCreateVolume("defragment.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile(a, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile(b, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(aPath, &aHandle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(bPath, &bHandle) == SIMFS_NO_ERROR);
+    for (int i = 0; i < 8; i++) {
+        memset(block, 'a' + i, SIMFS_DATA_SIZE);
+        block[SIMFS_DATA_SIZE] = '\0';
+        SIMFS_CHECK(simfsAppendFile(aHandle, block) == SIMFS_NO_ERROR && simfsFlushFile(aHandle) == SIMFS_NO_ERROR);
+        strcat(aContent, block);
+        memset(block, 'A' + i, SIMFS_DATA_SIZE);
+        SIMFS_CHECK(simfsAppendFile(bHandle, block) == SIMFS_NO_ERROR && simfsFlushFile(bHandle) == SIMFS_NO_ERROR);
+        strcat(bContent, block);
+    }
+    SIMFS_CHECK(simfsCloseFile(aHandle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(bHandle) == SIMFS_NO_ERROR);
+
+    SIMFS_FRAGMENTATION_TYPE fragmentation;
+    SIMFS_CHECK(simfsGetFragmentation(&fragmentation) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(fragmentation.files == 2 && fragmentation.fragmentedFiles == 2);
+    SIMFS_CHECK(fragmentation.dataBlocks == 16 && fragmentation.extents > 2);
+
+    unsigned int blocksMoved, slices = 0, total = 0;
+    do {
+        SIMFS_CHECK(simfsDefragment(8, &blocksMoved) == SIMFS_NO_ERROR);
+        SIMFS_CHECK(blocksMoved <= 8);
+        total += blocksMoved;
+    } while (blocksMoved > 0 && ++slices < 10);
+    SIMFS_CHECK(slices >= 2 && total == 16);
+
+    SIMFS_CHECK(simfsGetFragmentation(&fragmentation) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(fragmentation.fragmentedFiles == 0 && fragmentation.extents == 2);
+    SIMFS_CHECK(simfsTestHasContent("/a/", aContent));
+    SIMFS_CHECK(simfsTestHasContent("/b/", bContent));
+
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("defragment.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("defragment.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/a/", aContent));
+    SIMFS_CHECK(simfsTestHasContent("/b/", bContent));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("defragment.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * A scrub verifies the checksums of all blocks and finds a block whose content changed behind the file system, which
+ * a read of the file reports, too, also after the defragmenter moved the block.
+ */
+static void simfsTestScrub()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("scrub.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("file", "content whose checksums are verified") == SIMFS_NO_ERROR);
+
+    SIMFS_SCRUB_TYPE scrub;
+    SIMFS_CHECK(simfsScrub(2, &scrub) == SIMFS_NO_ERROR && scrub.blocksVerified > 0 && scrub.checksumErrors == 0);
+
+    SIMFS_NAME_TYPE path = "/file/";
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    SIMFS_INDEX_TYPE block = simfsTestSlot(info.block_ref, 1);
+    simfsVolume->block[block].content.data[3] ^= 1;
+
+    SIMFS_CHECK(simfsScrub(2, &scrub) == SIMFS_READ_ERROR && scrub.checksumErrors == 1);
+    SIMFS_CHECK(simfsScrub(1, &scrub) == SIMFS_READ_ERROR && scrub.checksumErrors == 1);
+    SIMFS_FILE_HANDLE_TYPE handle;
+    char *readBuffer = NULL;
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReadFile(handle, &readBuffer) == SIMFS_READ_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    simfsVolume->block[block].content.data[3] ^= 1;
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsTestHasContent("/file/", "content whose checksums are verified"));
+
+    // a corrupted block moved by the defragmenter is still detected
+    SIMFS_FILE_HANDLE_TYPE other;
+    SIMFS_CHECK(simfsTestWriteFile("other", "") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/other/", &other) == SIMFS_NO_ERROR);
+    char *content = simfsGenerateContent(SIMFS_DATA_SIZE + 1);
+    for (int i = 0; i < 4; i++) {
+        SIMFS_CHECK(simfsAppendFile(handle, content) == SIMFS_NO_ERROR && simfsFlushFile(handle) == SIMFS_NO_ERROR);
+        SIMFS_CHECK(simfsAppendFile(other, content) == SIMFS_NO_ERROR && simfsFlushFile(other) == SIMFS_NO_ERROR);
+    }
+    free(content);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(other) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    block = simfsTestSlot(info.block_ref, 1);
+    simfsVolume->block[block].content.data[3] ^= 1;
+    unsigned int blocksMoved;
+    SIMFS_CHECK(simfsDefragment(SIMFS_NUMBER_OF_BLOCKS, &blocksMoved) == SIMFS_NO_ERROR && blocksMoved > 0);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR && simfsTestSlot(info.block_ref, 1) != block);
+    SIMFS_CHECK(simfsScrub(2, &scrub) == SIMFS_READ_ERROR && scrub.checksumErrors == 1);
+    simfsVolume->block[simfsTestSlot(info.block_ref, 1)].content.data[3] ^= 1;
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("scrub.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Once the pools of the arena hold what a workload needs, repeating the workload takes no more memory: directory
+ * entries, process control blocks and read buffers are handed out again after they are released.
+ */
+static void simfsTestArena()
+{
+    SIMFS_NAME_TYPE name, path;
+    SIMFS_FILE_HANDLE_TYPE handle;
+    size_t bytesReserved = 0;
+
+    SIMFS_CHECK(simfsTestCreateVolume("arena.simfs") == SIMFS_NO_ERROR);
+    for (int round = 0; round < 4; round++) {
+        for (int f = 0; f < 24; f++) {
+            snprintf(name, SIMFS_MAX_NAME_LENGTH, "f%d", f);
+            SIMFS_CHECK(simfsTestWriteFile(name, "pooled") == SIMFS_NO_ERROR);
+        }
+        for (int f = 0; f < 24; f++) {
+            snprintf(path, SIMFS_MAX_NAME_LENGTH, "/f%d/", f);
+            SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+            char *readBuffer = NULL;
+            SIMFS_CHECK(simfsReadFile(handle, &readBuffer) == SIMFS_NO_ERROR);
+            if (readBuffer != NULL)
+                simfsReleaseReadBuffer(readBuffer);
+            SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+            SIMFS_CHECK(simfsDeleteFile(path) == SIMFS_NO_ERROR);
+        }
+
+        if (round == 0)
+            bytesReserved = simfsContext->arena.bytesReserved;
+        SIMFS_CHECK(bytesReserved > 0 && simfsContext->arena.bytesReserved == bytesReserved);
+    }
+
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("arena.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Returns the descriptor of the file whose content starts with the given block.
+ */
+static SIMFS_FILE_DESCRIPTOR_TYPE *simfsTestDescriptor(SIMFS_INDEX_TYPE blockRef)
+{
+    for (int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->block[i].type == FILE_CONTENT_TYPE &&
+            simfsVolume->block[i].content.fileDescriptor.block_ref == blockRef)
+            return &simfsVolume->block[i].content.fileDescriptor;
+    return NULL;
+}
+
+/*
+ * Mounts the image of simfsTestAccessTime with the given policy, sets the times of its file, reads the file, and
+ * returns the time of the last access that the read leaves.
+ */
+static time_t simfsTestAccessTimeAfterRead(SIMFS_ATIME_TYPE atime, time_t lastAccessTime, time_t lastModificationTime)
+{
+    SIMFS_MOUNT_OPTIONS_TYPE options = { .atime = atime };
+    SIMFS_NAME_TYPE path = "/file/";
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_FILE_HANDLE_TYPE handle;
+    char *readBuffer = NULL;
+
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("atime.simfs"), &options) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    SIMFS_FILE_DESCRIPTOR_TYPE *fd = simfsTestDescriptor(info.block_ref);
+    SIMFS_CHECK(fd != NULL);
+    if (fd == NULL)
+        return 0;
+    fd->lastAccessTime = lastAccessTime;
+    fd->lastModificationTime = lastModificationTime;
+
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReadFile(handle, &readBuffer) == SIMFS_NO_ERROR);
+    if (readBuffer != NULL)
+        simfsReleaseReadBuffer(readBuffer);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    time_t accessed = fd->lastAccessTime;
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("atime.simfs")) == SIMFS_NO_ERROR);
+    return accessed;
+}
+
+/*
+ * strictatime records every access, noatime none, and relatime only the first access after a modification and then
+ * once a day; timestamps from the coarse clock are within a tick of the precise ones. Read-only files and files of
+ * snapshots keep their access times.
+ */
+static void simfsTestAccessTime()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("atime.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("file", "read") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("atime.simfs")) == SIMFS_NO_ERROR);
+
+    time_t now = time(NULL);
+    SIMFS_CHECK(simfsTestAccessTimeAfterRead(SIMFS_NOATIME, now - 100, now - 10) == now - 100);
+    SIMFS_CHECK(simfsTestAccessTimeAfterRead(SIMFS_STRICTATIME, now - 10, now - 100) >= now);
+    SIMFS_CHECK(simfsTestAccessTimeAfterRead(SIMFS_RELATIME, now - 10, now - 100) == now - 10);
+    SIMFS_CHECK(simfsTestAccessTimeAfterRead(SIMFS_RELATIME, now - 100, now - 10) >= now);
+    SIMFS_CHECK(simfsTestAccessTimeAfterRead(SIMFS_RELATIME, now - 2 * 24 * 60 * 60, now - 3 * 24 * 60 * 60) >= now);
+
+    SIMFS_MOUNT_OPTIONS_TYPE options = { .atime = SIMFS_RELATIME, .coarseClock = 1 };
+    SIMFS_NAME_TYPE name = "coarse", path = "/coarse/";
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("atime.simfs"), &options) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile(name, FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo(path, &info) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(info.creationTime >= now - 1 && info.creationTime <= time(NULL));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("atime.simfs")) == SIMFS_NO_ERROR);
+
+    // neither a file without write permission nor a file of a snapshot gets a new access time
+    options.atime = SIMFS_STRICTATIME;
+    SIMFS_NAME_TYPE snapshot = "s";
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("atime.simfs"), &options) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    for (int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->block[i].type == FILE_CONTENT_TYPE) {
+            SIMFS_FILE_DESCRIPTOR_TYPE *fd = &simfsVolume->block[i].content.fileDescriptor;
+            fd->lastAccessTime = now - 100;
+            if (fd->parent == simfsVolume->superblock.rootNodeIndex)
+                fd->accessRights &= ~0200;
+        }
+    SIMFS_CHECK(simfsTestHasContent("/file/", "read"));
+    SIMFS_CHECK(simfsTestHasContent("@s/file/", "read"));
+    for (int i = 0; i < SIMFS_NUMBER_OF_BLOCKS; i++)
+        if (simfsVolume->block[i].type == FILE_CONTENT_TYPE)
+            SIMFS_CHECK(simfsVolume->block[i].content.fileDescriptor.lastAccessTime == now - 100);
+    SIMFS_CHECK(simfsUmountSnapshot(snapshot) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("atime.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Returns the number of the file "f<number>" listed under the given name, or -1 for another name.
+ */
+static int simfsTestListedFile(char *name)
+{
+    int number;
+    return sscanf(name + (name[0] == '/'), "f%d", &number) == 1 && number >= 0 && number < 10 ? number : -1;
+}
+
+/*
+ * A listing in pages returns every child once, and the plus variant returns their descriptors, with the bytes still
+ * buffered for an open file in its size.
+ */
+static void simfsTestReadDirectory()
+{
+    SIMFS_NAME_TYPE name, root = "/", missing = "/missing/";
+    char content[11] = "0123456789";
+
+    SIMFS_CHECK(simfsTestCreateVolume("directory.simfs") == SIMFS_NO_ERROR);
+    for (int f = 0; f < 10; f++) {
+        snprintf(name, SIMFS_MAX_NAME_LENGTH, "f%d", f);
+        content[f + 1] = '\0';
+        SIMFS_CHECK(simfsTestWriteFile(name, content) == SIMFS_NO_ERROR);
+        content[f + 1] = '0' + f + 1;
+    }
+
+    SIMFS_DIRECTORY_CURSOR_TYPE cursor = 0;
+    SIMFS_NAME_TYPE names[3];
+    int count, pages = 0, listed[10] = { 0 };
+    while (cursor != SIMFS_DIRECTORY_END && pages++ < 10) {
+        SIMFS_CHECK(simfsReadDirectory(root, &cursor, names, 3, &count) == SIMFS_NO_ERROR);
+        SIMFS_CHECK(count == 3 || (count == 1 && cursor == SIMFS_DIRECTORY_END));
+        for (int i = 0; i < count; i++)
+            if (simfsTestListedFile(names[i]) >= 0)
+                listed[simfsTestListedFile(names[i])]++;
+    }
+    SIMFS_CHECK(pages == 4);
+    for (int f = 0; f < 10; f++)
+        SIMFS_CHECK(listed[f] == 1);
+
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_NAME_TYPE path = "/f0/";
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, "buffered") == SIMFS_NO_ERROR);
+
+    SIMFS_FILE_DESCRIPTOR_TYPE infos[4];
+    cursor = 0;
+    pages = 0;
+    memset(listed, 0, sizeof(listed));
+    while (cursor != SIMFS_DIRECTORY_END && pages++ < 10) {
+        SIMFS_CHECK(simfsReadDirectoryPlus(root, &cursor, infos, 4, &count) == SIMFS_NO_ERROR);
+        for (int i = 0; i < count; i++) {
+            int f = simfsTestListedFile(infos[i].name);
+            if (f < 0)
+                continue;
+            listed[f]++;
+            SIMFS_CHECK(infos[i].type == FILE_CONTENT_TYPE);
+            SIMFS_CHECK(infos[i].size == (f == 0 ? 1 + strlen("buffered") : (size_t) f + 1));
+        }
+    }
+    SIMFS_CHECK(pages == 3);
+    for (int f = 0; f < 10; f++)
+        SIMFS_CHECK(listed[f] == 1);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    cursor = 0;
+    SIMFS_CHECK(simfsReadDirectory(missing, &cursor, names, 3, &count) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("directory.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Renaming moves a file or a folder with its content and its descendants, keeps open handles valid, and does not
+ * replace an existing file or move a folder into itself.
+ */
+static void simfsTestRename()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("rename.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/from", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/to", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/to/below", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("other", "in the way") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsRename("/other", "/to/other") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/from/file", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile("/from/file", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "moved") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsRename("/from/file", "/to/file") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, " while open") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/to/file", "moved while open"));
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_CHECK(simfsGetFileInfo("/from/file", &info) == SIMFS_NOT_FOUND_ERROR);
+
+    SIMFS_CHECK(simfsRename("/to/file", "/to/other") == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsRename("/nowhere", "/to/somewhere") == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsRename("/to/file", "/nowhere/file") == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsRename("/to", "/to/below/to") == SIMFS_ACCESS_ERROR);
+    SIMFS_CHECK(simfsRename("/to", "/from/to") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/from/to/file", "moved while open"));
+    SIMFS_CHECK(simfsTestHasContent("/from/to/other", "in the way"));
+    SIMFS_CHECK(simfsGetFileInfo("/from/to/below", &info) == SIMFS_NO_ERROR && info.type == FOLDER_CONTENT_TYPE);
+    SIMFS_CHECK(simfsTestScrubIsClean());
+
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("rename.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("rename.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/from/to/file", "moved while open"));
+    SIMFS_CHECK(simfsGetFileInfo("/to", &info) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("rename.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * A volume striped across three files spreads its blocks over all of them, reads back after a remount, and does not
+ * mount from members in another order, from some of them only, with a member of another volume, or with a member
+ * left from an earlier sync; no volume is created or mounted while one is mounted.
+ */
+static void simfsTestStriping()
+{
+    char members[5][PATH_MAX];
+    char *names[3], *reordered[3], *foreign[3], *stale[3];
+    for (int m = 0; m < 5; m++)
+        snprintf(members[m], PATH_MAX, "%s/stripe%d.simfs", simfsTestFolder, m);
+    for (int m = 0; m < 3; m++) {
+        names[m] = members[m];
+        reordered[m] = members[(m + 1) % 3];
+        foreign[m] = members[m == 2 ? 3 : m];
+        stale[m] = members[m == 1 ? 4 : m];
+    }
+    char *content = simfsGenerateContent(40 * SIMFS_DATA_SIZE);
+
+    SIMFS_CHECK(simfsCreateStripedFileSystem(names, 3) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFileSystem(members[3]) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountStripedFileSystem(names, 3, NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountStripedFileSystem(names, 3, NULL) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsCreateFileSystem(members[4]) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/striped", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("striped2", "small") == SIMFS_NO_ERROR);
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile("/striped", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSyncFileSystem() == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountStripedFileSystem(names, 3) == SIMFS_NO_ERROR);
+
+    struct stat status[3];
+    for (int m = 0; m < 3; m++)
+        SIMFS_CHECK(stat(members[m], &status[m]) == 0);
+    for (int m = 0; m < 3; m++)
+        SIMFS_CHECK(status[m].st_size < (off_t) sizeof(SIMFS_VOLUME) / 2);
+
+    SIMFS_CHECK(simfsMountStripedFileSystem(reordered, 3, NULL) == SIMFS_READ_ERROR);
+    SIMFS_CHECK(simfsMountStripedFileSystem(names, 2, NULL) == SIMFS_READ_ERROR);
+    SIMFS_CHECK(simfsMountStripedFileSystem(foreign, 3, NULL) == SIMFS_READ_ERROR);
+
+    SIMFS_CHECK(simfsMountStripedFileSystem(names, 3, NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/striped", content));
+    SIMFS_CHECK(simfsTestHasContent("/striped2", "small"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(rename(members[1], members[4]) == 0);
+    SIMFS_CHECK(simfsUmountStripedFileSystem(names, 3) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountStripedFileSystem(stale, 3, NULL) == SIMFS_READ_ERROR);
+    free(content);
+}
+
+/*
+ * Reads the whole file at the given path into an allocated buffer; returns NULL if it cannot be read.
+ */
+static char *simfsTestLoadFile(char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    char *bytes = malloc(*size > 0 ? *size : 1);
+    if (bytes != NULL && fread(bytes, 1, *size, file) != (size_t) *size) {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+/*
+ * A traced workload with a sync replays against a copy of the image taken before it, twice, without changing the
+ * copy; a file that is not a trace is refused, and so is a replay while a volume is mounted.
+ */
+static void simfsTestTrace()
+{
+    char trace[PATH_MAX], image[PATH_MAX], replay[PATH_MAX];
+    snprintf(trace, PATH_MAX, "%s", simfsTestPath("workload.trace"));
+    snprintf(image, PATH_MAX, "%s", simfsTestPath("trace.simfs"));
+    snprintf(replay, PATH_MAX, "%s", simfsTestPath("replay.simfs"));
+
+    SIMFS_CHECK(simfsCreateFileSystem(image) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFileSystem(replay) == SIMFS_NO_ERROR);
+    long replaySize;
+    char *replayBytes = simfsTestLoadFile(replay, &replaySize);
+    SIMFS_CHECK(replayBytes != NULL);
+
+    SIMFS_CHECK(simfsMountFileSystem(image, NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsStopTrace() == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsStartTrace(trace) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsStartTrace(trace) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/traced", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/traced/file", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile("/traced/file", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "traced content") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, " and more") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsRename("/traced/file", "/traced/renamed") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsDeleteFile("/traced/missing") == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/traced/renamed", "traced content and more"));
+    SIMFS_CHECK(simfsSyncFileSystem() == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsStopTrace() == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsReplayTrace(trace, replay, 0) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(image) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsReplayTrace(trace, replay, 0) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReplayTrace(trace, replay, 1) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReplayTrace(image, replay, 0) == SIMFS_READ_ERROR);
+    long size;
+    char *bytes = simfsTestLoadFile(replay, &size);
+    SIMFS_CHECK(bytes != NULL && size == replaySize && memcmp(bytes, replayBytes, size) == 0);
+    free(bytes);
+    free(replayBytes);
+}
+
+/*
+ * Writes a host file with the given content.
+ */
+static int simfsTestWriteHostFile(char *path, char *content)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return 0;
+    size_t written = fwrite(content, 1, strlen(content), file);
+    return (fclose(file) == 0) & (written == strlen(content));
+}
+
+/*
+ * A host tree with empty and multi-block files and nested folders is imported into a new image, reads back through
+ * the volume, and exports to a host tree that is the same as the original; no tree is imported over a mounted volume.
+ */
+static void simfsTestImportExport()
+{
+    char host[PATH_MAX], image[PATH_MAX], command[4 * PATH_MAX];
+    snprintf(host, PATH_MAX, "%s", simfsTestPath("host"));
+    snprintf(image, PATH_MAX, "%s", simfsTestPath("import.simfs"));
+    snprintf(command, sizeof(command), "rm -rf '%s' '%s'", host, simfsTestPath("export"));
+    SIMFS_CHECK(system(command) == 0);
+
+    char *content = simfsGenerateContent(10 * SIMFS_DATA_SIZE + 3);
+    SIMFS_CHECK(mkdir(host, 0755) == 0);
+    SIMFS_CHECK(mkdir(simfsTestPath("host/sub"), 0755) == 0);
+    SIMFS_CHECK(mkdir(simfsTestPath("host/sub/deep"), 0755) == 0);
+    SIMFS_CHECK(simfsTestWriteHostFile(simfsTestPath("host/small"), "small"));
+    SIMFS_CHECK(simfsTestWriteHostFile(simfsTestPath("host/sub/large"), content));
+    SIMFS_CHECK(simfsTestWriteHostFile(simfsTestPath("host/sub/deep/empty"), ""));
+
+    SIMFS_CHECK(simfsImportTree(simfsTestPath("host/small"), image, 2) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsImportTree(host, image, 2) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsMountFileSystem(image, NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsImportTree(host, simfsTestPath("again.simfs"), 2) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/small", "small"));
+    SIMFS_CHECK(simfsTestHasContent("/sub/large", content));
+    SIMFS_CHECK(simfsTestHasContent("/sub/deep/empty", ""));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+
+    SIMFS_CHECK(simfsExportTree("/missing", simfsTestPath("export")) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsExportTree("/", simfsTestPath("export")) == SIMFS_NO_ERROR);
+    snprintf(command, sizeof(command), "diff -r '%s' '%s'", host, simfsTestPath("export"));
+    SIMFS_CHECK(system(command) == 0);
+    SIMFS_CHECK(simfsUmountFileSystem(image) == SIMFS_NO_ERROR);
+    free(content);
+}
+
+/*
+ * Returns 1 if the file keeps the blocks reserved for it at the given slots after its content is replaced.
+ */
+static int simfsTestKeepsReservation(char *fileName, char *content, unsigned int slots)
+{
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_INDEX_TYPE reserved[SIMFS_INDEX_SIZE];
+
+    if (simfsGetFileInfo(fileName, &info) != SIMFS_NO_ERROR || simfsOpenFile(fileName, &handle) != SIMFS_NO_ERROR)
+        return 0;
+    for (unsigned int slot = 0; slot < slots; slot++)
+        reserved[slot] = simfsTestSlot(info.block_ref, slot);
+    int kept = simfsWriteFile(handle, content) == SIMFS_NO_ERROR;
+    kept &= simfsCloseFile(handle) == SIMFS_NO_ERROR;
+    kept &= simfsGetFileInfo(fileName, &info) == SIMFS_NO_ERROR && info.reserved == slots * SIMFS_DATA_SIZE;
+    for (unsigned int slot = 0; slot < slots && kept; slot++)
+        kept = simfsTestSlot(info.block_ref, slot) == reserved[slot];
+    return kept && simfsTestHasContent(fileName, content);
+}
+
+/*
+ * Returns 1 if one of the first slots of a chain holds a block that is also in one of the first slots of another.
+ */
+static int simfsTestSharesBlocks(SIMFS_INDEX_TYPE chain, SIMFS_INDEX_TYPE otherChain, unsigned int slots)
+{
+    for (unsigned int slot = 0; slot < slots; slot++)
+        for (unsigned int otherSlot = 0; otherSlot < slots; otherSlot++)
+            if (simfsTestSlot(chain, slot) != 0 && simfsTestSlot(chain, slot) == simfsTestSlot(otherChain, otherSlot))
+                return 1;
+    return 0;
+}
+
+/*
+ * A write into reserved space stays in the reserved blocks when its blocks match others with deduplication on,
+ * and other files do not come to share them; it also stays there when the compression of the volume was changed
+ * since the reservation, and on a log-structured volume.
+ */
+static void simfsTestReserveModes()
+{
+    char content[3 * SIMFS_DATA_SIZE + 1];
+    memset(content, 'r', 3 * SIMFS_DATA_SIZE);
+    content[3 * SIMFS_DATA_SIZE] = '\0';
+    SIMFS_FILE_HANDLE_TYPE handle;
+
+    SIMFS_CHECK(simfsTestCreateVolume("reservemodes.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/same", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/reserved", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/reserved", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, 4 * SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSetDeduplication(1) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestKeepsReservation("/reserved", content, 4));
+    // other files with the same content do not share the reserved blocks, also once the index is rebuilt
+    SIMFS_FILE_DESCRIPTOR_TYPE reservedInfo, info;
+    SIMFS_CHECK(simfsTestWriteFile("/later", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo("/reserved", &reservedInfo) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo("/later", &info) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(!simfsTestSharesBlocks(info.block_ref, reservedInfo.block_ref, 4));
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("reservemodes.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("reservemodes.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsDeleteFile("/same") == SIMFS_NO_ERROR && simfsDeleteFile("/later") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/remounted", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetFileInfo("/remounted", &info) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(!simfsTestSharesBlocks(info.block_ref, reservedInfo.block_ref, 4));
+    SIMFS_CHECK(simfsTestKeepsReservation("/reserved", "rewritten", 4));
+    SIMFS_CHECK(simfsSetDeduplication(0) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSetCompression(SIMFS_LZ_COMPRESSION) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestKeepsReservation("/reserved", "rewritten", 4));
+    SIMFS_CHECK(simfsSetCompression(SIMFS_NO_COMPRESSION) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("reservemodes.simfs")) == SIMFS_NO_ERROR);
+
+    char *members[1] = { simfsTestPath("reservelog.simfs") };
+    SIMFS_CHECK(simfsCreateLogStructuredFileSystem(members, 1) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(members[0], NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/reserved", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/reserved", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, 4 * SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestKeepsReservation("/reserved", content, 4));
+    SIMFS_CHECK(simfsTestKeepsReservation("/reserved", "rewritten", 4));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("reservelog.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * Writes past the end leave holes that read as zeros and take no blocks, seeks find the data and the holes, and
+ * truncation shrinks and grows a file; a positional write into compressed content keeps the rest of it.
+ */
+static void simfsTestHoles()
+{
+    SIMFS_FILE_HANDLE_TYPE handle;
+    char buffer[8 * SIMFS_DATA_SIZE];
+    size_t bytesRead, offset;
+    SIMFS_STATISTICS_TYPE statistics;
+
+    SIMFS_CHECK(simfsTestCreateVolume("holes.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/sparse", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/sparse", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFileAt(handle, 0, "head", 4) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFileAt(handle, 6 * SIMFS_DATA_SIZE, "tail", 4) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.physicalDataBlocks == 2);
+
+    SIMFS_CHECK(simfsReadFileAt(handle, 0, sizeof(buffer), buffer, &bytesRead) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(bytesRead == 6 * SIMFS_DATA_SIZE + 4);
+    SIMFS_CHECK(memcmp(buffer, "head", 4) == 0 && memcmp(buffer + 6 * SIMFS_DATA_SIZE, "tail", 4) == 0);
+    int zeros = 1;
+    for (int i = 4; i < 6 * SIMFS_DATA_SIZE; i++)
+        zeros = zeros && buffer[i] == '\0';
+    SIMFS_CHECK(zeros);
+
+    SIMFS_CHECK(simfsSeekFile(handle, 0, SIMFS_SEEK_HOLE, &offset) == SIMFS_NO_ERROR && offset == SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsSeekFile(handle, SIMFS_DATA_SIZE, SIMFS_SEEK_DATA, &offset) == SIMFS_NO_ERROR &&
+                offset == 6 * SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsSeekFile(handle, 6 * SIMFS_DATA_SIZE, SIMFS_SEEK_HOLE, &offset) == SIMFS_NO_ERROR &&
+                offset == 6 * SIMFS_DATA_SIZE + 4);
+    SIMFS_CHECK(simfsSeekFile(handle, 7 * SIMFS_DATA_SIZE, SIMFS_SEEK_DATA, &offset) == SIMFS_NOT_FOUND_ERROR);
+
+    SIMFS_CHECK(simfsTruncateFile(handle, 2) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTruncateFile(handle, 3 * SIMFS_DATA_SIZE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.physicalDataBlocks == 1);
+    SIMFS_CHECK(simfsReadFileAt(handle, 0, sizeof(buffer), buffer, &bytesRead) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(bytesRead == 3 * SIMFS_DATA_SIZE && memcmp(buffer, "he\0\0", 4) == 0 && buffer[bytesRead - 1] == '\0');
+    SIMFS_CHECK(simfsSeekFile(handle, SIMFS_DATA_SIZE, SIMFS_SEEK_DATA, &offset) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    SIMFS_CHECK(simfsGetFileInfo("/sparse", &info) == SIMFS_NO_ERROR && info.size == 3 * SIMFS_DATA_SIZE);
+    // a positional write into compressed content rewrites only the chunk it falls into
+    char *content = simfsGenerateContent(4 * SIMFS_DATA_SIZE);
+    SIMFS_CHECK(simfsSetCompression(SIMFS_LZ_COMPRESSION) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/compressed", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/compressed", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFileAt(handle, SIMFS_DATA_SIZE + 1, "patched", 7) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    memcpy(content + SIMFS_DATA_SIZE + 1, "patched", 7);
+    SIMFS_CHECK(simfsTestHasContent("/compressed", content));
+    SIMFS_CHECK(simfsSetCompression(SIMFS_NO_COMPRESSION) == SIMFS_NO_ERROR);
+    free(content);
+
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("holes.simfs")) == SIMFS_NO_ERROR);
+}
+
+/*
+ * A second process attaches to a shared mount, reads and writes on it, and detaches; the volume is not unmounted
+ * while the process is attached, and it cannot be attached to once it is unmounted.
+ */
+static void simfsTestSharedMount()
+{
+    int toChild[2], toParent[2];
+    char token = 0;
+    SIMFS_CHECK(pipe(toChild) == 0 && pipe(toParent) == 0);
+    SIMFS_MOUNT_OPTIONS_TYPE options = { .atime = SIMFS_RELATIME };
+    snprintf(options.sharedName, sizeof(options.sharedName), "/simfs-test-%d", getpid());
+
+    pid_t child = fork();
+    if (child == 0) {
+        int failures = simfsTestFailures;
+        SIMFS_CHECK(read(toChild[0], &token, 1) == 1);
+        SIMFS_CHECK(simfsAttachSharedFileSystem(options.sharedName) == SIMFS_NO_ERROR);
+        SIMFS_CHECK(simfsTestHasContent("/parent", "from the parent"));
+        SIMFS_CHECK(simfsTestWriteFile("/child", "from the child") == SIMFS_NO_ERROR);
+        SIMFS_CHECK(write(toParent[1], &token, 1) == 1);
+        SIMFS_CHECK(read(toChild[0], &token, 1) == 1);
+        SIMFS_CHECK(simfsDetachSharedFileSystem() == SIMFS_NO_ERROR);
+        SIMFS_CHECK(simfsDetachSharedFileSystem() == SIMFS_NOT_FOUND_ERROR);
+        fflush(stdout);
+        _exit(simfsTestFailures > failures);
+    }
+
+    SIMFS_CHECK(simfsCreateFileSystem(simfsTestPath("shared.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("shared.simfs"), &options) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAttachSharedFileSystem(options.sharedName) == SIMFS_DUPLICATE_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/parent", "from the parent") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(write(toChild[1], &token, 1) == 1);
+    SIMFS_CHECK(read(toParent[0], &token, 1) == 1);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("shared.simfs")) == SIMFS_NOT_EMPTY_ERROR);
+    SIMFS_CHECK(write(toChild[1], &token, 1) == 1);
+
+    int status;
+    SIMFS_CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    SIMFS_CHECK(simfsTestHasContent("/child", "from the child"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("shared.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAttachSharedFileSystem(options.sharedName) == SIMFS_NOT_FOUND_ERROR);
+
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("shared.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/child", "from the child"));
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("shared.simfs")) == SIMFS_NO_ERROR);
+    for (int end = 0; end < 2; end++) {
+        close(toChild[end]);
+        close(toParent[end]);
+    }
+}
+
+/*
+ * Rewriting some blocks of a file on a log-structured volume much more often than others leaves its segments partly
+ * live; a slice of the cleaner then moves their live blocks and makes them clean, and the file reads back, also
+ * after a remount.
+ */
+static void simfsTestLogStructured()
+{
+    char *members[1] = { simfsTestPath("log.simfs") };
+    SIMFS_CHECK(simfsCreateLogStructuredFileSystem(members, 1) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(members[0], NULL) == SIMFS_NO_ERROR);
+
+    char *content = simfsGenerateContent(30 * SIMFS_DATA_SIZE);
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsCreateFile("/log", FILE_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsOpenFile("/log", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, content) == SIMFS_NO_ERROR);
+    for (int i = 0; i < 1000; i++) {
+        // every 16th write goes to a cold slot, which outlives the writes to the hot slots around it in the log
+        size_t offset = (i % 16 == 0 ? 15 + i / 16 % 15 : i % 15) * SIMFS_DATA_SIZE;
+        content[offset] = 'a' + i % 26;
+        SIMFS_CHECK(simfsWriteFileAt(handle, offset, content + offset, 1) == SIMFS_NO_ERROR);
+    }
+
+    SIMFS_STATISTICS_TYPE before, after;
+    unsigned int blocksMoved;
+    SIMFS_CHECK(simfsGetStatistics(&before) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCleanSegments(SIMFS_NUMBER_OF_BLOCKS, &blocksMoved) == SIMFS_NO_ERROR && blocksMoved > 0);
+    SIMFS_CHECK(simfsGetStatistics(&after) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(after.blocksCleaned == before.blocksCleaned + blocksMoved);
+    SIMFS_CHECK(after.cleanSegments > before.cleanSegments);
+    SIMFS_CHECK(after.freeBlocks == before.freeBlocks);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestHasContent("/log", content));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(members[0]) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(members[0], NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/log", content));
+    SIMFS_CHECK(simfsUmountFileSystem(members[0]) == SIMFS_NO_ERROR);
+    free(content);
+}
+
+/*
+ * Returns the seconds it takes to read the first bytes of an open file the given number of times.
+ */
+static double simfsTestTimeReads(SIMFS_FILE_HANDLE_TYPE handle, int reads, size_t bytes)
+{
+    char buffer[256];
+    size_t bytesRead;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < reads; i++)
+        SIMFS_CHECK(simfsReadFileAt(handle, 0, bytes, buffer, &bytesRead) == SIMFS_NO_ERROR && bytesRead == bytes);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * The scheduler keeps the share set for a process and counts its calls and bytes, and a byte-rate cap spaces out
+ * the calls of the process by their cost.
+ */
+static void simfsTestIoShare()
+{
+    SIMFS_IO_STATISTICS_TYPE statistics;
+    SIMFS_CHECK(simfsTestCreateVolume("share.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetIoStatistics(0, &statistics) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsSetIoShare(0, 0, 0) == SIMFS_ACCESS_ERROR);
+    SIMFS_CHECK(simfsSetIoShare(0, 3, 0) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetIoStatistics(0, &statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.weight == 3 && statistics.rateLimit == 0 && statistics.requests == 0);
+
+    char *content = simfsGenerateContent(200 + 1);
+    SIMFS_CHECK(simfsTestWriteFile("/shared", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsGetIoStatistics(getpid(), &statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.requests == 2 && statistics.bytes == 200 && statistics.queueDepth == 0);
+
+    // six calls of 200 bytes capped at the rate of two and a half such calls per second take two seconds
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile("/shared", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSetIoShare(0, 3, 5 * (200 + SIMFS_IO_REQUEST_COST) / 2) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestTimeReads(handle, 6, 200) >= 1.9);
+    SIMFS_CHECK(simfsSetIoShare(0, 3, 0) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestTimeReads(handle, 6, 200) < 1.0);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsGetIoStatistics(0, &statistics) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(statistics.requests == 14 && statistics.bytes == 200 + 12 * 200);
+    SIMFS_CHECK(statistics.totalLatency >= statistics.totalWait && statistics.maxLatency <= statistics.totalLatency);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("share.simfs")) == SIMFS_NO_ERROR);
+    free(content);
+}
+
+/*
+ * Returns the usage of the subtree at the given path, as kept in its descriptor.
+ */
+static SIMFS_USAGE_TYPE simfsTestUsage(char *fileName)
+{
+    SIMFS_FILE_DESCRIPTOR_TYPE info;
+    memset(&info, 0, sizeof(info));
+    SIMFS_CHECK(simfsGetFileInfo(fileName, &info) == SIMFS_NO_ERROR);
+    return info.usage;
+}
+
+/*
+ * Returns the free blocks of the mounted volume.
+ */
+static unsigned int simfsTestFreeBlocks()
+{
+    SIMFS_STATISTICS_TYPE statistics;
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    return statistics.freeBlocks;
+}
+
+/*
+ * The usage of a folder adds up the usage of what it holds, follows a file that is written, appended to, moved, and
+ * deleted, and accounts for every block taken from or given back to the volume.
+ */
+static void simfsTestUsageAggregates()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("usage.simfs") == SIMFS_NO_ERROR);
+    SIMFS_USAGE_TYPE root = simfsTestUsage("/");
+    SIMFS_CHECK(root.files == 0 && root.folders == 1 && root.bytes == 0);
+    // the blocks of the tree and the free blocks are the volume without its superblock and bitvector
+    unsigned int blocks = root.blocks + simfsTestFreeBlocks();
+
+    char *content = simfsGenerateContent(3 * SIMFS_DATA_SIZE + 2);
+    size_t length = strlen(content);
+    SIMFS_CHECK(simfsCreateFile("/a", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/a/deep", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/b", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/a/deep/f", content) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/a/g", "small") == SIMFS_NO_ERROR);
+
+    SIMFS_USAGE_TYPE f = simfsTestUsage("/a/deep/f"), g = simfsTestUsage("/a/g");
+    SIMFS_USAGE_TYPE deep = simfsTestUsage("/a/deep"), a = simfsTestUsage("/a"), b = simfsTestUsage("/b");
+    SIMFS_CHECK(f.bytes == length && f.files == 1 && f.folders == 0 && f.blocks >= 1 + 4);
+    SIMFS_CHECK(g.bytes == 5 && g.files == 1 && g.blocks >= 2);
+    SIMFS_CHECK(deep.bytes == length && deep.files == 1 && deep.folders == 1 && deep.blocks > f.blocks);
+    SIMFS_CHECK(a.bytes == length + 5 && a.files == 2 && a.folders == 2 && a.blocks > deep.blocks + g.blocks);
+    root = simfsTestUsage("/");
+    SIMFS_CHECK(root.bytes == a.bytes && root.files == 2 && root.folders == 4);
+    SIMFS_CHECK(root.blocks + simfsTestFreeBlocks() == blocks);
+
+    // buffered appends count once they are stored
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile("/a/g", &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, " and more") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsFlushFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestUsage("/a/g").bytes == 14 && simfsTestUsage("/").bytes == length + 14);
+    SIMFS_CHECK(simfsTestUsage("/").blocks + simfsTestFreeBlocks() == blocks);
+
+    // a moved subtree takes its totals from its old ancestors to the new ones
+    a = simfsTestUsage("/a");
+    SIMFS_CHECK(simfsRename("/a/deep", "/b/deep") == SIMFS_NO_ERROR);
+    SIMFS_USAGE_TYPE movedA = simfsTestUsage("/a"), movedB = simfsTestUsage("/b");
+    SIMFS_CHECK(movedA.bytes == a.bytes - deep.bytes && movedA.files == 1 && movedA.folders == 1);
+    SIMFS_CHECK(movedB.bytes == deep.bytes && movedB.files == 1 && movedB.folders == 2);
+    SIMFS_CHECK(movedA.blocks + movedB.blocks == a.blocks + b.blocks);
+    SIMFS_CHECK(simfsTestUsage("/").blocks + simfsTestFreeBlocks() == blocks);
+
+    SIMFS_CHECK(simfsDeleteFile("/b/deep/f") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestUsage("/b").bytes == 0 && simfsTestUsage("/b").files == 0);
+    SIMFS_CHECK(simfsTestUsage("/b").blocks == movedB.blocks - f.blocks);
+    root = simfsTestUsage("/");
+    SIMFS_CHECK(root.bytes == 14 && root.files == 1 && root.blocks + simfsTestFreeBlocks() == blocks);
+
+    // the totals are saved with the metadata
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("usage.simfs")) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsMountFileSystem(simfsTestPath("usage.simfs"), NULL) == SIMFS_NO_ERROR);
+    SIMFS_USAGE_TYPE remounted = simfsTestUsage("/");
+    SIMFS_CHECK(remounted.bytes == root.bytes && remounted.files == root.files && remounted.folders == root.folders &&
+                remounted.blocks == root.blocks);
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("usage.simfs")) == SIMFS_NO_ERROR);
+    free(content);
+}
+
+/*
+ * Returns 1 if receiving the stream without its last bytes fails with SIMFS_READ_ERROR and leaves the replica as
+ * it was, without a partly received file next to it.
+ */
+static int simfsTestReceiveDamaged(char *streamFileName, char *replica)
+{
+    char damagedFileName[PATH_MAX], receivedFileName[PATH_MAX];
+    snprintf(damagedFileName, sizeof(damagedFileName), "%s", simfsTestPath("damaged.stream"));
+    snprintf(receivedFileName, sizeof(receivedFileName), "%s.receive", replica);
+
+    long streamSize, replicaSize, size;
+    char *stream = simfsTestLoadFile(streamFileName, &streamSize);
+    char *replicaBytes = simfsTestLoadFile(replica, &replicaSize);
+    FILE *damaged = fopen(damagedFileName, "wb");
+    int refused = stream != NULL && replicaBytes != NULL && damaged != NULL &&
+                  fwrite(stream, 1, streamSize - 10, damaged) == (size_t) streamSize - 10;
+    if (damaged != NULL)
+        refused &= fclose(damaged) == 0;
+
+    refused = refused && simfsReceive(damagedFileName, replica) == SIMFS_READ_ERROR;
+    char *bytes = simfsTestLoadFile(replica, &size);
+    refused = refused && bytes != NULL && size == replicaSize && memcmp(bytes, replicaBytes, size) == 0 &&
+              access(receivedFileName, F_OK) != 0;
+    free(bytes);
+    free(replicaBytes);
+    free(stream);
+    return refused;
+}
+
+/*
+ * A full stream and an incremental one received into a replica give a volume that mounts with the content of the
+ * source, and a damaged stream, full or incremental, leaves the replica as it was.
+ */
+static void simfsTestSendReceive()
+{
+    char source[PATH_MAX], replica[PATH_MAX], full[PATH_MAX], incremental[PATH_MAX];
+    snprintf(source, sizeof(source), "%s", simfsTestPath("source.simfs"));
+    snprintf(replica, sizeof(replica), "%s", simfsTestPath("replica.simfs"));
+    snprintf(full, sizeof(full), "%s", simfsTestPath("full.stream"));
+    snprintf(incremental, sizeof(incremental), "%s", simfsTestPath("incremental.stream"));
+    unlink(replica);
+
+    SIMFS_CHECK(simfsTestCreateVolume("source.simfs") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsCreateFile("/d", FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("/d/first", "sent in the full stream") == SIMFS_NO_ERROR);
+
+    SIMFS_STATISTICS_TYPE statistics;
+    SIMFS_CHECK(simfsGetStatistics(&statistics) == SIMFS_NO_ERROR);
+    unsigned int generation = statistics.generation + 1;
+    SIMFS_CHECK(simfsSend(0, generation, full) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsReceive(full, replica) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestWriteFile("/d/second", "sent in the incremental stream") == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsSend(generation, generation + 1, incremental) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsUmountFileSystem(source) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestReceiveDamaged(full, replica));
+    SIMFS_CHECK(simfsTestReceiveDamaged(incremental, replica));
+
+    SIMFS_CHECK(simfsReceive(incremental, replica) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsMountFileSystem(replica, NULL) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestHasContent("/d/first", "sent in the full stream"));
+    SIMFS_CHECK(simfsTestHasContent("/d/second", "sent in the incremental stream"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(replica) == SIMFS_NO_ERROR);
+}
+
+/*
+ * The index chain of a folder holds its children, so a folder opened as a file cannot be read, seeked in, written,
+ * appended to, reserved for, or truncated.
+ */
+static void simfsTestFolderHandle()
+{
+    SIMFS_CHECK(simfsTestCreateVolume("folder.simfs") == SIMFS_NO_ERROR);
+    SIMFS_NAME_TYPE folder = "d";
+    SIMFS_CHECK(simfsCreateFile(folder, FOLDER_CONTENT_TYPE) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsTestWriteFile("file", "still there") == SIMFS_NO_ERROR);
+
+    SIMFS_NAME_TYPE path = "/d/";
+    SIMFS_FILE_HANDLE_TYPE handle;
+    SIMFS_CHECK(simfsOpenFile(path, &handle) == SIMFS_NO_ERROR);
+    SIMFS_CHECK(simfsWriteFile(handle, "over the children") == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsAppendFile(handle, "after the children") == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsReserve(handle, 10 * SIMFS_DATA_SIZE) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsWriteFileAt(handle, 0, "x", 1) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsTruncateFile(handle, 0) == SIMFS_NOT_FOUND_ERROR);
+    char *readBuffer = NULL, buffer[SIMFS_DATA_SIZE];
+    size_t bytesRead, offset;
+    SIMFS_CHECK(simfsReadFile(handle, &readBuffer) == SIMFS_NOT_FOUND_ERROR && readBuffer == NULL);
+    SIMFS_CHECK(simfsReadFileAt(handle, 0, sizeof(buffer), buffer, &bytesRead) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsSeekFile(handle, 0, SIMFS_SEEK_DATA, &offset) == SIMFS_NOT_FOUND_ERROR);
+    SIMFS_CHECK(simfsCloseFile(handle) == SIMFS_NO_ERROR);
+
+    SIMFS_CHECK(simfsTestHasContent("/file/", "still there"));
+    SIMFS_CHECK(simfsTestScrubIsClean());
+    SIMFS_CHECK(simfsUmountFileSystem(simfsTestPath("folder.simfs")) == SIMFS_NO_ERROR);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct simfs_test_type {
+    char *name;
+    void (*test)();
+} SIMFS_TEST_TYPE;
+
+static SIMFS_TEST_TYPE simfsTests[] = {
+    { "snapshot", simfsTestSnapshot },
+    { "deduplication", simfsTestDeduplication },
+    { "compression", simfsTestCompression },
+    { "buffered append", simfsTestBufferedAppend },
+    { "reserve", simfsTestReserve },
+    { "reserve modes", simfsTestReserveModes },
+    { "defragment", simfsTestDefragment },
+    { "scrub", simfsTestScrub },
+    { "arena", simfsTestArena },
+    { "access time", simfsTestAccessTime },
+    { "read directory", simfsTestReadDirectory },
+    { "rename", simfsTestRename },
+    { "striping", simfsTestStriping },
+    { "trace", simfsTestTrace },
+    { "import and export", simfsTestImportExport },
+    { "holes", simfsTestHoles },
+    { "shared mount", simfsTestSharedMount },
+    { "log-structured", simfsTestLogStructured },
+    { "I/O share", simfsTestIoShare },
+    { "usage aggregates", simfsTestUsageAggregates },
+    { "send and receive", simfsTestSendReceive },
+    { "folder handle", simfsTestFolderHandle }
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        simfsTestFolder = argv[1];
+
+    int failed = 0;
+    for (unsigned int t = 0; t < sizeof(simfsTests) / sizeof(SIMFS_TEST_TYPE); t++) {
+        int failures = simfsTestFailures;
+        simfsTests[t].test();
+        if (simfsTestFailures > failures)
+            failed++;
+        printf("%-20s %s\n", simfsTests[t].name, simfsTestFailures > failures ? "FAILED" : "ok");
+    }
+
+    return failed;
+}